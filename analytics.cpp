@@ -0,0 +1,165 @@
+#include "analytics.hpp"
+#include <cmath>
+
+namespace App {
+
+    // 1970-01-01 was a Thursday, weeks start on Monday
+    static int weekStart(int day) {
+        return day - ((day + 3) % 7 + 7) % 7;
+    }
+    static int monthStart(int day) {
+        int y, m, d;
+        civilFromDays(day, y, m, d);
+        return daysFromCivil(y, m, 1);
+    }
+    static int nextMonth(int monthStartDay) {
+        int y, m, d;
+        civilFromDays(monthStartDay, y, m, d);
+        return m == 12 ? daysFromCivil(y + 1, 1, 1) : daysFromCivil(y, m + 1, 1);
+    }
+
+    void downsampleLTTB(const float* xs, const float* ys, size_t n, size_t threshold, Series& out) {
+        out.clear();
+        // threshold 0 means no limit
+        if(threshold == 0 || threshold >= n) {
+            out.xs.assign(xs, xs + n);
+            out.ys.assign(ys, ys + n);
+            return;
+        }
+        if(threshold < 3) {
+            out.xs.push_back(xs[0]);
+            out.ys.push_back(ys[0]);
+            if(threshold == 2) {
+                out.xs.push_back(xs[n - 1]);
+                out.ys.push_back(ys[n - 1]);
+            }
+            return;
+        }
+        out.xs.reserve(threshold);
+        out.ys.reserve(threshold);
+
+        const double every = static_cast<double>(n - 2) / static_cast<double>(threshold - 2);
+        size_t a = 0;
+        out.xs.push_back(xs[0]);
+        out.ys.push_back(ys[0]);
+
+        for(size_t i = 0; i < threshold - 2; i++) {
+            // average of the next bucket is the third point of the triangle
+            size_t avgStart = static_cast<size_t>(std::floor((i + 1) * every)) + 1;
+            size_t avgEnd = static_cast<size_t>(std::floor((i + 2) * every)) + 1;
+            if(avgEnd > n)
+                avgEnd = n;
+            double avgX = 0.0, avgY = 0.0;
+            for(size_t j = avgStart; j < avgEnd; j++) {
+                avgX += xs[j];
+                avgY += ys[j];
+            }
+            const double len = static_cast<double>(avgEnd - avgStart);
+            if(len > 0) {
+                avgX /= len;
+                avgY /= len;
+            }
+
+            size_t rangeStart = static_cast<size_t>(std::floor(i * every)) + 1;
+            size_t rangeEnd = static_cast<size_t>(std::floor((i + 1) * every)) + 1;
+            double maxArea = -1.0;
+            size_t picked = rangeStart;
+            for(size_t j = rangeStart; j < rangeEnd; j++) {
+                double area = std::fabs((xs[a] - avgX) * (ys[j] - ys[a]) -
+                                        (xs[a] - xs[j]) * (avgY - ys[a]));
+                if(area > maxArea) {
+                    maxArea = area;
+                    picked = j;
+                }
+            }
+            out.xs.push_back(xs[picked]);
+            out.ys.push_back(ys[picked]);
+            a = picked;
+        }
+
+        out.xs.push_back(xs[n - 1]);
+        out.ys.push_back(ys[n - 1]);
+    }
+
+    /*
+     * Class: SpendingTimeline
+     */
+    void SpendingTimeline::clear() {
+        daily.clear();
+        weekly.clear();
+        monthly.clear();
+        for(PlotCache& p : plots)
+            p.valid = false;
+        totalSpent = 0.0;
+    }
+
+    void SpendingTimeline::load(const std::vector<int>& days, const std::vector<double>& amounts) {
+        clear();
+        if(days.empty())
+            return;
+        const int first = days.front();
+        const int last = days.back();
+
+        // daily: one slot per day between the first and the last purchase
+        const size_t dayCount = static_cast<size_t>(last - first) + 1;
+        daily.xs.resize(dayCount);
+        daily.ys.assign(dayCount, 0.0f);
+        for(size_t i = 0; i < dayCount; i++)
+            daily.xs[i] = static_cast<float>(first + static_cast<int>(i));
+        for(size_t i = 0; i < days.size(); i++) {
+            daily.ys[days[i] - first] += static_cast<float>(amounts[i]);
+            totalSpent += amounts[i];
+        }
+
+        // weekly
+        const int firstWeek = weekStart(first);
+        const size_t weekCount = static_cast<size_t>((weekStart(last) - firstWeek) / 7) + 1;
+        weekly.xs.resize(weekCount);
+        weekly.ys.assign(weekCount, 0.0f);
+        for(size_t i = 0; i < weekCount; i++)
+            weekly.xs[i] = static_cast<float>(firstWeek + 7 * static_cast<int>(i));
+        for(size_t i = 0; i < dayCount; i++)
+            weekly.ys[(weekStart(first + static_cast<int>(i)) - firstWeek) / 7] += daily.ys[i];
+
+        // monthly
+        const int lastMonth = monthStart(last);
+        for(int m = monthStart(first); m <= lastMonth; m = nextMonth(m)) {
+            monthly.xs.push_back(static_cast<float>(m));
+            monthly.ys.push_back(0.0f);
+        }
+        size_t slot = 0;
+        int slotEnd = monthly.xs.size() > 1 ? static_cast<int>(monthly.xs[1]) : last + 1;
+        for(size_t i = 0; i < dayCount; i++) {
+            const int day = first + static_cast<int>(i);
+            while(day >= slotEnd) {
+                slot++;
+                slotEnd = slot + 1 < monthly.xs.size() ? static_cast<int>(monthly.xs[slot + 1]) : last + 1;
+            }
+            monthly.ys[slot] += daily.ys[i];
+        }
+    }
+
+    const Series& SpendingTimeline::series(SeriesBucket bucket) const {
+        switch(bucket) {
+            case SeriesBucket::WEEK:
+                return weekly;
+            case SeriesBucket::MONTH:
+                return monthly;
+            default:
+                return daily;
+        }
+    }
+
+    const Series& SpendingTimeline::plot(SeriesBucket bucket, size_t maxPoints) {
+        PlotCache& cache = plots[static_cast<int>(bucket)];
+        if(cache.valid && cache.maxPoints == maxPoints)
+            return cache.points;
+        const Series& src = series(bucket);
+        downsampleLTTB(src.xs.data(), src.ys.data(), src.size(), maxPoints, cache.points);
+        cache.maxPoints = maxPoints;
+        cache.valid = true;
+        return cache.points;
+    }
+    // end of Class: SpendingTimeline
+
+}
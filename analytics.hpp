@@ -0,0 +1,73 @@
+#ifndef ANALYTICS_H
+#define ANALYTICS_H
+#include <vector>
+#include <cstddef>
+#include "date.hpp"
+
+namespace App {
+
+    enum class SeriesBucket {
+        DAY,
+        WEEK,
+        MONTH
+    };
+
+    /*
+     * A plottable series. xs holds the bucket start as days since 1970-01-01,
+     * ys the amount spent in that bucket. Both arrays are contiguous so they
+     * can be handed to ImGui::PlotLines/PlotHistogram without copying.
+     */
+    struct Series {
+        std::vector<float> xs;
+        std::vector<float> ys;
+        size_t size() const { return ys.size(); }
+        bool empty() const { return ys.empty(); }
+        void clear() { xs.clear(); ys.clear(); }
+    };
+
+    /*
+     * Largest-Triangle-Three-Buckets downsampling.
+     * Keeps the first and last points and picks one point per bucket that preserves
+     * the visual shape of the line. If n <= threshold (or threshold is 0) the input is copied as is.
+     */
+    void downsampleLTTB(const float* xs, const float* ys, size_t n, size_t threshold, Series& out);
+
+    /*
+     * Spending over time, precomputed from the per-day totals in GIFTS.
+     * Daily totals are loaded once with a single GROUP BY query (see GiftPlanner::spendingTimeline()),
+     * week and month series are rolled up from them in memory. Every series is dense
+     * (empty buckets are 0) so index i maps to a fixed time step.
+     *
+     * plot() caches the last downsampled result per bucket, so calling it every frame
+     * with the same width costs nothing.
+     */
+    class SpendingTimeline {
+        public:
+            // days: days since epoch in ascending order, amounts: spending on that day.
+            // The series span first to last day, callers bound the range they load
+            void load(const std::vector<int>& days, const std::vector<double>& amounts);
+            void clear();
+
+            const Series& series(SeriesBucket bucket) const;
+            // Returns the series for bucket with at most maxPoints points
+            const Series& plot(SeriesBucket bucket, size_t maxPoints);
+
+            double total() const { return totalSpent; }
+            bool empty() const { return daily.empty(); }
+
+        private:
+            struct PlotCache {
+                size_t maxPoints = 0;
+                bool valid = false;
+                Series points;
+            };
+            Series daily;
+            Series weekly;
+            Series monthly;
+            PlotCache plots[3];
+            double totalSpent = 0.0;
+    };
+
+}
+
+#endif
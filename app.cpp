@@ -1,9 +1,94 @@
 #include <iostream> 
+#include <cctype>
 #include <app.hpp>
+#include "query.hpp"
 
 using namespace Engine;
 namespace App {
 
+    // parameter counts are checked when these are compiled
+    // Inserts bring back a deleted row with the same natural key (see deleteGifts). A live duplicate
+    // fails the WHERE, RETURNING gives no row and the insert is reported as a constraint violation
+    // Every query is limited to the rows of one user (GiftPlanner::user), see GiftPlanner::useUser
+    static constexpr Query<Params<int, std::string, std::string>, Columns<int>> INSERT_RECIPIENT(
+        "INSERT INTO RECIPIENTS(UserID, name, relationship) VALUES(?, ?, ?) "
+        "ON CONFLICT(UserID, Name, Relationship) DO UPDATE SET DeletedAt = NULL WHERE RECIPIENTS.DeletedAt IS NOT NULL RETURNING ID;");
+    static constexpr Query<Params<int, int, std::string, std::string, double, GiftStatus, int, double>, Columns<int>> INSERT_GIFT(
+        "INSERT INTO GIFTS(UserID, recipientId, name, link, price, status, eventId, budget, date) "
+        "VALUES(?, ?, ?, ?, ?, ?, ?, ?, date('now', 'localtime')) "
+        "ON CONFLICT(RecipientID, EventID, Name) DO UPDATE SET Link = excluded.Link, Budget = excluded.Budget, "
+        "Price = excluded.Price, Status = excluded.Status, Date = excluded.Date, DeletedAt = NULL "
+        "WHERE GIFTS.DeletedAt IS NOT NULL RETURNING ID;");
+    static constexpr Query<Params<int, std::string, std::string>, Columns<int>> INSERT_EVENT(
+        "INSERT INTO EVENTS(UserID, name, date) VALUES(?, ?, ?) "
+        "ON CONFLICT(UserID, Name) DO UPDATE SET Date = excluded.Date, DeletedAt = NULL WHERE EVENTS.DeletedAt IS NOT NULL RETURNING ID;");
+    static constexpr Query<Params<GiftStatus, int, int>, Columns<>> SET_GIFT_STATUS(
+        "UPDATE GIFTS SET Status = ?, Date = date('now', 'localtime') WHERE ID = ? AND UserID = ? AND DeletedAt IS NULL;");
+    // upserts by natural key, RETURNING gives the ID whether the row was inserted or updated
+    static constexpr Query<Params<int, std::string, std::string>, Columns<int>> UPSERT_RECIPIENT(
+        "INSERT INTO RECIPIENTS(UserID, Name, Relationship) VALUES(?, ?, ?) "
+        "ON CONFLICT(UserID, Name, Relationship) DO UPDATE SET Relationship = excluded.Relationship, DeletedAt = NULL RETURNING ID;");
+    static constexpr Query<Params<int, std::string, std::string>, Columns<int>> UPSERT_EVENT(
+        "INSERT INTO EVENTS(UserID, Name, Date) VALUES(?, ?, ?) "
+        "ON CONFLICT(UserID, Name) DO UPDATE SET Date = excluded.Date, DeletedAt = NULL RETURNING ID;");
+    static constexpr Query<Params<int, int, int, std::string, std::string, double, double, GiftStatus>, Columns<int>> UPSERT_GIFT(
+        "INSERT INTO GIFTS(UserID, RecipientID, EventID, Name, Link, Budget, Price, Status, Date) "
+        "VALUES(?, ?, ?, ?, ?, ?, ?, ?, date('now', 'localtime')) "
+        "ON CONFLICT(RecipientID, EventID, Name) DO UPDATE SET Link = excluded.Link, Budget = excluded.Budget, "
+        "Price = excluded.Price, Status = excluded.Status, "
+        "Date = CASE WHEN GIFTS.Status = excluded.Status AND GIFTS.DeletedAt IS NULL THEN GIFTS.Date ELSE excluded.Date END, "
+        "DeletedAt = NULL RETURNING ID;");
+    // set-based mutations, the IDs are in temp.ID_SET (see loadIdSet). Deletes only set the
+    // DeletedAt tombstone (unix seconds), Compactor removes the rows later
+    static constexpr Query<Params<int>, Columns<>> DELETE_GIFTS(
+        "UPDATE GIFTS SET DeletedAt = CAST(strftime('%s', 'now') AS INTEGER) "
+        "WHERE ID IN (SELECT ID FROM temp.ID_SET) AND UserID = ? AND DeletedAt IS NULL;");
+    static constexpr Query<Params<int>, Columns<>> DELETE_EVENTS(
+        "UPDATE EVENTS SET DeletedAt = CAST(strftime('%s', 'now') AS INTEGER) "
+        "WHERE ID IN (SELECT ID FROM temp.ID_SET) AND UserID = ? AND DeletedAt IS NULL;");
+    static constexpr Query<Params<int>, Columns<>> DELETE_RECIPIENTS(
+        "UPDATE RECIPIENTS SET DeletedAt = CAST(strftime('%s', 'now') AS INTEGER) "
+        "WHERE ID IN (SELECT ID FROM temp.ID_SET) AND UserID = ? AND DeletedAt IS NULL;");
+    static constexpr Query<Params<int>, Columns<>> DELETE_EVENT_GIFTS(
+        "UPDATE GIFTS SET DeletedAt = CAST(strftime('%s', 'now') AS INTEGER) "
+        "WHERE EventID IN (SELECT ID FROM temp.ID_SET) AND UserID = ? AND DeletedAt IS NULL;");
+    static constexpr Query<Params<int>, Columns<>> DELETE_RECIPIENT_GIFTS(
+        "UPDATE GIFTS SET DeletedAt = CAST(strftime('%s', 'now') AS INTEGER) "
+        "WHERE RecipientID IN (SELECT ID FROM temp.ID_SET) AND UserID = ? AND DeletedAt IS NULL;");
+    static constexpr Query<Params<GiftStatus, GiftStatus, int>, Columns<>> SET_GIFTS_STATUS(
+        "UPDATE GIFTS SET Status = ?, Date = date('now', 'localtime') "
+        "WHERE ID IN (SELECT ID FROM temp.ID_SET) AND Status <> ? AND UserID = ? AND DeletedAt IS NULL;");
+    static constexpr Query<Params<int, int>, Columns<>> MOVE_GIFTS(
+        "UPDATE GIFTS SET EventID = ? WHERE ID IN (SELECT ID FROM temp.ID_SET) AND UserID = ? AND DeletedAt IS NULL;");
+    static constexpr Query<Params<int>, Columns<int, std::string, std::string>> SELECT_EVENTS(
+        "SELECT ID, Name, strftime('%d-%m-%Y', Date) FROM EVENTS WHERE UserID = ? AND DeletedAt IS NULL ORDER BY Date;");
+    // a range scan of EVENTS_DATE, from and to are ISO dates
+    static constexpr Query<Params<int, std::string, std::string>, Columns<int, std::string, std::string>> SELECT_EVENTS_BETWEEN(
+        "SELECT ID, Name, strftime('%d-%m-%Y', Date) FROM EVENTS WHERE UserID = ? AND Date BETWEEN ? AND ? AND DeletedAt IS NULL ORDER BY Date;");
+    static constexpr Query<Params<int>, Columns<int, std::string, std::string>> SELECT_RECIPIENTS(
+        "SELECT ID, Name, Relationship FROM RECIPIENTS WHERE UserID = ? AND DeletedAt IS NULL;");
+    static constexpr Query<Params<>, Columns<int, std::string>> SELECT_USERS(
+        "SELECT ID, COALESCE(Name, '') FROM USER ORDER BY ID;");
+    static constexpr Query<Params<int>, Columns<int, std::string>> SELECT_USER(
+        "SELECT ID, COALESCE(Name, '') FROM USER WHERE ID = ?;");
+    static constexpr Query<Params<std::string>, Columns<int>> INSERT_USER(
+        "INSERT INTO USER(Name) VALUES(?) RETURNING ID;");
+    static constexpr Query<Params<int, int, int, long long, std::string>, Columns<int>> INSERT_REMINDER(
+        "INSERT INTO REMINDERS(UserID, EventID, GiftID, DueAt, Message) VALUES(?, NULLIF(?, 0), NULLIF(?, 0), ?, ?) RETURNING ID;");
+    // event reminders keep their lead, EVENTS_REMINDERS_FOLLOW moves them with the date
+    static constexpr Query<Params<long long, long long, std::string, int, int>, Columns<int, long long, std::string>> INSERT_EVENT_REMINDER(
+        "INSERT INTO REMINDERS(UserID, EventID, DueAt, Lead, Message) "
+        "SELECT UserID, ID, CAST(strftime('%s', Date, 'utc') AS INTEGER) - ?, ?, COALESCE(NULLIF(?, ''), Name) "
+        "FROM EVENTS WHERE ID = ? AND UserID = ? AND DeletedAt IS NULL RETURNING ID, DueAt, Message;");
+    static constexpr Query<Params<int, long long>, Columns<int, int, int, long long, std::string>> SELECT_PENDING_REMINDERS(
+        "SELECT r.ID, COALESCE(r.EventID, 0), COALESCE(r.GiftID, 0), r.DueAt, r.Message FROM REMINDERS r "
+        "LEFT JOIN EVENTS e ON e.ID = r.EventID LEFT JOIN GIFTS g ON g.ID = r.GiftID "
+        "WHERE r.UserID = ? AND r.FiredAt IS NULL AND r.DueAt <= ? AND e.DeletedAt IS NULL AND g.DeletedAt IS NULL ORDER BY r.DueAt;");
+    static constexpr Query<Params<int, int>, Columns<>> MARK_REMINDER_FIRED(
+        "UPDATE REMINDERS SET FiredAt = CAST(strftime('%s', 'now') AS INTEGER) WHERE ID = ? AND UserID = ?;");
+    static constexpr Query<Params<int, int>, Columns<>> DELETE_REMINDER(
+        "DELETE FROM REMINDERS WHERE ID = ? AND UserID = ?;");
+
     //convert string to double
     double strToDouble(const std::string& str) {
         return std::stod(str);
@@ -12,8 +97,18 @@ namespace App {
         return std::to_string(num);
     }
 
-    void GiftPlanner::init(const std::string& filename) {
-        db=new DBEngine(filename, false);
+    void GiftPlanner::init(const std::string& filename, const DBConfig& config) {
+        db=new DBEngine(filename, false, 16, config);
+        // any committed change to GIFTS invalidates the precomputed spending series of every user
+        db->subscribe([this](const ChangeBatch& changes) {
+            for(const RowChange& change : changes) {
+                if(change.table == "GIFTS") {
+                    for(auto& entry : spending)
+                        entry.second.stale = true;
+                    return;
+                }
+            }
+        });
     }
     GiftPlanner::~GiftPlanner() {
         if(db){
@@ -21,21 +116,72 @@ namespace App {
             db = nullptr;
         }
     }
+    /*
+     * EVENTS had a UNIQUE Name, a name is now unique per user (EVENTS_KEY). SQLite can't drop a
+     * column constraint, the table is copied into a new one. Foreign keys are off while the old
+     * table is dropped, or its gifts and reminders would go with it; that can't be changed inside
+     * a transaction, so this runs before initialize_tables' own. Triggers and indexes of EVENTS
+     * go with the old table, initialize_tables creates them again.
+     */
+    static void addUserToEvents(DBEngine* db, bool tombstones) {
+        std::string rebuild = std::string(R"(
+        PRAGMA foreign_keys = OFF;
+        BEGIN IMMEDIATE;
+        CREATE TABLE EVENTS_NEW (
+            ID INTEGER PRIMARY KEY AUTOINCREMENT,
+            UserID INTEGER NOT NULL DEFAULT 1,
+            Name TEXT NOT NULL,
+            Date TEXT NOT NULL,
+            DeletedAt INTEGER
+            );
+        INSERT INTO EVENTS_NEW(ID, Name, Date, DeletedAt) SELECT ID, Name, Date, )") + (tombstones ? "DeletedAt" : "NULL") + R"( FROM EVENTS;
+        DROP TABLE EVENTS;
+        ALTER TABLE EVENTS_NEW RENAME TO EVENTS;
+        COMMIT;
+        )";
+        // a failed step leaves the transaction open, nothing of it is kept
+        if(db->execute(rebuild, "Add user IDs to events") != ENGINE_OK)
+            db->execute("ROLLBACK;", "Undo events rebuild");
+        db->execute(std::string("PRAGMA foreign_keys = ") + (db->config().foreignKeys ? "ON" : "OFF") + ";", "Restore foreign keys");
+    }
+
     void GiftPlanner::initialize_tables(){
         
+        auto exists = [this](const char* name) {
+            PreparedStatement stmt(db, "SELECT COUNT(*) FROM sqlite_master WHERE name = ?;");
+            stmt.bind(1, name);
+            stmt.step();
+            return Row(stmt.get()).get<int>(0) > 0;
+        };
+        auto hasColumn = [this](const char* table, const char* column) {
+            PreparedStatement stmt(db, "SELECT COUNT(*) FROM pragma_table_info(?) WHERE name = ?;");
+            stmt.bind(1, table);
+            stmt.bind(2, column);
+            stmt.step();
+            return Row(stmt.get()).get<int>(0) > 0;
+        };
+        // the rebuild drops EVENTS_DATE, dates are converted to ISO by whether it was there
+        bool datesIso = exists("EVENTS_DATE");
+        bool partitioned = !exists("EVENTS") || hasColumn("EVENTS", "UserID");
+        if(!partitioned)
+            addUserToEvents(db, hasColumn("EVENTS", "DeletedAt"));
+
         // create Recipients table
         Transaction tx(db);
         std::string recipients_table = R"(
         CREATE TABLE IF NOT EXISTS RECIPIENTS (
             ID INTEGER PRIMARY KEY AUTOINCREMENT,
+            UserID INTEGER NOT NULL DEFAULT 1,
             Name TEXT NOT NULL,
-            Relationship TEXT
+            Relationship TEXT,
+            DeletedAt INTEGER
             );
         )";
 
         std::string gifts_table = R"(
         CREATE TABLE IF NOT EXISTS GIFTS (
             ID INTEGER PRIMARY KEY AUTOINCREMENT,
+            UserID INTEGER NOT NULL DEFAULT 1,
             RecipientID INTEGER NOT NULL,
             EventID INTEGER NOT NULL,
             Name TEXT NOT NULL,
@@ -44,6 +190,7 @@ namespace App {
             Price TEXT,
             Status INTEGER DEFAULT 0,
             Date TEXT,
+            DeletedAt INTEGER,
             FOREIGN KEY(RecipientID) REFERENCES RECIPIENTS(ID) ON DELETE CASCADE,
             FOREIGN KEY(EventID) REFERENCES EVENTS(ID) ON DELETE CASCADE
             );
@@ -52,8 +199,10 @@ namespace App {
         std::string event_table = R"(
         CREATE TABLE IF NOT EXISTS EVENTS (
             ID INTEGER PRIMARY KEY AUTOINCREMENT,
-            Name TEXT NOT NULL UNIQUE,
-            Date TEXT NOT NULL
+            UserID INTEGER NOT NULL DEFAULT 1,
+            Name TEXT NOT NULL,
+            Date TEXT NOT NULL,
+            DeletedAt INTEGER
             );
         )";
 
@@ -68,49 +217,404 @@ namespace App {
             );
         )";
 
+        /*
+         * Reminders. DueAt is unix seconds, the partial index (user_keys) holds only the ones still
+         * to fire, a user's next ones due are a range scan. Lead is set for reminders relative to their event's
+         * date, the trigger moves them when the date changes.
+         */
+        std::string reminders_table = R"(
+        CREATE TABLE IF NOT EXISTS REMINDERS (
+            ID INTEGER PRIMARY KEY AUTOINCREMENT,
+            UserID INTEGER NOT NULL DEFAULT 1,
+            EventID INTEGER,
+            GiftID INTEGER,
+            DueAt INTEGER NOT NULL,
+            Lead INTEGER,
+            Message TEXT NOT NULL,
+            FiredAt INTEGER,
+            FOREIGN KEY(EventID) REFERENCES EVENTS(ID) ON DELETE CASCADE,
+            FOREIGN KEY(GiftID) REFERENCES GIFTS(ID) ON DELETE CASCADE
+            );
+        CREATE TRIGGER IF NOT EXISTS EVENTS_REMINDERS_FOLLOW AFTER UPDATE OF Date ON EVENTS BEGIN
+            UPDATE REMINDERS SET DueAt = CAST(strftime('%s', new.Date, 'utc') AS INTEGER) - Lead
+            WHERE EventID = new.ID AND Lead IS NOT NULL AND FiredAt IS NULL;
+        END;
+        )";
+
+        /*
+         * Search index. One FTS5 table for all three tables, the rowid encodes
+         * the source as ID * 4 + SearchKind so triggers can find their row without a scan.
+         * Title is weighted above Detail in the ranking. Owner is 'u' || UserID, a search matches
+         * it too and only reads the current user's postings; it doesn't count in the ranking.
+         */
+        std::string search_index = R"(
+        CREATE VIRTUAL TABLE IF NOT EXISTS SEARCH_INDEX USING fts5(
+            Title,
+            Detail,
+            Owner,
+            tokenize = 'unicode61 remove_diacritics 2',
+            prefix = '2 3'
+            );
+        )";
+
+        std::string search_triggers = R"(
+        CREATE TRIGGER IF NOT EXISTS GIFTS_SEARCH_INSERT AFTER INSERT ON GIFTS BEGIN
+            INSERT INTO SEARCH_INDEX(rowid, Title, Detail, Owner) VALUES(new.ID * 4, new.Name, new.Link, 'u' || new.UserID);
+        END;
+        CREATE TRIGGER IF NOT EXISTS GIFTS_SEARCH_UPDATE AFTER UPDATE OF Name, Link ON GIFTS BEGIN
+            UPDATE SEARCH_INDEX SET Title = new.Name, Detail = new.Link WHERE rowid = old.ID * 4;
+        END;
+        CREATE TRIGGER IF NOT EXISTS GIFTS_SEARCH_DELETE AFTER DELETE ON GIFTS BEGIN
+            DELETE FROM SEARCH_INDEX WHERE rowid = old.ID * 4;
+        END;
+        CREATE TRIGGER IF NOT EXISTS RECIPIENTS_SEARCH_INSERT AFTER INSERT ON RECIPIENTS BEGIN
+            INSERT INTO SEARCH_INDEX(rowid, Title, Detail, Owner) VALUES(new.ID * 4 + 1, new.Name, new.Relationship, 'u' || new.UserID);
+        END;
+        CREATE TRIGGER IF NOT EXISTS RECIPIENTS_SEARCH_UPDATE AFTER UPDATE OF Name, Relationship ON RECIPIENTS BEGIN
+            UPDATE SEARCH_INDEX SET Title = new.Name, Detail = new.Relationship WHERE rowid = old.ID * 4 + 1;
+        END;
+        CREATE TRIGGER IF NOT EXISTS RECIPIENTS_SEARCH_DELETE AFTER DELETE ON RECIPIENTS BEGIN
+            DELETE FROM SEARCH_INDEX WHERE rowid = old.ID * 4 + 1;
+        END;
+        CREATE TRIGGER IF NOT EXISTS EVENTS_SEARCH_INSERT AFTER INSERT ON EVENTS BEGIN
+            INSERT INTO SEARCH_INDEX(rowid, Title, Owner) VALUES(new.ID * 4 + 2, new.Name, 'u' || new.UserID);
+        END;
+        CREATE TRIGGER IF NOT EXISTS EVENTS_SEARCH_UPDATE AFTER UPDATE OF Name ON EVENTS BEGIN
+            UPDATE SEARCH_INDEX SET Title = new.Name WHERE rowid = old.ID * 4 + 2;
+        END;
+        CREATE TRIGGER IF NOT EXISTS EVENTS_SEARCH_DELETE AFTER DELETE ON EVENTS BEGIN
+            DELETE FROM SEARCH_INDEX WHERE rowid = old.ID * 4 + 2;
+        END;
+        )";
+
+        // existing databases get their index filled once
+        std::string search_backfill = R"(
+        INSERT INTO SEARCH_INDEX(rowid, Title, Detail, Owner) SELECT ID * 4, Name, Link, 'u' || UserID FROM GIFTS WHERE DeletedAt IS NULL;
+        INSERT INTO SEARCH_INDEX(rowid, Title, Detail, Owner) SELECT ID * 4 + 1, Name, Relationship, 'u' || UserID FROM RECIPIENTS WHERE DeletedAt IS NULL;
+        INSERT INTO SEARCH_INDEX(rowid, Title, Owner) SELECT ID * 4 + 2, Name, 'u' || UserID FROM EVENTS WHERE DeletedAt IS NULL;
+        INSERT INTO SEARCH_INDEX(SEARCH_INDEX, rank) VALUES('rank', 'bm25(10.0, 1.0, 0.0)');
+        )";
+
+        // an index from before Owner is built again, with its triggers
+        std::string search_owner = R"(
+        DROP TRIGGER IF EXISTS GIFTS_SEARCH_INSERT;
+        DROP TRIGGER IF EXISTS RECIPIENTS_SEARCH_INSERT;
+        DROP TRIGGER IF EXISTS EVENTS_SEARCH_INSERT;
+        DROP TRIGGER IF EXISTS GIFTS_SEARCH_RESTORE;
+        DROP TRIGGER IF EXISTS RECIPIENTS_SEARCH_RESTORE;
+        DROP TRIGGER IF EXISTS EVENTS_SEARCH_RESTORE;
+        DROP TABLE SEARCH_INDEX;
+        )";
+
+        /*
+         * Natural keys for the upserts: a recipient is its name and relationship, a gift its
+         * recipient, event and name. A missing relationship is stored as '', NULLs never conflict
+         * in a unique index. Databases from before the keys are deduplicated once, the oldest
+         * row wins and gifts of a removed duplicate recipient move to it.
+         */
+        std::string dedupe = R"(
+        UPDATE RECIPIENTS SET Relationship = '' WHERE Relationship IS NULL;
+        CREATE TEMP TABLE RECIPIENT_DUPLICATES(ID INTEGER PRIMARY KEY, Keep INTEGER NOT NULL);
+        INSERT INTO RECIPIENT_DUPLICATES(ID, Keep)
+            SELECT r.ID, k.Keep FROM RECIPIENTS r
+            JOIN (SELECT Name, Relationship, MIN(ID) AS Keep FROM RECIPIENTS GROUP BY Name, Relationship) k
+              ON k.Name = r.Name AND k.Relationship = r.Relationship
+            WHERE r.ID <> k.Keep;
+        UPDATE GIFTS SET RecipientID = (SELECT Keep FROM RECIPIENT_DUPLICATES d WHERE d.ID = GIFTS.RecipientID)
+            WHERE RecipientID IN (SELECT ID FROM RECIPIENT_DUPLICATES);
+        DELETE FROM RECIPIENTS WHERE ID IN (SELECT ID FROM RECIPIENT_DUPLICATES);
+        DROP TABLE RECIPIENT_DUPLICATES;
+        DELETE FROM GIFTS WHERE ID NOT IN (SELECT MIN(ID) FROM GIFTS GROUP BY RecipientID, EventID, Name);
+        )";
+
+        /*
+         * Soft deletes. DeletedAt is NULL while a row is live, a tombstoned row leaves the search
+         * index and comes back into it when restored. The partial indexes hold only tombstones,
+         * Compactor finds its next batch without scanning live rows. A live gift needs a live
+         * recipient and event, purging a tombstoned parent would cascade to it.
+         */
+        std::string tombstones = R"(
+        CREATE INDEX IF NOT EXISTS GIFTS_TOMBSTONES ON GIFTS(DeletedAt) WHERE DeletedAt IS NOT NULL;
+        CREATE INDEX IF NOT EXISTS RECIPIENTS_TOMBSTONES ON RECIPIENTS(DeletedAt) WHERE DeletedAt IS NOT NULL;
+        CREATE INDEX IF NOT EXISTS EVENTS_TOMBSTONES ON EVENTS(DeletedAt) WHERE DeletedAt IS NOT NULL;
+        CREATE TRIGGER IF NOT EXISTS GIFTS_LIVE_PARENT_INSERT BEFORE INSERT ON GIFTS
+        WHEN new.DeletedAt IS NULL AND (
+            EXISTS(SELECT 1 FROM RECIPIENTS WHERE ID = new.RecipientID AND DeletedAt IS NOT NULL)
+            OR EXISTS(SELECT 1 FROM EVENTS WHERE ID = new.EventID AND DeletedAt IS NOT NULL)) BEGIN
+            SELECT RAISE(ABORT, 'gift of a deleted recipient or event');
+        END;
+        CREATE TRIGGER IF NOT EXISTS GIFTS_LIVE_PARENT_UPDATE BEFORE UPDATE OF RecipientID, EventID, DeletedAt ON GIFTS
+        WHEN new.DeletedAt IS NULL AND (
+            EXISTS(SELECT 1 FROM RECIPIENTS WHERE ID = new.RecipientID AND DeletedAt IS NOT NULL)
+            OR EXISTS(SELECT 1 FROM EVENTS WHERE ID = new.EventID AND DeletedAt IS NOT NULL)) BEGIN
+            SELECT RAISE(ABORT, 'gift of a deleted recipient or event');
+        END;
+        CREATE TRIGGER IF NOT EXISTS GIFTS_SEARCH_TOMBSTONE AFTER UPDATE OF DeletedAt ON GIFTS
+        WHEN old.DeletedAt IS NULL AND new.DeletedAt IS NOT NULL BEGIN
+            DELETE FROM SEARCH_INDEX WHERE rowid = old.ID * 4;
+        END;
+        CREATE TRIGGER IF NOT EXISTS GIFTS_SEARCH_RESTORE AFTER UPDATE OF DeletedAt ON GIFTS
+        WHEN old.DeletedAt IS NOT NULL AND new.DeletedAt IS NULL BEGIN
+            INSERT INTO SEARCH_INDEX(rowid, Title, Detail, Owner) VALUES(new.ID * 4, new.Name, new.Link, 'u' || new.UserID);
+        END;
+        CREATE TRIGGER IF NOT EXISTS RECIPIENTS_SEARCH_TOMBSTONE AFTER UPDATE OF DeletedAt ON RECIPIENTS
+        WHEN old.DeletedAt IS NULL AND new.DeletedAt IS NOT NULL BEGIN
+            DELETE FROM SEARCH_INDEX WHERE rowid = old.ID * 4 + 1;
+        END;
+        CREATE TRIGGER IF NOT EXISTS RECIPIENTS_SEARCH_RESTORE AFTER UPDATE OF DeletedAt ON RECIPIENTS
+        WHEN old.DeletedAt IS NOT NULL AND new.DeletedAt IS NULL BEGIN
+            INSERT INTO SEARCH_INDEX(rowid, Title, Detail, Owner) VALUES(new.ID * 4 + 1, new.Name, new.Relationship, 'u' || new.UserID);
+        END;
+        CREATE TRIGGER IF NOT EXISTS EVENTS_SEARCH_TOMBSTONE AFTER UPDATE OF DeletedAt ON EVENTS
+        WHEN old.DeletedAt IS NULL AND new.DeletedAt IS NOT NULL BEGIN
+            DELETE FROM SEARCH_INDEX WHERE rowid = old.ID * 4 + 2;
+        END;
+        CREATE TRIGGER IF NOT EXISTS EVENTS_SEARCH_RESTORE AFTER UPDATE OF DeletedAt ON EVENTS
+        WHEN old.DeletedAt IS NOT NULL AND new.DeletedAt IS NULL BEGIN
+            INSERT INTO SEARCH_INDEX(rowid, Title, Owner) VALUES(new.ID * 4 + 2, new.Name, 'u' || new.UserID);
+        END;
+        )";
+
+        /*
+         * Dates are ISO 8601 text (see date.hpp), events are ordered and ranged on EVENTS_DATE.
+         * Databases from before stored dd-mm-YYYY and are converted once. The reminders trigger
+         * reads the old format, it goes first and reminders_table creates it again.
+         */
+        std::string iso_dates = R"(
+        DROP TRIGGER IF EXISTS EVENTS_REMINDERS_FOLLOW;
+        UPDATE EVENTS SET Date = substr(Date, 7, 4) || '-' || substr(Date, 4, 2) || '-' || substr(Date, 1, 2)
+            WHERE Date GLOB '[0-9][0-9]-[0-9][0-9]-[0-9][0-9][0-9][0-9]';
+        UPDATE GIFTS SET Date = substr(Date, 7, 4) || '-' || substr(Date, 4, 2) || '-' || substr(Date, 1, 2)
+            WHERE Date GLOB '[0-9][0-9]-[0-9][0-9]-[0-9][0-9][0-9][0-9]';
+        )";
+
+        std::string date_index = R"(
+        CREATE INDEX IF NOT EXISTS EVENTS_DATE ON EVENTS(UserID, Date) WHERE DeletedAt IS NULL;
+        )";
+
+        std::string natural_keys = R"(
+        CREATE UNIQUE INDEX IF NOT EXISTS RECIPIENTS_KEY ON RECIPIENTS(UserID, Name, Relationship);
+        CREATE UNIQUE INDEX IF NOT EXISTS EVENTS_KEY ON EVENTS(UserID, Name);
+        CREATE UNIQUE INDEX IF NOT EXISTS GIFTS_KEY ON GIFTS(RecipientID, EventID, Name);
+        CREATE INDEX IF NOT EXISTS GIFTS_EVENT ON GIFTS(EventID);
+        )";
+
+        /*
+         * Users. Every row has the UserID of the user it belongs to and the planner's queries are
+         * led by it, so the indexes a user's reads go through start with UserID and one user's
+         * queries never scan another's rows. Gifts and reminders must refer to events, recipients
+         * and gifts of their own user. Databases from before belong to user 1, the indexes that
+         * didn't lead with UserID are dropped and created again.
+         */
+        std::string user_keys = R"(
+        CREATE INDEX IF NOT EXISTS REMINDERS_DUE ON REMINDERS(UserID, DueAt) WHERE FiredAt IS NULL;
+        CREATE INDEX IF NOT EXISTS GIFTS_USER_STATUS ON GIFTS(UserID, Status) WHERE DeletedAt IS NULL;
+        CREATE TRIGGER IF NOT EXISTS GIFTS_OWNER_INSERT BEFORE INSERT ON GIFTS
+        WHEN EXISTS(SELECT 1 FROM RECIPIENTS WHERE ID = new.RecipientID AND UserID <> new.UserID)
+          OR EXISTS(SELECT 1 FROM EVENTS WHERE ID = new.EventID AND UserID <> new.UserID) BEGIN
+            SELECT RAISE(ABORT, 'gift of another user''s recipient or event');
+        END;
+        CREATE TRIGGER IF NOT EXISTS GIFTS_OWNER_UPDATE BEFORE UPDATE OF RecipientID, EventID ON GIFTS
+        WHEN EXISTS(SELECT 1 FROM RECIPIENTS WHERE ID = new.RecipientID AND UserID <> new.UserID)
+          OR EXISTS(SELECT 1 FROM EVENTS WHERE ID = new.EventID AND UserID <> new.UserID) BEGIN
+            SELECT RAISE(ABORT, 'gift of another user''s recipient or event');
+        END;
+        CREATE TRIGGER IF NOT EXISTS REMINDERS_OWNER_INSERT BEFORE INSERT ON REMINDERS
+        WHEN EXISTS(SELECT 1 FROM EVENTS WHERE ID = new.EventID AND UserID <> new.UserID)
+          OR EXISTS(SELECT 1 FROM GIFTS WHERE ID = new.GiftID AND UserID <> new.UserID) BEGIN
+            SELECT RAISE(ABORT, 'reminder of another user''s event or gift');
+        END;
+        )";
+
+        std::string unpartitioned_keys = R"(
+        DROP INDEX IF EXISTS RECIPIENTS_KEY;
+        DROP INDEX IF EXISTS REMINDERS_DUE;
+        )";
+
+        bool indexExists = exists("SEARCH_INDEX");
+        bool keysExist = exists("RECIPIENTS_KEY");
+
         db->execute(event_table, "Create Event table");
         db->execute(recipients_table, "Create Recipients table");
         db->execute(gifts_table, "Create Gifts table");
         db->execute(user_data, "Create User data table");
+        if(!datesIso)
+            db->execute(iso_dates, "Convert dates to ISO 8601");
+        db->execute(reminders_table, "Create Reminders table");
+        for(const char* table : {"EVENTS", "RECIPIENTS", "GIFTS"}) {
+            if(!hasColumn(table, "DeletedAt"))
+                db->execute(std::string("ALTER TABLE ") + table + " ADD COLUMN DeletedAt INTEGER;", "Add tombstones");
+        }
+        for(const char* table : {"RECIPIENTS", "GIFTS", "REMINDERS"}) {
+            if(!hasColumn(table, "UserID"))
+                db->execute(std::string("ALTER TABLE ") + table + " ADD COLUMN UserID INTEGER NOT NULL DEFAULT 1;", "Add user IDs");
+        }
+        if(indexExists && !hasColumn("SEARCH_INDEX", "Owner")) {
+            db->execute(search_owner, "Drop search index without owners");
+            indexExists = false;
+        }
+        db->execute(search_index, "Create search index");
+        if(!indexExists)
+            db->execute(search_backfill, "Fill search index");
+        db->execute(search_triggers, "Create search triggers");
+        if(!keysExist)
+            db->execute(dedupe, "Deduplicate recipients and gifts");
+        if(!partitioned)
+            db->execute(unpartitioned_keys, "Drop keys without user IDs");
+        db->execute(natural_keys, "Create natural keys");
+        db->execute(user_keys, "Create user indexes");
+        db->execute(tombstones, "Create tombstone indexes");
+        db->execute(date_index, "Create date index");
         tx.commit();
 
     }
 
-    void GiftPlanner::addRecipient(Recipient recipient) {
+    // Events take dd-mm-YYYY or ISO dates, they are stored as ISO
+    static Date eventDate(const std::string& text) {
+        std::optional<Date> date = parseDate(text);
+        if(!date)
+            throw ConstraintError("Invalid date '" + text + "', expected dd-mm-YYYY", SQLITE_CONSTRAINT);
+        return *date;
+    }
+
+    // The inserts return no ID when a live row already has the natural key
+    static int insertedId(const std::optional<int>& id, const std::string& what) {
+        if(!id)
+            throw ConstraintError(what + " already exists", SQLITE_CONSTRAINT);
+        return *id;
+    }
+
+    Recipient GiftPlanner::addRecipient(Recipient recipient) {
         Transaction tx(db);
-        PreparedStatement stmt(db, "INSERT INTO RECIPIENTS(name, relationship) VALUES(?, ?);");
-        stmt.bind(1, recipient.name);
-        stmt.bind(2, recipient.relationship); 
-        stmt.step();
+        recipient.id = insertedId(INSERT_RECIPIENT.one<int>(db, user, recipient.name, recipient.relationship), "Recipient " + recipient.name);
         tx.commit();
+        return recipient;
     }
-    void GiftPlanner::addGift(Gift gift) {
+    Gift GiftPlanner::addGift(Gift gift) {
         Transaction tx(db);
-        PreparedStatement stmt(db, "INSERT INTO GIFTS(recipientId, name, link, price, status, eventId, budget) VALUES(?, ?, ?, ?, ?, ?, ?);");
-        stmt.bind(1, gift.recipientId);
-        stmt.bind(2, gift.name);
-        stmt.bind(3, gift.link);
-        stmt.bind(4, doubleToStr(gift.price));
-        stmt.bind(5, static_cast<int>(gift.status));
-        stmt.bind(6, gift.eventId);
-        stmt.bind(7, doubleToStr(gift.budgetLimit));
-        stmt.step();
+        // Date records the last status change, spending charts are bucketed by it
+        gift.id = insertedId(INSERT_GIFT.one<int>(db, user, gift.recipientId, gift.name, gift.link, gift.price, gift.status,
+                                                  gift.eventId, gift.budgetLimit), "Gift " + gift.name);
         tx.commit();
+        return gift;
     }
-    void GiftPlanner::addEvent(Event event) {
+    Event GiftPlanner::addEvent(Event event) {
+        Date date = eventDate(event.eventDate);
         Transaction tx(db);
-        PreparedStatement stmt(db, "INSERT INTO EVENTS(name, date) VALUES(?, ?);");
-        stmt.bind(1, event.eventName);
-        stmt.bind(2, event.eventDate);
-        stmt.step();
+        event.eventId = insertedId(INSERT_EVENT.one<int>(db, user, event.eventName, formatDate(date).view()), "Event " + event.eventName);
+        event.eventDate = formatDate(date, DateFormat::DISPLAY).c_str();
+        tx.commit();
+        return event;
+    }
+    int GiftPlanner::upsertRecipient(const Recipient& recipient) {
+        return *UPSERT_RECIPIENT.one<int>(db, user, recipient.name, recipient.relationship);
+    }
+    int GiftPlanner::upsertEvent(const Event& event) {
+        return *UPSERT_EVENT.one<int>(db, user, event.eventName, formatDate(eventDate(event.eventDate)).view());
+    }
+    int GiftPlanner::upsertGift(const Gift& gift) {
+        return *UPSERT_GIFT.one<int>(db, user, gift.recipientId, gift.eventId, gift.name, gift.link, gift.budgetLimit, gift.price, gift.status);
+    }
+    std::vector<int> GiftPlanner::upsertRecipients(const std::vector<Recipient>& recipients) {
+        std::vector<int> ids;
+        ids.reserve(recipients.size());
+        Transaction tx(db);
+        for(const Recipient& recipient : recipients)
+            ids.push_back(upsertRecipient(recipient));
         tx.commit();
+        return ids;
+    }
+    std::vector<int> GiftPlanner::upsertEvents(const std::vector<Event>& events) {
+        std::vector<int> ids;
+        ids.reserve(events.size());
+        Transaction tx(db);
+        for(const Event& event : events)
+            ids.push_back(upsertEvent(event));
+        tx.commit();
+        return ids;
+    }
+    std::vector<int> GiftPlanner::upsertGifts(const std::vector<Gift>& gifts) {
+        std::vector<int> ids;
+        ids.reserve(gifts.size());
+        Transaction tx(db);
+        for(const Gift& gift : gifts)
+            ids.push_back(upsertGift(gift));
+        tx.commit();
+        return ids;
+    }
+    /*
+     * Set-based deletes and updates. The IDs are written to a connection-local temp table once and
+     * a single statement joins against it, in one transaction. Foreign keys are enforced
+     * (DBConfig::foreignKeys). Each returns the number of rows changed in its own table.
+     */
+    void GiftPlanner::loadIdSet(const std::vector<int>& ids) {
+        db->execute("CREATE TEMP TABLE IF NOT EXISTS ID_SET(ID INTEGER PRIMARY KEY); DELETE FROM temp.ID_SET;", "Prepare ID set");
+        PreparedStatement insert(db, "INSERT OR IGNORE INTO temp.ID_SET(ID) VALUES(?);");
+        for(int id : ids) {
+            insert.bind(1, id);
+            insert.step();
+            insert.reset();
+        }
+    }
+    int GiftPlanner::changeIdSet(const std::vector<int>& ids, const std::function<int()>& statement) {
+        if(ids.empty())
+            return 0;
+        Transaction tx(db);
+        loadIdSet(ids);
+        int changed = statement();
+        tx.commit();
+        return changed;
+    }
+    int GiftPlanner::deleteGifts(const std::vector<int>& giftIds) {
+        return changeIdSet(giftIds, [this]() { return DELETE_GIFTS.exec(db, user); });
+    }
+    // Gifts of deleted events and recipients are tombstoned with them, so reads of GIFTS never
+    // need to join to find out whether their event or recipient is still there
+    int GiftPlanner::deleteEvents(const std::vector<int>& eventIds) {
+        return changeIdSet(eventIds, [this]() {
+            int changed = DELETE_EVENTS.exec(db, user);
+            DELETE_EVENT_GIFTS.exec(db, user);
+            return changed;
+        });
+    }
+    int GiftPlanner::deleteRecipients(const std::vector<int>& recipientIds) {
+        return changeIdSet(recipientIds, [this]() {
+            int changed = DELETE_RECIPIENTS.exec(db, user);
+            DELETE_RECIPIENT_GIFTS.exec(db, user);
+            return changed;
+        });
+    }
+    int GiftPlanner::clearEventGifts(const std::vector<int>& eventIds) {
+        return changeIdSet(eventIds, [this]() { return DELETE_EVENT_GIFTS.exec(db, user); });
+    }
+    int GiftPlanner::setGiftStatus(const std::vector<int>& giftIds, GiftStatus status) {
+        return changeIdSet(giftIds, [this, status]() { return SET_GIFTS_STATUS.exec(db, status, status, user); });
+    }
+    int GiftPlanner::moveGifts(const std::vector<int>& giftIds, int eventId) {
+        return changeIdSet(giftIds, [this, eventId]() { return MOVE_GIFTS.exec(db, eventId, user); });
+    }
+    int GiftPlanner::addEventWithGifts(Event event, const std::vector<Gift>& gifts, std::vector<size_t>* rejected) {
+        Transaction tx(db);
+        int eventId = addEvent(event).eventId;
+        for(size_t i = 0; i < gifts.size(); i++) {
+            Gift gift = gifts[i];
+            gift.eventId = eventId;
+            try {
+                addGift(gift);
+            }
+            catch(const ConstraintError&) {
+                // addGift's own savepoint has already undone it
+                if(rejected)
+                    rejected->push_back(i);
+            }
+        }
+        tx.commit();
+        return eventId;
     }
 
     void GiftPlanner::markGiftAsPurchased(int giftId) {
         Transaction tx(db);
-        PreparedStatement stmt(db, "UPDATE GIFTS SET Status = ? WHERE ID = ?;");
-        stmt.bind(1, static_cast<int>(GiftStatus::PURCHASED));
-        stmt.bind(2, giftId);        stmt.step();
+        SET_GIFT_STATUS.exec(db, GiftStatus::PURCHASED, giftId, user);
         tx.commit();
     }
    
@@ -121,11 +625,11 @@ namespace App {
         
         std::string query = "SELECT recipients.id, recipients.name, recipients.relationship, "
                             "gifts.id AS giftId, gifts.name AS giftName, gifts.link, gifts.budget, gifts.price, gifts.status, "
-                            "events.name, events.date "
+                            "events.name, strftime('%d-%m-%Y', events.date) "
                             "FROM gifts "
                             "JOIN recipients ON recipients.id = gifts.recipientid "
                             "JOIN events ON events.id = gifts.eventId "
-                            "WHERE events.id = ?";
+                            "WHERE events.id = ? AND gifts.UserID = ? AND gifts.DeletedAt IS NULL";
         
         if(limit>-1 && offset> -1) {
             query+= " LIMIT ? OFFSET ?";
@@ -136,9 +640,10 @@ namespace App {
         PreparedStatement stmt(db, query);
         
         stmt.bind(1,eventId);
+        stmt.bind(2, user);
         if(paged){
-            stmt.bind(2, limit);
-            stmt.bind(3, offset);
+            stmt.bind(3, limit);
+            stmt.bind(4, offset);
         }
         while(stmt.step()==ENGINE_ROW) {
             Row r(stmt.get());
@@ -160,23 +665,26 @@ namespace App {
     }
 
     int GiftPlanner::getEventCount() {
-        std::string query = "SELECT COUNT(*) FROM EVENTS;";
+        std::string query = "SELECT COUNT(*) FROM EVENTS WHERE UserID = ? AND DeletedAt IS NULL;";
         PreparedStatement stmt(db, query);
+        stmt.bind(1, user);
         stmt.step();
         Row r(stmt.get());
         return r.get<int>(0);
     }
     int GiftPlanner::getRecipientCount() {
-        std::string query = "SELECT COUNT(*) FROM RECIPIENTS;";
+        std::string query = "SELECT COUNT(*) FROM RECIPIENTS WHERE UserID = ? AND DeletedAt IS NULL;";
         PreparedStatement stmt(db, query);
+        stmt.bind(1, user);
         stmt.step();
         Row r(stmt.get());
         return r.get<int>(0);
     }
     int GiftPlanner::getGiftCount(int eventId) {
-        std::string query = "SELECT COUNT(*) FROM GIFTS WHERE eventId = ?;";
+        std::string query = "SELECT COUNT(*) FROM GIFTS WHERE eventId = ? AND UserID = ? AND DeletedAt IS NULL;";
         PreparedStatement stmt(db, query);
         stmt.bind(1, eventId);
+        stmt.bind(2, user);
         stmt.step();
         Row r(stmt.get());
         return r.get<int>(0);
@@ -184,9 +692,10 @@ namespace App {
     
     int GiftPlanner::totalGiftsPurchased() {
         int status = static_cast<int>(GiftStatus::PURCHASED);
-        std::string query = "SELECT COUNT(*) FROM GIFTS WHERE STATUS = ?;";
+        std::string query = "SELECT COUNT(*) FROM GIFTS WHERE UserID = ? AND STATUS = ? AND DeletedAt IS NULL;";
         PreparedStatement stmt(db, query);
-        stmt.bind(1, status);
+        stmt.bind(1, user);
+        stmt.bind(2, status);
         stmt.step();
         Row r(stmt.get());
         return r.get<int>(0);
@@ -203,54 +712,156 @@ namespace App {
             return true;
     }
     
-    void GiftPlanner::setup(User user) {
+    User GiftPlanner::setup(User user) {
         Transaction tx(db);
-        std::string query = "INSERT INTO user (Name) VALUES(?)";
-        PreparedStatement stmt(db, query);
-        stmt.bind(1, user.name);
-        stmt.step();
+        user.id = *INSERT_USER.one<int>(db, user.name);
         tx.commit();
+        return user;
+    }
+    std::vector<User> GiftPlanner::getUsers() {
+        return SELECT_USERS.all<User>(db);
+    }
+    void GiftPlanner::useUser(int userId) {
+        if(!SELECT_USER.one<User>(db, userId))
+            throw ConstraintError("No user " + std::to_string(userId), SQLITE_CONSTRAINT);
+        user = userId;
     }
     User GiftPlanner::getUserData() {
-        std::string query = "SELECT * FROM USER LIMIT 1";
-        PreparedStatement stmt(db, query);
-        stmt.step();
-        User user;
-        Row r(stmt.get());
-        user.id = r.get<int>(0);
-        user.name = r.get<std::string>(1);
-        return user;
+        std::optional<User> current = SELECT_USER.one<User>(db, user);
+        return current ? *current : User{user, ""};
     }
     
     std::vector<Event> GiftPlanner::getEvents() {
-        std::vector<Event> events;
-        std::string query = "SELECT * FROM EVENTS";
+        return SELECT_EVENTS.all<Event>(db, user);
+    }
+    std::vector<Recipient> GiftPlanner::getRecipients() {
+        return SELECT_RECIPIENTS.all<Recipient>(db, user);
+    }
+    std::vector<Event> GiftPlanner::getEventsBetween(const Date& from, const Date& to) {
+        return SELECT_EVENTS_BETWEEN.all<Event>(db, user, formatDate(from).view(), formatDate(to).view());
+    }
+
+    Reminder GiftPlanner::addReminder(Reminder reminder) {
+        Transaction tx(db);
+        reminder.id = *INSERT_REMINDER.one<int>(db, user, reminder.eventId, reminder.giftId, reminder.dueAt, reminder.message);
+        tx.commit();
+        return reminder;
+    }
+    Reminder GiftPlanner::remindBeforeEvent(int eventId, std::chrono::seconds lead, const std::string& message) {
+        Transaction tx(db);
+        auto row = INSERT_EVENT_REMINDER.one(db, lead.count(), lead.count(), message, eventId, user);
+        if(!row)
+            throw ConstraintError("No event " + std::to_string(eventId), SQLITE_CONSTRAINT);
+        tx.commit();
+        return Reminder{std::get<0>(*row), eventId, 0, std::get<1>(*row), std::get<2>(*row)};
+    }
+    std::vector<Reminder> GiftPlanner::getPendingReminders(long long until) {
+        return SELECT_PENDING_REMINDERS.all<Reminder>(db, user, until);
+    }
+    void GiftPlanner::markReminderFired(int reminderId) {
+        MARK_REMINDER_FIRED.exec(db, reminderId, user);
+    }
+    void GiftPlanner::deleteReminder(int reminderId) {
+        DELETE_REMINDER.exec(db, reminderId, user);
+    }
+
+
+    /*
+     * Spending is summed per day in SQL (Date is an ISO date, converted to days since epoch),
+     * the timeline rolls it up into weeks and months. Ordered and purchased gifts count as spent.
+     */
+    SpendingTimeline& GiftPlanner::spendingTimeline() {
+        SpendingCache& cache = spending[user];
+        if(!cache.stale)
+            return cache.timeline;
+        std::string query = "SELECT CAST(julianday(Date) - 2440587.5 AS INTEGER) AS Day, "
+                            "SUM(CAST(Price AS REAL)) "
+                            "FROM GIFTS "
+                            "WHERE UserID = ? AND Status IN (?, ?) AND DeletedAt IS NULL "
+                            // the series is dense, a mistyped year must not make it millions of days long
+                            "AND Date BETWEEN date('now', ?) AND date('now', ?) "
+                            "GROUP BY Day HAVING Day IS NOT NULL ORDER BY Day;";
         PreparedStatement stmt(db, query);
+        stmt.bind(1, user);
+        stmt.bind(2, static_cast<int>(GiftStatus::ORDERED));
+        stmt.bind(3, static_cast<int>(GiftStatus::PURCHASED));
+        stmt.bind(4, "-" + std::to_string(SPENDING_YEARS_BACK) + " years");
+        stmt.bind(5, "+" + std::to_string(SPENDING_YEARS_AHEAD) + " years");
+        std::vector<int> days;
+        std::vector<double> amounts;
         while(stmt.step() == ENGINE_ROW) {
             Row r(stmt.get());
-            Event event;
-            event.eventId = r.get<int>(0);
-            event.eventName = r.get<std::string>(1);
-            event.eventDate = r.get<std::string>(2);
-            events.push_back(event);
+            days.push_back(r.get<int>(0));
+            amounts.push_back(r.get<double>(1));
         }
-        
-        return events;
+        cache.timeline.load(days, amounts);
+        cache.stale = false;
+        return cache.timeline;
     }
-    std::vector<Recipient> GiftPlanner::getRecipients() {
-        std::vector<Recipient> recipients;
-        std::string query = "SELECT * from Recipients";
-        PreparedStatement stmt(db, query);
+
+
+    void GiftPlanner::batch(const std::function<void()>& fn) {
+        Transaction tx(db, TransactionMode::IMMEDIATE);
+        fn();
+        tx.commit();
+    }
+    void GiftPlanner::read(const std::function<void()>& fn) {
+        Transaction tx(db, TransactionMode::READ_ONLY_SNAPSHOT);
+        fn();
+        tx.commit();
+    }
+
+    // Turns user input into an FTS5 query: every word becomes a quoted prefix term
+    static std::string toMatchQuery(const std::string& input) {
+        std::string match;
+        std::string word;
+        auto flush = [&]() {
+            if(word.empty())
+                return;
+            if(!match.empty())
+                match += ' ';
+            match += '"' + word + "\"*";
+            word.clear();
+        };
+        for(char c : input) {
+            unsigned char u = static_cast<unsigned char>(c);
+            if(std::isalnum(u) || u >= 0x80)
+                word += c;
+            else
+                flush();
+        }
+        flush();
+        return match;
+    }
+
+    std::vector<SearchResult> GiftPlanner::search(const std::string& query, int limit, std::optional<SearchKind> kind) {
+        std::vector<SearchResult> results;
+        std::string match = toMatchQuery(query);
+        if(match.empty())
+            return results;
+        // Every match is ranked, the results are the true top limit. FTS5 keeps only the best
+        // limit rows while it ranks (ORDER BY rank LIMIT), and Owner limits the match to the
+        // current user's postings, so a broad prefix costs one pass over that user's matches.
+        PreparedStatement stmt(db, "SELECT rowid, Title, Detail, rank FROM SEARCH_INDEX "
+                                   "WHERE SEARCH_INDEX MATCH ? AND (? < 0 OR rowid % 4 = ?) "
+                                   "ORDER BY rank LIMIT ?;");
+        int kindFilter = kind ? static_cast<int>(*kind) : -1;
+        stmt.bind(1, "Owner : u" + std::to_string(user) + " AND {Title Detail} : (" + match + ")");
+        stmt.bind(2, kindFilter);
+        stmt.bind(3, kindFilter);
+        stmt.bind(4, limit);
         while(stmt.step() == ENGINE_ROW) {
             Row r(stmt.get());
-            Recipient recipient;
-            recipient.id = r.get<int>(0);
-            recipient.name = r.get<std::string>(1);
-            recipient.relationship = r.get<std::string>(2);
-            recipients.push_back(recipient);
+            long long rowid = r.get<long long>(0);
+            SearchResult result;
+            result.kind = static_cast<SearchKind>(rowid % 4);
+            result.id = static_cast<int>(rowid / 4);
+            result.title = r.get<std::string>(1);
+            result.detail = r.get<std::string>(2);
+            result.score = r.get<double>(3);
+            results.push_back(result);
         }
-
-        return recipients;
+        return results;
     }
 
 }
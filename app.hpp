@@ -1,11 +1,16 @@
 #ifndef APP_H
 #define APP_H
 #include "db.hpp"
+#include "analytics.hpp"
+#include "date.hpp"
 #include <vector>
 #include <string>
 #include <optional>
 #include <common.hpp>
 #include <memory>
+#include <functional>
+#include <chrono>
+#include <unordered_map>
 
 namespace App {
 
@@ -58,35 +63,132 @@ namespace App {
     struct Event {
         int eventId=0;
         std::string eventName;
-        std::string eventDate;
+        std::string eventDate;      // dd-mm-YYYY, ISO dates are accepted too
+    };
+
+    struct Reminder {
+        int id = 0;
+        int eventId = 0;            // 0 when it isn't about an event
+        int giftId = 0;             // 0 when it isn't about a gift
+        long long dueAt = 0;        // unix seconds
+        std::string message;
+    };
+
+    enum class SearchKind {
+        GIFT,
+        RECIPIENT,
+        EVENT
+    };
+
+    struct SearchResult {
+        SearchKind kind;
+        int id = 0;             // ID in GIFTS, RECIPIENTS or EVENTS
+        std::string title;      // gift, recipient or event name
+        std::string detail;     // gift link or recipient relationship
+        double score = 0.0;     // bm25, lower is better
     };
 
     class GiftPlanner {
         public:
             GiftPlanner(){}
-            void init(const std::string& filename);
+            void init(const std::string& filename, const Engine::DBConfig& config=Engine::DBConfig::interactive());
             ~GiftPlanner();
             
             void initialize_tables();
 
-            void addRecipient(Recipient recipient);
-            void addGift(Gift gift);
-            void addEvent(Event event);
+            // Inserts return the stored entity with its new ID, views can append it instead of reloading
+            Recipient addRecipient(Recipient recipient);
+            Gift addGift(Gift gift);
+            Event addEvent(Event event);
+            // Insert or update by natural key and return the row's ID, in a single statement.
+            // A recipient is its name and relationship, an event its name (the date is updated),
+            // a gift its recipient, event and name (link, budget, price and status are updated)
+            int upsertRecipient(const Recipient& recipient);
+            int upsertEvent(const Event& event);
+            int upsertGift(const Gift& gift);
+            // Batch forms: one transaction, IDs in input order
+            std::vector<int> upsertRecipients(const std::vector<Recipient>& recipients);
+            std::vector<int> upsertEvents(const std::vector<Event>& events);
+            std::vector<int> upsertGifts(const std::vector<Gift>& gifts);
+            // Adds an event and its gifts in one transaction and returns the event's ID. Every gift
+            // has its own savepoint: one that violates a constraint (e.g. unknown recipient) is
+            // undone alone, its index goes to rejected, and the rest still commit
+            int addEventWithGifts(Event event, const std::vector<Gift>& gifts, std::vector<size_t>* rejected=nullptr);
             void markGiftAsPurchased(int giftId);
+            // Bulk deletes and updates by ID set, in one transaction. Return the number of rows changed.
+            // Deletes are soft: rows get a tombstone and vanish from every read and from search, deleting
+            // events or recipients deletes their gifts too. Compactor removes tombstoned rows later.
+            // Adding a row with the natural key of a deleted one brings it back under its old ID
+            int deleteGifts(const std::vector<int>& giftIds);
+            int deleteEvents(const std::vector<int>& eventIds);
+            int deleteRecipients(const std::vector<int>& recipientIds);
+            // Deletes every gift of the events, the events stay (clearing out a past season)
+            int clearEventGifts(const std::vector<int>& eventIds);
+            // Gifts that change status get today's Date, like markGiftAsPurchased
+            int setGiftStatus(const std::vector<int>& giftIds, GiftStatus status);
+            int moveGifts(const std::vector<int>& giftIds, int eventId);
             std::vector<RecipientGifts> fetchRecipientsAndGifts(int eventId, int limit=-1, int offset=-1);
             int getEventCount();
             int getRecipientCount();
             int getGiftCount(int eventId);
             int totalGiftsPurchased();
             int totalMoneySpent();
+            // Users. Every entity belongs to one, the planner reads and writes the current user's
+            // rows only (user 1 until useUser() says otherwise). IDs of another user's rows are
+            // treated as missing, a gift or reminder can't refer to another user's event or recipient
             bool setupComplete();
-            void setup(User user);
+            // Adds a user and returns it with its ID, the current user doesn't change
+            User setup(User user);
+            std::vector<User> getUsers();
+            // Throws ConstraintError when there is no such user
+            void useUser(int userId);
+            int currentUser() const { return user; }
+            // The current user
             User getUserData();
+            // Events by date. Invalid dates are a ConstraintError when events are added or upserted
             std::vector<Event>getEvents();
+            // Events dated from from to to, both included, by date
+            std::vector<Event> getEventsBetween(const Date& from, const Date& to);
             std::vector<Recipient> getRecipients();
+            // Reminders, due times are unix seconds. One of a deleted event or gift never comes due
+            Reminder addReminder(Reminder reminder);
+            // Due lead before the start of the event's day (local time), moves when the date changes.
+            // An empty message is the event's name. Throws ConstraintError when there is no such event
+            Reminder remindBeforeEvent(int eventId, std::chrono::seconds lead, const std::string& message);
+            // Reminders not fired yet that are due at or before until, soonest first
+            std::vector<Reminder> getPendingReminders(long long until);
+            void markReminderFired(int reminderId);
+            void deleteReminder(int reminderId);
+            // Full-text search over gifts, recipients and events. Every word is prefix matched,
+            // results are the best limit of all matches, best first. kind limits results to one table
+            std::vector<SearchResult> search(const std::string& query, int limit=20, std::optional<SearchKind> kind=std::nullopt);
+            // Runs fn in one transaction. Mutations called from fn nest in it as savepoints
+            // instead of committing on their own, so many writes cost a single commit
+            void batch(const std::function<void()>& fn);
+            // Runs fn in a read-only snapshot: every query in it sees the same state of the
+            // database, even while other connections commit. A mutation called from fn throws
+            // DatabaseException and nothing of fn is kept
+            void read(const std::function<void()>& fn);
+            // The current user's spending per day/week/month, reloaded only after gifts change.
+            // Covers purchases dated from SPENDING_YEARS_BACK years ago to SPENDING_YEARS_AHEAD years ahead
+            SpendingTimeline& spendingTimeline();
+            // Underlying database, for bulk tools that drive statements directly
+            Engine::DBEngine* engine() { return db; }
             
         private:
+            void loadIdSet(const std::vector<int>& ids);
+            int changeIdSet(const std::vector<int>& ids, const std::function<int()>& statement);
+
             Engine::DBEngine* db;
+            int user = 1;
+            // by user, kept while the planner switches between users
+            struct SpendingCache {
+                SpendingTimeline timeline;
+                bool stale = true;
+            };
+            std::unordered_map<int, SpendingCache> spending;
+            static const int SPENDING_YEARS_BACK = 100;
+            static const int SPENDING_YEARS_AHEAD = 10;
     };
 
 }
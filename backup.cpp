@@ -0,0 +1,130 @@
+#include "backup.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+namespace Engine {
+
+    /*
+     * Class: BackupScheduler
+     */
+    BackupScheduler::BackupScheduler(DBEngine* db, const std::string& dir, std::chrono::seconds interval,
+                                     size_t keep, const std::string& prefix)
+        : db(db), dir(dir), interval(interval), keep(keep), prefix(prefix) {
+        // prune() would delete every snapshot right after writing it
+        if(keep == 0)
+            throw ConfigError("[Backup] keep must be at least 1", ENGINE_CONFIG_ERROR);
+    }
+
+    BackupScheduler::~BackupScheduler() {
+        stop();
+    }
+
+    void BackupScheduler::start() {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(running)
+            return;
+        running = true;
+        worker = std::thread(&BackupScheduler::run, this);
+    }
+
+    void BackupScheduler::stop() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            running = false;
+        }
+        cv.notify_all();
+        if(worker.joinable())
+            worker.join();
+    }
+
+    void BackupScheduler::run() {
+        std::unique_lock<std::mutex> lock(mtx);
+        while(running) {
+            if(cv.wait_for(lock, interval, [this]() { return !running; }))
+                break;
+            lock.unlock();
+            try {
+                snapshot();
+            }
+            catch(const std::exception& e) {
+                Logger::error(std::string("[Backup]: ") + e.what());
+            }
+            lock.lock();
+        }
+    }
+
+    std::string BackupScheduler::snapshot() {
+        long long stampMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        {
+            // two snapshots in the same millisecond still get distinct, ordered names
+            std::lock_guard<std::mutex> lock(mtx);
+            if(stampMs <= lastStampMs)
+                stampMs = lastStampMs + 1;
+            lastStampMs = stampMs;
+        }
+        std::time_t t = static_cast<std::time_t>(stampMs / 1000);
+        int ms = static_cast<int>(stampMs % 1000);
+        // UTC, local time repeats an hour when DST ends and prune() orders by name
+        std::tm tm{};
+#ifdef _WIN32
+        gmtime_s(&tm, &t);
+#else
+        gmtime_r(&t, &tm);
+#endif
+        char stamp[32];
+        std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+        char millis[8];
+        std::snprintf(millis, sizeof(millis), "-%03d", ms);
+
+        std::error_code ec;
+        fs::create_directories(dir, ec);
+        fs::path target = fs::path(dir) / (prefix + "-" + stamp + millis + ".db");
+        fs::path part = target;
+        part += ".part";
+        fs::remove(part, ec);
+
+        try {
+            db->backup(part.string()).get();
+        }
+        catch(...) {
+            fs::remove(part, ec);
+            throw;
+        }
+        fs::rename(part, target, ec);
+        if(ec)
+            throw BackupError("[Backup] Couldn't rename " + part.string() + ": " + ec.message(), ENGINE_BACKUP_ERROR);
+        Logger::info("[Backup]: Snapshot " + target.string());
+        prune();
+        return target.string();
+    }
+
+    std::vector<std::string> BackupScheduler::snapshots() const {
+        std::vector<std::string> found;
+        std::error_code ec;
+        for(fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+            std::string name = it->path().filename().string();
+            if(name.size() > prefix.size() + 4 && name.compare(0, prefix.size() + 1, prefix + "-") == 0 &&
+               name.compare(name.size() - 3, 3, ".db") == 0)
+                found.push_back(it->path().string());
+        }
+        std::sort(found.begin(), found.end());
+        return found;
+    }
+
+    void BackupScheduler::prune() {
+        std::vector<std::string> existing = snapshots();
+        std::error_code ec;
+        for(size_t i = 0; i + keep < existing.size(); i++) {
+            fs::remove(existing[i], ec);
+            Logger::info("[Backup]: Removed old snapshot " + existing[i]);
+        }
+    }
+    // end of Class: BackupScheduler
+
+}
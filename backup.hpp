@@ -0,0 +1,55 @@
+#ifndef BACKUP_H
+#define BACKUP_H
+#include "db.hpp"
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+namespace Engine {
+
+    /*
+     * Periodic online snapshots with retention.
+     * Every interval the database is copied with DBEngine::backup to
+     * dir/<prefix>-YYYYmmdd-HHMMSS-mmm.db in UTC, so names sort by age. A snapshot is written under a
+     * .part name and renamed once complete, an interrupted copy never looks like a good one.
+     * After each snapshot only the newest `keep` are left, keep 0 throws ConfigError.
+     */
+    class BackupScheduler {
+        public:
+            BackupScheduler(DBEngine* db, const std::string& dir, std::chrono::seconds interval,
+                            size_t keep=7, const std::string& prefix="snapshot");
+            ~BackupScheduler();
+
+            // Starts the timer thread, the first snapshot is taken after one interval
+            void start();
+            void stop();
+            // Takes a snapshot now and returns its path. Throws BackupError
+            std::string snapshot();
+            // Existing snapshots, oldest first
+            std::vector<std::string> snapshots() const;
+
+            BackupScheduler(const BackupScheduler&) = delete;
+            BackupScheduler& operator=(const BackupScheduler&) = delete;
+
+        private:
+            void run();
+            void prune();
+
+            DBEngine* db;
+            std::string dir;
+            std::chrono::seconds interval;
+            size_t keep;
+            std::string prefix;
+            std::thread worker;
+            std::mutex mtx;
+            std::condition_variable cv;
+            bool running = false;
+            long long lastStampMs = 0;
+    };
+
+}
+
+#endif
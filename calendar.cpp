@@ -0,0 +1,75 @@
+#include "calendar.hpp"
+
+namespace App {
+
+    /*
+     * Class: EventCalendar
+     */
+    EventCalendar::EventCalendar(GiftPlanner& planner, size_t capacity)
+        : planner(planner), capacity(capacity > 0 ? capacity : 1) {
+        subscription = planner.engine()->subscribe([this](const Engine::ChangeBatch& changes) {
+            for(const Engine::RowChange& change : changes) {
+                if(change.table == "EVENTS") {
+                    stale = true;
+                    return;
+                }
+            }
+        });
+    }
+
+    EventCalendar::~EventCalendar() {
+        planner.engine()->unsubscribe(subscription);
+    }
+
+    const std::vector<EventCalendar::Entry>& EventCalendar::month(int year, int month) {
+        if(stale) {
+            windows.clear();
+            stale = false;
+        }
+        std::pair<int, int> key(planner.currentUser(), year * 12 + month - 1);
+        auto found = windows.find(key);
+        if(found != windows.end()) {
+            found->second.used = ++clock;
+            return found->second.entries;
+        }
+
+        if(windows.size() >= capacity) {
+            auto oldest = windows.begin();
+            for(auto it = windows.begin(); it != windows.end(); ++it) {
+                if(it->second.used < oldest->second.used)
+                    oldest = it;
+            }
+            windows.erase(oldest);
+        }
+        Window window;
+        window.used = ++clock;
+        for(Event& event : planner.getEventsBetween(Date{year, month, 1}, Date{year, month, daysInMonth(year, month)})) {
+            // read back from the database, always a valid date
+            Date date = *parseDate(event.eventDate);
+            window.entries.push_back(Entry{date, std::move(event)});
+        }
+        loaded++;
+        return windows.emplace(key, std::move(window)).first->second.entries;
+    }
+
+    std::vector<EventCalendar::Entry> EventCalendar::agenda(const Date& from, int days) {
+        std::vector<Entry> entries;
+        if(days <= 0)
+            return entries;
+        Date to = from.addDays(days - 1);
+        int year = from.year, m = from.month;
+        while(year < to.year || (year == to.year && m <= to.month)) {
+            for(const Entry& entry : month(year, m)) {
+                if(entry.date >= from && entry.date <= to)
+                    entries.push_back(entry);
+            }
+            if(++m > 12) {
+                m = 1;
+                year++;
+            }
+        }
+        return entries;
+    }
+    // end of Class: EventCalendar
+
+}
@@ -0,0 +1,59 @@
+#ifndef CALENDAR_H
+#define CALENDAR_H
+#include "app.hpp"
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace App {
+
+    /*
+     * Events by month for calendar and agenda views.
+     * month() loads a month with one range scan of the date index (getEventsBetween) and keeps
+     * it, going back to a month already seen doesn't query. Up to capacity months are kept, the
+     * least recently used one goes first. Months are kept per user, switching the planner to
+     * another user and back finds them still there. A committed change to EVENTS drops them all,
+     * the next month() loads only the month asked for.
+     * Use it on the thread that uses the planner.
+     */
+    class EventCalendar {
+        public:
+            struct Entry {
+                Date date;
+                Event event;
+            };
+
+            explicit EventCalendar(GiftPlanner& planner, size_t capacity=12);
+            ~EventCalendar();
+
+            // The month's events by date, valid until the next call
+            const std::vector<Entry>& month(int year, int month);
+            // Events of the days days starting at from, by date, through the month cache
+            std::vector<Entry> agenda(const Date& from, int days);
+            // Drop the cache, for changes made through another connection
+            void invalidate() { stale = true; }
+            size_t cached() const { return windows.size(); }
+            // Months read from the database so far
+            size_t loads() const { return loaded; }
+
+            EventCalendar(const EventCalendar&) = delete;
+            EventCalendar& operator=(const EventCalendar&) = delete;
+
+        private:
+            struct Window {
+                std::vector<Entry> entries;
+                unsigned long used = 0;
+            };
+
+            GiftPlanner& planner;
+            size_t capacity;
+            std::map<std::pair<int, int>, Window> windows;  // by user, year * 12 + month - 1
+            unsigned long clock = 0;
+            size_t loaded = 0;
+            bool stale = false;
+            int subscription;
+    };
+
+}
+
+#endif
@@ -0,0 +1,373 @@
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <ctime>
+#include <thread>
+#include <string>
+#include <vector>
+#include <app.hpp>
+#include <importer.hpp>
+#include <exporter.hpp>
+#include <compactor.hpp>
+#include <reminders.hpp>
+#include "logger.hpp"
+
+/*
+ * giftcli: headless front end for GiftPlanner.
+ * Links only giftcore (no GLFW/OpenGL) so it runs on servers and in scripts.
+ *
+ * Usage: giftcli <database> <command> [args...]
+ *        giftcli <database> batch < commands.txt      (one command per line)
+ */
+
+using namespace App;
+
+static void usage() {
+    std::cerr << "Usage: giftcli <database> <command> [args...]\n"
+                 "Commands:\n"
+                 "  add-recipient <name> [relationship]\n"
+                 "  add-event <name> <dd-mm-YYYY>\n"
+                 "  add-gift <recipientId> <eventId> <name> [price] [budget] [link]\n"
+                 "  purchase <giftId>\n"
+                 "  set-status <idea|ordered|purchased|cancelled> <giftId>...\n"
+                 "  delete <gifts|events|recipients> <id>...   events and recipients take their gifts along\n"
+                 "  clear-event <eventId>...                   delete every gift of the events\n"
+                 "  events [from to]       by date, from and to are dd-mm-YYYY and included\n"
+                 "  recipients\n"
+                 "  gifts <eventId>\n"
+                 "  search <query> [limit]\n"
+                 "  stats\n"
+                 "  import <recipients|events|gifts> <file.csv>\n"
+                 "  export <recipients|events|gifts> [csv|json] [file]   stdout by default\n"
+                 "  backup <file>          online copy of the database\n"
+                 "  compact                remove deleted rows and shrink the file\n"
+                 "  remind <eventId> <days> [message]   remind days before the event\n"
+                 "  reminders [days]       reminders due in the next days (default 7)\n"
+                 "  watch                  print reminders as they come due, until interrupted\n"
+                 "  users\n"
+                 "  add-user <name>\n"
+                 "  use <userId|name>      later commands of a batch work on that user's data\n"
+                 "  batch                  read commands from stdin, one per line\n"
+                 "Environment:\n"
+                 "  GIFT_DB_PROFILE        interactive, bulk-load or read-mostly\n"
+                 "  GIFT_USER              user ID or name whose data the commands see, user 1 by default\n";
+}
+
+// splits a batch line on whitespace, "double quoted" arguments may contain spaces
+static std::vector<std::string> splitArgs(const std::string& line) {
+    std::vector<std::string> args;
+    std::string arg;
+    bool quoted = false, inArg = false;
+    for(char c : line) {
+        if(c == '"') {
+            quoted = !quoted;
+            inArg = true;
+        }
+        else if(!quoted && (c == ' ' || c == '\t' || c == '\r')) {
+            if(inArg)
+                args.push_back(arg);
+            arg.clear();
+            inArg = false;
+        }
+        else {
+            arg += c;
+            inArg = true;
+        }
+    }
+    if(inArg)
+        args.push_back(arg);
+    return args;
+}
+
+static const char* statusName(GiftStatus status) {
+    const char* names[] = {"Idea", "Ordered", "Purchased", "Cancelled"};
+    return names[static_cast<int>(status)];
+}
+
+static std::string localTime(long long t) {
+    std::time_t time = static_cast<std::time_t>(t);
+    char buf[32];
+    std::strftime(buf, sizeof(buf), "%d-%m-%Y %H:%M", std::localtime(&time));
+    return buf;
+}
+
+// Switches the planner to a user given by ID or name
+static void useUser(GiftPlanner& planner, const std::string& user) {
+    for(const User& u : planner.getUsers()) {
+        if(u.name == user) {
+            planner.useUser(u.id);
+            return;
+        }
+    }
+    if(user.empty() || user.find_first_not_of("0123456789") != std::string::npos)
+        throw std::runtime_error("No user " + user);
+    planner.useUser(std::stoi(user));
+}
+
+// Prints reminders as they come due. Other processes may add reminders or change events,
+// so the wheel is reloaded at least once a minute
+static void watchReminders(GiftPlanner& planner) {
+    ReminderService reminders(planner);
+    reminders.subscribe([](const Reminder& r) {
+        std::cout << localTime(r.dueAt) << '\t' << r.id << '\t' << r.message << std::endl;
+    });
+    while(true) {
+        reminders.poll();
+        long long now = unixNow();
+        long long wake = std::min(reminders.nextWake(), now + 60);
+        std::this_thread::sleep_for(std::chrono::seconds(std::max(wake - now, 1LL)));
+        if(wake == now + 60)
+            reminders.invalidate();
+    }
+}
+
+static int runCommand(GiftPlanner& planner, const std::vector<std::string>& args) {
+    if(args.empty())
+        return 0;
+    const std::string& cmd = args[0];
+    auto need = [&](size_t n) {
+        if(args.size() < n + 1) {
+            std::cerr << cmd << ": expected " << n << " argument(s)\n";
+            return false;
+        }
+        return true;
+    };
+
+    if(cmd == "add-recipient") {
+        if(!need(1)) return 2;
+        Recipient r;
+        r.name = args[1];
+        r.relationship = args.size() > 2 ? args[2] : "";
+        std::cout << planner.addRecipient(r).id << '\n';
+    }
+    else if(cmd == "add-event") {
+        if(!need(2)) return 2;
+        Event e;
+        e.eventName = args[1];
+        e.eventDate = args[2];
+        std::cout << planner.addEvent(e).eventId << '\n';
+    }
+    else if(cmd == "add-gift") {
+        if(!need(3)) return 2;
+        Gift g;
+        g.recipientId = std::stoi(args[1]);
+        g.eventId = std::stoi(args[2]);
+        g.name = args[3];
+        g.price = args.size() > 4 ? std::stod(args[4]) : 0.0;
+        g.budgetLimit = args.size() > 5 ? std::stod(args[5]) : 0.0;
+        g.link = args.size() > 6 ? args[6] : "";
+        std::cout << planner.addGift(g).id << '\n';
+    }
+    else if(cmd == "purchase") {
+        if(!need(1)) return 2;
+        planner.markGiftAsPurchased(std::stoi(args[1]));
+    }
+    else if(cmd == "set-status" || cmd == "delete" || cmd == "clear-event") {
+        bool clear = cmd == "clear-event";
+        if(!need(clear ? 1 : 2)) return 2;
+        std::vector<int> ids;
+        for(size_t i = clear ? 1 : 2; i < args.size(); i++)
+            ids.push_back(std::stoi(args[i]));
+        int changed;
+        if(clear)
+            changed = planner.clearEventGifts(ids);
+        else if(cmd == "set-status") {
+            const char* names[] = {"idea", "ordered", "purchased", "cancelled"};
+            const char** name = std::find(std::begin(names), std::end(names), args[1]);
+            if(name == std::end(names)) {
+                std::cerr << "set-status: unknown status " << args[1] << '\n';
+                return 2;
+            }
+            changed = planner.setGiftStatus(ids, static_cast<GiftStatus>(name - names));
+        }
+        else if(args[1] == "gifts")
+            changed = planner.deleteGifts(ids);
+        else if(args[1] == "events")
+            changed = planner.deleteEvents(ids);
+        else if(args[1] == "recipients")
+            changed = planner.deleteRecipients(ids);
+        else {
+            std::cerr << "delete: expected gifts, events or recipients\n";
+            return 2;
+        }
+        std::cout << changed << '\n';
+    }
+    else if(cmd == "events") {
+        std::vector<Event> events;
+        if(args.size() > 2) {
+            std::optional<Date> from = parseDate(args[1]), to = parseDate(args[2]);
+            if(!from || !to) {
+                std::cerr << "events: expected dd-mm-YYYY dates\n";
+                return 2;
+            }
+            events = planner.getEventsBetween(*from, *to);
+        }
+        else
+            events = planner.getEvents();
+        for(const Event& e : events)
+            std::cout << e.eventId << '\t' << e.eventName << '\t' << e.eventDate << '\n';
+    }
+    else if(cmd == "recipients") {
+        for(const Recipient& r : planner.getRecipients())
+            std::cout << r.id << '\t' << r.name << '\t' << r.relationship << '\n';
+    }
+    else if(cmd == "gifts") {
+        if(!need(1)) return 2;
+        for(const RecipientGifts& g : planner.fetchRecipientsAndGifts(std::stoi(args[1])))
+            std::cout << g.giftId << '\t' << g.recipientName << '\t' << g.giftName << '\t'
+                      << g.giftPrice << '\t' << statusName(g.giftStatus) << '\n';
+    }
+    else if(cmd == "search") {
+        if(!need(1)) return 2;
+        int limit = args.size() > 2 ? std::stoi(args[2]) : 20;
+        const char* kinds[] = {"gift", "recipient", "event"};
+        for(const SearchResult& r : planner.search(args[1], limit))
+            std::cout << kinds[static_cast<int>(r.kind)] << '\t' << r.id << '\t' << r.title << '\t' << r.detail << '\n';
+    }
+    else if(cmd == "stats") {
+        // one snapshot so the numbers agree with each other
+        planner.read([&]() {
+            std::cout << "events\t" << planner.getEventCount() << '\n'
+                      << "recipients\t" << planner.getRecipientCount() << '\n'
+                      << "purchased\t" << planner.totalGiftsPurchased() << '\n'
+                      << "spent\t" << planner.spendingTimeline().total() << '\n';
+        });
+    }
+    else if(cmd == "import") {
+        if(!need(2)) return 2;
+        ImportKind kind;
+        if(args[1] == "recipients") kind = ImportKind::RECIPIENTS;
+        else if(args[1] == "events") kind = ImportKind::EVENTS;
+        else if(args[1] == "gifts") kind = ImportKind::GIFTS;
+        else {
+            std::cerr << "import: unknown kind " << args[1] << '\n';
+            return 2;
+        }
+        CsvImporter importer(planner);
+        ImportStats stats = importer.importFile(kind, args[2]);
+        for(const std::string& e : stats.errors)
+            std::cerr << e << '\n';
+        std::cout << "rows\t" << stats.rows << '\n'
+                  << "inserted\t" << stats.inserted << '\n'
+                  << "skipped\t" << stats.skipped << '\n'
+                  << "recipients created\t" << stats.recipientsCreated << '\n'
+                  << "events created\t" << stats.eventsCreated << '\n'
+                  << "seconds\t" << stats.seconds << '\n';
+    }
+    else if(cmd == "export") {
+        if(!need(1)) return 2;
+        ExportKind kind;
+        if(args[1] == "recipients") kind = ExportKind::RECIPIENTS;
+        else if(args[1] == "events") kind = ExportKind::EVENTS;
+        else if(args[1] == "gifts") kind = ExportKind::GIFTS;
+        else {
+            std::cerr << "export: unknown kind " << args[1] << '\n';
+            return 2;
+        }
+        ExportFormat format = ExportFormat::CSV;
+        if(args.size() > 2 && args[2] == "json")
+            format = ExportFormat::NDJSON;
+        else if(args.size() > 2 && args[2] != "csv") {
+            std::cerr << "export: unknown format " << args[2] << '\n';
+            return 2;
+        }
+        Exporter exporter(planner);
+        if(args.size() > 3)
+            exporter.exportFile(args[3], kind, format);
+        else
+            exporter.exportTo(std::cout, kind, format);
+    }
+    else if(cmd == "backup") {
+        if(!need(1)) return 2;
+        planner.engine()->backup(args[1]).get();
+    }
+    else if(cmd == "compact") {
+        Compactor compactor;
+        CompactionStats stats = compactor.compact(planner.engine());
+        std::cout << "removed " << stats.purged << " rows, freed " << stats.pagesFreed << " pages\n";
+    }
+    else if(cmd == "remind") {
+        if(!need(2)) return 2;
+        std::string message = args.size() > 3 ? args[3] : "";
+        Reminder r = planner.remindBeforeEvent(std::stoi(args[1]), std::chrono::hours(24 * std::stoi(args[2])), message);
+        std::cout << r.id << '\t' << localTime(r.dueAt) << '\n';
+    }
+    else if(cmd == "reminders") {
+        int days = args.size() > 1 ? std::stoi(args[1]) : 7;
+        for(const Reminder& r : planner.getPendingReminders(unixNow() + days * 86400LL))
+            std::cout << r.id << '\t' << localTime(r.dueAt) << '\t' << r.eventId << '\t' << r.message << '\n';
+    }
+    else if(cmd == "watch") {
+        watchReminders(planner);
+    }
+    else if(cmd == "users") {
+        for(const User& u : planner.getUsers())
+            std::cout << u.id << '\t' << u.name << (u.id == planner.currentUser() ? "\t*" : "") << '\n';
+    }
+    else if(cmd == "add-user") {
+        if(!need(1)) return 2;
+        std::cout << planner.setup(User{0, args[1]}).id << '\n';
+    }
+    else if(cmd == "use") {
+        if(!need(1)) return 2;
+        useUser(planner, args[1]);
+    }
+    else {
+        std::cerr << "Unknown command: " << cmd << '\n';
+        usage();
+        return 2;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if(argc < 3) {
+        usage();
+        return 2;
+    }
+    Logger::enabled = false;
+
+    GiftPlanner planner;
+    try {
+        // imports run with the bulk-load profile, GIFT_DB_PROFILE overrides the choice
+        std::string profile = std::string(argv[2]) == "import" ? "bulk-load" : "interactive";
+        if(const char* env = std::getenv("GIFT_DB_PROFILE"))
+            profile = env;
+        planner.init(argv[1], Engine::DBConfig::preset(profile));
+        planner.initialize_tables();
+        if(const char* user = std::getenv("GIFT_USER"))
+            useUser(planner, user);
+    }
+    catch(const std::exception& e) {
+        std::cerr << "giftcli: " << e.what() << '\n';
+        return 1;
+    }
+
+    std::vector<std::string> args(argv + 2, argv + argc);
+    if(args[0] != "batch") {
+        try {
+            return runCommand(planner, args);
+        }
+        catch(const std::exception& e) {
+            std::cerr << "giftcli: " << e.what() << '\n';
+            return 1;
+        }
+    }
+
+    // batch: keep going on errors, report them with the line number
+    int failed = 0;
+    int lineNo = 0;
+    std::string line;
+    while(std::getline(std::cin, line)) {
+        lineNo++;
+        try {
+            if(runCommand(planner, splitArgs(line)) != 0)
+                failed++;
+        }
+        catch(const std::exception& e) {
+            std::cerr << "line " << lineNo << ": " << e.what() << '\n';
+            failed++;
+        }
+    }
+    return failed == 0 ? 0 : 1;
+}
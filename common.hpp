@@ -1,7 +1,80 @@
 // Engine
+#ifndef COMMON_H
+#define COMMON_H
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
 
 namespace Engine {
     
     //centralize common types here
 
+    enum ENGINE_CODES {
+        ENGINE_OK,
+        ENGINE_ERROR,
+        ENGINE_CONNECTION_ERROR,
+        ENGINE_ROLLBACK_FAILURE,
+        ENGINE_COMMIT_FAILURE,
+        ENGINE_SYNTAX_ERROR,
+        ENGINE_STEP_ERROR,
+        ENGINE_BIND_ERROR,
+        ENGINE_ROW,
+        ENGINE_FINALIZE_ERROR,
+        ENGINE_BUSY,
+        ENGINE_CACHE_OK,
+        ENGINE_CACHE_BUSY,
+        ENGINE_CACHE_NOT_FOUND,
+        ENGINE_BACKUP_ERROR,
+        ENGINE_CONFIG_ERROR,
+        ENGINE_CONSTRAINT,
+        ENGINE_MISMATCH,
+        ENGINE_MISUSE,
+        ENGINE_RANGE,
+        ENGINE_NOMEM,
+        ENGINE_STATE_ERROR
+    };
+
+    /*
+     * Outcome of a non-throwing engine call (PreparedStatement::tryStep, tryBind, tryPrepare).
+     * code is an ENGINE_CODES value, rc the SQLite result code behind it and what a static
+     * description, so reporting an expected failure allocates nothing.
+     * A step that produced a row or finished is ok, only ENGINE_ROW tells them apart.
+     */
+    struct Status {
+        int code = ENGINE_OK;
+        int rc = 0;
+        const char* what = "";
+
+        bool ok() const { return code == ENGINE_OK || code == ENGINE_ROW; }
+        bool row() const { return code == ENGINE_ROW; }
+        explicit operator bool() const { return ok(); }
+    };
+
+    // A value or the Status explaining why there is none
+    template <typename T>
+    class Expected {
+        public:
+            Expected(T&& value) : value_(std::move(value)) {}
+            Expected(const Status& status) : status_(status) {}
+
+            bool ok() const { return value_.has_value(); }
+            explicit operator bool() const { return ok(); }
+            const Status& status() const { return status_; }
+
+            T& value() {
+                if(!value_)
+                    throw std::logic_error(std::string("Expected has no value: ") + status_.what);
+                return *value_;
+            }
+            T& operator*() { return value(); }
+            T* operator->() { return &value(); }
+
+        private:
+            std::optional<T> value_;
+            Status status_;
+    };
+
 } // engine namespace
+
+#endif
@@ -0,0 +1,113 @@
+#include "compactor.hpp"
+#include "logger.hpp"
+
+using namespace Engine;
+
+namespace App {
+
+    // children first, see Compactor
+    static const char* const TOMBSTONED_TABLES[] = {"GIFTS", "RECIPIENTS", "EVENTS"};
+    // pages freed per incremental_vacuum, the deadline is checked between steps
+    static const int VACUUM_STEP = 128;
+
+    /*
+     * Class: Compactor
+     */
+    Compactor::Compactor(int batchSize) : batchSize(batchSize > 0 ? batchSize : 1) {}
+
+    void Compactor::schedule(MaintenanceScheduler& scheduler, std::chrono::seconds interval, std::chrono::milliseconds budget) {
+        scheduler.add("compact", interval, budget, [this](MaintenanceContext& ctx) {
+            CompactionStats stats = compact(ctx.conn, ctx.deadline);
+            ctx.result = std::to_string(stats.purged) + " rows, " + std::to_string(stats.pagesFreed) + " pages";
+            return stats.complete;
+        });
+    }
+
+    CompactionStats Compactor::compact(DBEngine* conn, std::chrono::steady_clock::time_point deadline) {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto start = std::chrono::steady_clock::now();
+        auto expired = [&deadline]() { return std::chrono::steady_clock::now() >= deadline; };
+        bool incremental = conn->config().autoVacuum == "INCREMENTAL";
+        if(!incremental && !warned) {
+            Logger::warn("[Compactor]: auto_vacuum is " + conn->config().autoVacuum + ", deleted rows are removed but the file won't shrink");
+            warned = true;
+        }
+
+        CompactionStats stats;
+        bool done = true;
+        for(const char* table : TOMBSTONED_TABLES) {
+            int removed;
+            do {
+                if(expired()) {
+                    done = false;
+                    break;
+                }
+                removed = purge(conn, table);
+                stats.purged += removed;
+            } while(removed == batchSize);
+            if(!done)
+                break;
+        }
+        while(done && incremental) {
+            if(expired()) {
+                done = false;
+                break;
+            }
+            int freed = freePages(conn);
+            stats.pagesFreed += freed;
+            if(freed < VACUUM_STEP)
+                break;
+        }
+        stats.complete = done;
+        stats.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+        total.purged += stats.purged;
+        total.pagesFreed += stats.pagesFreed;
+        total.complete = stats.complete;
+        total.elapsed += stats.elapsed;
+        if(stats.purged || stats.pagesFreed)
+            Logger::info("[Compactor]: Removed " + std::to_string(stats.purged) + " rows, freed " +
+                         std::to_string(stats.pagesFreed) + " pages");
+        return stats;
+    }
+
+    CompactionStats Compactor::totals() {
+        std::lock_guard<std::mutex> lock(mtx);
+        return total;
+    }
+
+    // Deleting a tombstoned event or recipient cascades to its gifts, which are tombstones themselves.
+    // A parent that still has live gifts (from a database older than GIFTS_LIVE_PARENT_*) is kept
+    int Compactor::purge(DBEngine* conn, const char* table) {
+        std::string t(table);
+        std::string liveChildren;
+        if(t == "RECIPIENTS")
+            liveChildren = " AND NOT EXISTS (SELECT 1 FROM GIFTS g WHERE g.RecipientID = p.ID AND g.DeletedAt IS NULL)";
+        else if(t == "EVENTS")
+            liveChildren = " AND NOT EXISTS (SELECT 1 FROM GIFTS g WHERE g.EventID = p.ID AND g.DeletedAt IS NULL)";
+        PreparedStatement stmt(conn, "DELETE FROM " + t + " WHERE ID IN (SELECT ID FROM " + t +
+                                     " p WHERE DeletedAt IS NOT NULL" + liveChildren + " ORDER BY DeletedAt LIMIT ?);");
+        stmt.bind(1, batchSize);
+        int rc = stmt.step();
+        if(rc != SQLITE_DONE)
+            throw DatabaseException("[Compactor] Couldn't purge " + t + ": " + conn->getLastErrorMsg(), rc);
+        return sqlite3_changes(conn->get());
+    }
+
+    // Moves up to VACUUM_STEP pages from the end of the file into free slots and truncates it
+    int Compactor::freePages(DBEngine* conn) {
+        auto freelist = [conn]() {
+            PreparedStatement stmt(conn, "PRAGMA freelist_count;");
+            stmt.step();
+            return Row(stmt.get()).get<int>(0);
+        };
+        int before = freelist();
+        if(before == 0)
+            return 0;
+        if(conn->execute("PRAGMA incremental_vacuum(" + std::to_string(VACUUM_STEP) + ");", "incremental vacuum") != ENGINE_OK)
+            throw DatabaseException("[Compactor] incremental_vacuum failed: " + std::string(conn->getLastErrorMsg()), ENGINE_ERROR);
+        return before - freelist();
+    }
+    // end of Class: Compactor
+
+}
@@ -0,0 +1,55 @@
+#ifndef COMPACTOR_H
+#define COMPACTOR_H
+#include "db.hpp"
+#include "maintenance.hpp"
+#include <mutex>
+#include <chrono>
+
+namespace App {
+
+    struct CompactionStats {
+        int purged = 0;                         // tombstoned rows removed
+        int pagesFreed = 0;                     // pages given back to the file system
+        bool complete = false;                  // no tombstones and no free pages were left
+        std::chrono::microseconds elapsed{0};
+    };
+
+    /*
+     * Compaction for GiftPlanner's soft deletes.
+     * A run removes tombstoned rows in batches of batchSize, gifts first so that removing an event
+     * or recipient never cascades to many rows at once, then returns free pages to the file system
+     * with PRAGMA incremental_vacuum (only with auto_vacuum=INCREMENTAL, see DBConfig::autoVacuum).
+     * Every batch is its own short write transaction and the run stops at its deadline, the rest
+     * is left for the next run. Scheduled, it runs on the maintenance connection while the app
+     * keeps reading and writing.
+     */
+    class Compactor {
+        public:
+            explicit Compactor(int batchSize=256);
+
+            // One run on conn, until the work is done or the deadline has passed
+            CompactionStats compact(Engine::DBEngine* conn,
+                                    std::chrono::steady_clock::time_point deadline=std::chrono::steady_clock::time_point::max());
+            // Registers the "compact" task
+            void schedule(Engine::MaintenanceScheduler& scheduler, std::chrono::seconds interval=std::chrono::minutes(10),
+                          std::chrono::milliseconds budget=std::chrono::milliseconds(50));
+            // Totals over every run so far
+            CompactionStats totals();
+
+            Compactor(const Compactor&) = delete;
+            Compactor& operator=(const Compactor&) = delete;
+
+        private:
+            // Removes one batch from table, returns the number of rows removed
+            int purge(Engine::DBEngine* conn, const char* table);
+            int freePages(Engine::DBEngine* conn);
+
+            int batchSize;
+            bool warned = false;
+            CompactionStats total;
+            std::mutex mtx;
+    };
+
+}
+
+#endif
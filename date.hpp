@@ -0,0 +1,157 @@
+#ifndef DATE_H
+#define DATE_H
+#include <optional>
+#include <string_view>
+
+namespace App {
+
+    /*
+     * Calendar dates, proleptic Gregorian.
+     * The database stores dates as ISO 8601 text (YYYY-MM-DD): it sorts chronologically, a date
+     * range is an index range scan and SQLite's date functions take it as is. People type and
+     * read dd-mm-YYYY. Parsing and formatting are constexpr and never allocate, a formatted date
+     * is a fixed size DateText.
+     */
+
+    // Days since 1970-01-01, Howard Hinnant's days_from_civil and civil_from_days
+    constexpr int daysFromCivil(int year, int month, int day) {
+        year -= month <= 2;
+        const int era = (year >= 0 ? year : year - 399) / 400;
+        const unsigned yoe = static_cast<unsigned>(year - era * 400);
+        const unsigned doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+        const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        return era * 146097 + static_cast<int>(doe) - 719468;
+    }
+    constexpr void civilFromDays(int days, int& year, int& month, int& day) {
+        days += 719468;
+        const int era = (days >= 0 ? days : days - 146096) / 146097;
+        const unsigned doe = static_cast<unsigned>(days - era * 146097);
+        const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        const unsigned mp = (5 * doy + 2) / 153;
+        day = static_cast<int>(doy - (153 * mp + 2) / 5 + 1);
+        month = static_cast<int>(mp < 10 ? mp + 3 : mp - 9);
+        year = static_cast<int>(yoe) + era * 400 + (month <= 2);
+    }
+
+    constexpr bool isLeapYear(int year) {
+        return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    }
+    constexpr int daysInMonth(int year, int month) {
+        if(month == 2)
+            return isLeapYear(year) ? 29 : 28;
+        return month == 4 || month == 6 || month == 9 || month == 11 ? 30 : 31;
+    }
+
+    struct Date {
+        int year = 1970;
+        int month = 1;
+        int day = 1;
+
+        // Four digit years only, that is all the text formats hold
+        constexpr bool valid() const {
+            return year >= 1 && year <= 9999 && month >= 1 && month <= 12 && day >= 1 && day <= daysInMonth(year, month);
+        }
+        constexpr int days() const { return daysFromCivil(year, month, day); }
+        static constexpr Date fromDays(int days) {
+            Date date;
+            civilFromDays(days, date.year, date.month, date.day);
+            return date;
+        }
+        constexpr Date addDays(int n) const { return fromDays(days() + n); }
+        // 0 for Monday to 6 for Sunday, 1970-01-01 was a Thursday
+        constexpr int weekday() const { return ((days() + 3) % 7 + 7) % 7; }
+
+        constexpr bool operator==(const Date& other) const {
+            return year == other.year && month == other.month && day == other.day;
+        }
+        constexpr bool operator!=(const Date& other) const { return !(*this == other); }
+        constexpr bool operator<(const Date& other) const {
+            return year != other.year ? year < other.year : month != other.month ? month < other.month : day < other.day;
+        }
+        constexpr bool operator<=(const Date& other) const { return !(other < *this); }
+        constexpr bool operator>(const Date& other) const { return other < *this; }
+        constexpr bool operator>=(const Date& other) const { return !(*this < other); }
+    };
+
+    enum class DateFormat {
+        ISO,            // YYYY-MM-DD, how dates are stored
+        DISPLAY         // dd-mm-YYYY, how they are shown and typed
+    };
+
+    // A formatted date, NUL terminated
+    struct DateText {
+        char chars[11] = {};
+
+        constexpr std::string_view view() const { return std::string_view(chars, 10); }
+        constexpr operator std::string_view() const { return view(); }
+        const char* c_str() const { return chars; }
+    };
+
+    namespace detail {
+        // The n digit number at text[at], -1 if any of them isn't a digit
+        constexpr int readDigits(std::string_view text, size_t at, size_t n) {
+            int value = 0;
+            for(size_t i = at; i < at + n; i++) {
+                if(text[i] < '0' || text[i] > '9')
+                    return -1;
+                value = value * 10 + (text[i] - '0');
+            }
+            return value;
+        }
+        constexpr void writeDigits(char* out, int value, int n) {
+            for(int i = n - 1; i >= 0; i--) {
+                out[i] = static_cast<char>('0' + value % 10);
+                value /= 10;
+            }
+        }
+        constexpr bool isSeparator(char c) {
+            return c == '-' || c == '/' || c == '.';
+        }
+    }
+
+    // Reads YYYY-MM-DD or dd-mm-YYYY, '/' and '.' separate too. Nothing when the text is
+    // neither or not a real date, like 31-02-2025
+    constexpr std::optional<Date> parseDate(std::string_view text) {
+        if(text.size() != 10)
+            return std::nullopt;
+        Date date;
+        if(detail::isSeparator(text[4]) && text[7] == text[4]) {
+            date.year = detail::readDigits(text, 0, 4);
+            date.month = detail::readDigits(text, 5, 2);
+            date.day = detail::readDigits(text, 8, 2);
+        }
+        else if(detail::isSeparator(text[2]) && text[5] == text[2]) {
+            date.day = detail::readDigits(text, 0, 2);
+            date.month = detail::readDigits(text, 3, 2);
+            date.year = detail::readDigits(text, 6, 4);
+        }
+        else
+            return std::nullopt;
+        if(!date.valid())
+            return std::nullopt;
+        return date;
+    }
+
+    constexpr DateText formatDate(const Date& date, DateFormat format=DateFormat::ISO) {
+        DateText text;
+        if(format == DateFormat::ISO) {
+            detail::writeDigits(text.chars, date.year, 4);
+            text.chars[4] = '-';
+            detail::writeDigits(text.chars + 5, date.month, 2);
+            text.chars[7] = '-';
+            detail::writeDigits(text.chars + 8, date.day, 2);
+        }
+        else {
+            detail::writeDigits(text.chars, date.day, 2);
+            text.chars[2] = '-';
+            detail::writeDigits(text.chars + 3, date.month, 2);
+            text.chars[5] = '-';
+            detail::writeDigits(text.chars + 6, date.year, 4);
+        }
+        return text;
+    }
+
+}
+
+#endif
@@ -1,11 +1,17 @@
 #include "db.hpp"
 #include "logger.hpp"
 #include <iostream>
+#include <thread>
+#include <cctype>
+#include <cstring>
+#include <cstdlib>
+#include <random>
+#include <algorithm>
 
 //TODO: Expose API
-static Engine::DBEngine* Engine::Init(const std::string& path, bool debug, size_t cache) {
+static Engine::DBEngine* Engine::Init(const std::string& path, bool debug, size_t cache, const DBConfig& config) {
     try {
-        Engine::DBEngine* db = new Engine::DBEngine(path, debug, cache);
+        Engine::DBEngine* db = new Engine::DBEngine(path, debug, cache, config);
         return db;
     }
     catch(Engine::ConnectionError &e) {
@@ -15,6 +21,69 @@ static Engine::DBEngine* Engine::Init(const std::string& path, bool debug, size_
 
 using namespace Engine;
 
+/*
+ * Struct: DBConfig
+ */
+DBConfig DBConfig::interactive() {
+    return DBConfig();
+}
+DBConfig DBConfig::bulkLoad() {
+    DBConfig config;
+    config.synchronous = "OFF";
+    config.cacheSize = -262144;         // 256 MiB
+    config.mmapSize = 256LL << 20;
+    config.busyTimeout = 30000;
+    return config;
+}
+DBConfig DBConfig::readMostly() {
+    DBConfig config;
+    config.cacheSize = -65536;          // 64 MiB
+    config.mmapSize = 1LL << 30;
+    config.busyTimeout = 10000;
+    return config;
+}
+DBConfig DBConfig::preset(const std::string& name) {
+    if(name == "interactive")
+        return interactive();
+    if(name == "bulk-load")
+        return bulkLoad();
+    if(name == "read-mostly")
+        return readMostly();
+    throw ConfigError("[DB] Unknown config preset: " + name, ENGINE_CONFIG_ERROR);
+}
+// end of Struct: DBConfig
+
+static std::string upper(std::string s) {
+    for(char& c : s)
+        c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    return s;
+}
+// position of value in names, -1 if missing. PRAGMA synchronous and temp_store report these indexes
+static int indexOf(const std::vector<std::string>& names, const std::string& value) {
+    for(size_t i = 0; i < names.size(); i++) {
+        if(names[i] == upper(value))
+            return static_cast<int>(i);
+    }
+    return -1;
+}
+static const std::vector<std::string> JOURNAL_MODES = {"DELETE", "TRUNCATE", "PERSIST", "MEMORY", "WAL", "OFF"};
+static const std::vector<std::string> SYNCHRONOUS_MODES = {"OFF", "NORMAL", "FULL", "EXTRA"};
+static const std::vector<std::string> TEMP_STORES = {"DEFAULT", "FILE", "MEMORY"};
+static const std::vector<std::string> AUTO_VACUUM_MODES = {"NONE", "FULL", "INCREMENTAL"};
+
+// first column of the first row of a PRAGMA, empty if it returns nothing
+static std::string pragma(sqlite3* db, const std::string& sql) {
+    sqlite3_stmt* stmt = nullptr;
+    std::string value;
+    if(sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) == SQLITE_OK && sqlite3_step(stmt) == SQLITE_ROW) {
+        const unsigned char* text = sqlite3_column_text(stmt, 0);
+        if(text)
+            value = reinterpret_cast<const char*>(text);
+    }
+    sqlite3_finalize(stmt);
+    return value;
+}
+
 /*
  * Class: LRUCache
  * LRU cache for sqlite3_stmt* statements
@@ -163,10 +232,23 @@ int LRUCache::clearAll() {
  */
 // This engine does not support multithreading
 // Default statement cache size is 16
-DBEngine::DBEngine(const std::string& dbPath, bool debug, size_t cacheSize) {
+DBEngine::DBEngine(const std::string& dbPath, bool debug, size_t cacheSize, const DBConfig& config) {
     
     // enable logging
     Logger::enabled = debug;
+
+    if(indexOf(JOURNAL_MODES, config.journalMode) < 0)
+        throw ConfigError("[DB] Invalid journal_mode: " + config.journalMode, ENGINE_CONFIG_ERROR);
+    if(indexOf(SYNCHRONOUS_MODES, config.synchronous) < 0)
+        throw ConfigError("[DB] Invalid synchronous: " + config.synchronous, ENGINE_CONFIG_ERROR);
+    if(indexOf(TEMP_STORES, config.tempStore) < 0)
+        throw ConfigError("[DB] Invalid temp_store: " + config.tempStore, ENGINE_CONFIG_ERROR);
+    if(indexOf(AUTO_VACUUM_MODES, config.autoVacuum) < 0)
+        throw ConfigError("[DB] Invalid auto_vacuum: " + config.autoVacuum, ENGINE_CONFIG_ERROR);
+    if(config.pageSize < 512 || config.pageSize > 65536 || (config.pageSize & (config.pageSize - 1)) != 0)
+        throw ConfigError("[DB] page_size must be a power of two between 512 and 65536", ENGINE_CONFIG_ERROR);
+    if(config.mmapSize < 0 || config.busyTimeout < 0)
+        throw ConfigError("[DB] mmap_size and busy_timeout can't be negative", ENGINE_CONFIG_ERROR);
     
     if (sqlite3_open(dbPath.c_str(), &db)){
         Logger::error("[DB]: Failed to open DB");
@@ -175,11 +257,75 @@ DBEngine::DBEngine(const std::string& dbPath, bool debug, size_t cacheSize) {
         throw ConnectionError("[DB] Couldn't connect to database", ENGINE_CONNECTION_ERROR);
     }
     Logger::info("[DB]: Opened DB successfully");
+    configure(config, dbPath.empty() || dbPath == ":memory:" || dbPath.compare(0, 5, "file:") == 0);
+    sqlite3_update_hook(db, &DBEngine::onUpdate, this);
+    sqlite3_commit_hook(db, &DBEngine::onCommit, this);
+    sqlite3_rollback_hook(db, &DBEngine::onRollback, this);
     stmtCache = new LRUCache(cacheSize);
     Logger::info("[DB]: Initialized statement cache");
 }
+// Applies config and reads every setting back. SQLite silently keeps the old value when it
+// can't apply one (journal mode of an in-memory database, page size of a used file, mmap
+// limit of the build), such differences are logged and visible through config()
+void DBEngine::configure(const DBConfig& config, bool inMemory) {
+    sqlite3_busy_timeout(db, config.busyTimeout);
+    // page size and auto_vacuum only take effect before the first table is created, and page
+    // size must be set before WAL is enabled, WAL databases can't change it
+    pragma(db, "PRAGMA auto_vacuum = " + upper(config.autoVacuum) + ";");
+    pragma(db, "PRAGMA page_size = " + std::to_string(config.pageSize) + ";");
+    pragma(db, "PRAGMA journal_mode = " + upper(config.journalMode) + ";");
+    pragma(db, "PRAGMA synchronous = " + upper(config.synchronous) + ";");
+    pragma(db, "PRAGMA cache_size = " + std::to_string(config.cacheSize) + ";");
+    pragma(db, "PRAGMA mmap_size = " + std::to_string(config.mmapSize) + ";");
+    pragma(db, "PRAGMA temp_store = " + upper(config.tempStore) + ";");
+    pragma(db, std::string("PRAGMA foreign_keys = ") + (config.foreignKeys ? "ON" : "OFF") + ";");
+
+    effective.journalMode = upper(pragma(db, "PRAGMA journal_mode;"));
+    int sync = std::atoi(pragma(db, "PRAGMA synchronous;").c_str());
+    effective.synchronous = sync >= 0 && sync < static_cast<int>(SYNCHRONOUS_MODES.size()) ? SYNCHRONOUS_MODES[sync] : "";
+    effective.cacheSize = std::atoi(pragma(db, "PRAGMA cache_size;").c_str());
+    effective.mmapSize = std::atoll(pragma(db, "PRAGMA mmap_size;").c_str());
+    int temp = std::atoi(pragma(db, "PRAGMA temp_store;").c_str());
+    effective.tempStore = temp >= 0 && temp < static_cast<int>(TEMP_STORES.size()) ? TEMP_STORES[temp] : "";
+    effective.pageSize = std::atoi(pragma(db, "PRAGMA page_size;").c_str());
+    int vacuum = std::atoi(pragma(db, "PRAGMA auto_vacuum;").c_str());
+    effective.autoVacuum = vacuum >= 0 && vacuum < static_cast<int>(AUTO_VACUUM_MODES.size()) ? AUTO_VACUUM_MODES[vacuum] : "";
+    effective.busyTimeout = std::atoi(pragma(db, "PRAGMA busy_timeout;").c_str());
+    effective.foreignKeys = pragma(db, "PRAGMA foreign_keys;") == "1";
+    effective.busy = config.busy;
+
+    auto check = [](const char* name, const std::string& wanted, const std::string& got) {
+        if(wanted != got)
+            Logger::warn(std::string("[DB]: ") + name + " is " + got + ", requested " + wanted);
+    };
+    if(!inMemory)
+        check("journal_mode", upper(config.journalMode), effective.journalMode);
+    check("synchronous", upper(config.synchronous), effective.synchronous);
+    check("cache_size", std::to_string(config.cacheSize), std::to_string(effective.cacheSize));
+    if(!inMemory)
+        check("mmap_size", std::to_string(config.mmapSize), std::to_string(effective.mmapSize));
+    check("temp_store", upper(config.tempStore), effective.tempStore);
+    check("page_size", std::to_string(config.pageSize), std::to_string(effective.pageSize));
+    // an existing file keeps its mode until the next full VACUUM
+    check("auto_vacuum", upper(config.autoVacuum), effective.autoVacuum);
+    check("busy_timeout", std::to_string(config.busyTimeout), std::to_string(effective.busyTimeout));
+    // GIFTS relies on ON DELETE CASCADE, a build without foreign key support is an error
+    if(config.foreignKeys && !effective.foreignKeys) {
+        sqlite3_close(db);
+        db = nullptr;
+        throw ConfigError("[DB] foreign_keys could not be enabled", ENGINE_CONFIG_ERROR);
+    }
+}
 DBEngine::~DBEngine(){
+    {
+        // running backups read from db, stop them before closing it
+        std::unique_lock<std::mutex> lock(backupMtx);
+        closing = true;
+        backupDone.wait(lock, [this]() { return activeBackups == 0; });
+    }
     if(db){ 
+        // keeps planner statistics current for what this connection queried, usually a no-op
+        sqlite3_exec(db, "PRAGMA analysis_limit = 1000; PRAGMA optimize;", nullptr, nullptr, nullptr);
         sqlite3_close(db);
         db=nullptr;
         Logger::info("[DB]: Closed DB successfully");
@@ -200,17 +346,55 @@ DBEngine::~DBEngine(){
  */
 //execute
 int DBEngine::execute(const std::string& sql, const std::string& msg) {
-    std::lock_guard<std::mutex> lock(mtx);
-    char* errMsg = nullptr;
-    if (sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &errMsg) != SQLITE_OK) {
+    std::unique_lock<std::mutex> lock(mtx);
+    std::string errMsg;
+    int rc;
+    // statements before a busy one have committed, a retry resumes at the one that failed
+    const char* next = sql.c_str();
+    for(int attempt = 0; ; attempt++) {
+        rc = execStatements(next, errMsg);
+        // inside a transaction the caller has to roll back, retrying could deadlock
+        if(rc != SQLITE_BUSY || active || !backoff(attempt))
+            break;
+    }
+    if (rc != SQLITE_OK) {
         Logger::error(std::string("[DB]: Failed to execute query: ") + msg + ": " + errMsg);
-        sqlite3_free(errMsg);
         return ENGINE_ERROR;
     }
 
     Logger::info("[DB] OK: "+ msg);
+    lock.unlock();
+    dispatchChanges();
     return ENGINE_OK;
 }
+// sqlite3_exec one statement at a time, a failing statement inside a transaction drops only its own changes.
+// On failure next points at the statement that failed
+int DBEngine::execStatements(const char*& next, std::string& errMsg) {
+    while(*next) {
+        const char* start = next;
+        sqlite3_stmt* stmt = nullptr;
+        int rc = sqlite3_prepare_v2(db, start, -1, &stmt, &next);
+        if(rc != SQLITE_OK) {
+            errMsg = sqlite3_errmsg(db);
+            next = start;
+            return rc;
+        }
+        if(!stmt)
+            continue;       // whitespace or a comment
+        const size_t mark = changeMark();
+        while((rc = sqlite3_step(stmt)) == SQLITE_ROW) {}
+        if(rc != SQLITE_DONE) {
+            errMsg = sqlite3_errmsg(db);
+            sqlite3_finalize(stmt);
+            if(active)
+                dropChangesSince(mark);
+            next = start;
+            return rc;
+        }
+        sqlite3_finalize(stmt);
+    }
+    return SQLITE_OK;
+}
 
 
 /*
@@ -252,34 +436,103 @@ int DBEngine::releaseCached(sqlite3_stmt* stmt){
 
 // Initiate a transaction
 // The engine allows only one transaction at a time per connection
-int DBEngine::begin() {
+int DBEngine::begin(TransactionMode mode) {
     std::lock_guard<std::mutex> lock(mtx);
     if(active)
         throw TransactionError("Transaction already active", ENGINE_ERROR);
+    // IMMEDIATE takes the write lock up front. A deferred transaction that has read and then
+    // finds the lock taken when it writes can't wait for it, it has to roll back and start over
+    const char* sql = "BEGIN IMMEDIATE;";
+    if(mode == TransactionMode::DEFERRED)
+        sql = "BEGIN DEFERRED;";
+    else if(mode == TransactionMode::EXCLUSIVE)
+        sql = "BEGIN EXCLUSIVE;";
+    else if(mode == TransactionMode::READ_ONLY_SNAPSHOT)
+        // the snapshot starts at the first read, take it now rather than at the caller's first query
+        sql = "BEGIN DEFERRED; SELECT COUNT(*) FROM sqlite_master;";
     char* errMsg = nullptr;
-    if(sqlite3_exec(db, "BEGIN TRANSACTION;", nullptr, nullptr, &errMsg) != SQLITE_OK) {
-        std::string msg = errMsg;
+    int rc;
+    for(int attempt = 0; ; attempt++) {
+        rc = sqlite3_exec(db, sql, nullptr, nullptr, &errMsg);
+        if(rc != SQLITE_BUSY || !backoff(attempt))
+            break;
         sqlite3_free(errMsg);
+        errMsg = nullptr;
+        if(sqlite3_get_autocommit(db) == 0)
+            sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);  // BEGIN ran, the read did not
+    }
+    if(rc != SQLITE_OK) {
+        std::string msg = errMsg ? errMsg : "";
+        sqlite3_free(errMsg);
+        if(sqlite3_get_autocommit(db) == 0)
+            sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        if(rc == SQLITE_BUSY)
+            throw BusyError("Database is locked, couldn't start transaction: "+msg, ENGINE_BUSY);
         throw TransactionError("Failed to start transaction"+msg, ENGINE_ERROR);
     }
+    if(mode == TransactionMode::READ_ONLY_SNAPSHOT) {
+        sqlite3_exec(db, "PRAGMA query_only = ON;", nullptr, nullptr, nullptr);
+        readOnly = true;
+    }
     active = true;    
     Logger::info("[TRANSACTION]: Starting transaction");
     return ENGINE_OK;
 }
+// query_only belongs to the connection, it must not outlive the snapshot
+void DBEngine::endReadOnly() {
+    if(readOnly) {
+        sqlite3_exec(db, "PRAGMA query_only = OFF;", nullptr, nullptr, nullptr);
+        readOnly = false;
+    }
+}
 //commit
 int DBEngine::commit() {
-    std::lock_guard<std::mutex> lock(mtx);
+    std::unique_lock<std::mutex> lock(mtx);
     if(!active)
         throw std::runtime_error("No active transaction");
+    // a busy COMMIT leaves the transaction open and may simply be run again
     char* errMsg = nullptr;
-    if(sqlite3_exec(db, "COMMIT;", nullptr, nullptr, &errMsg) != SQLITE_OK) {
+    int rc;
+    const size_t batches = committedChanges.size();
+    for(int attempt = 0; ; attempt++) {
+        rc = sqlite3_exec(db, "COMMIT;", nullptr, nullptr, &errMsg);
+        if(rc != SQLITE_BUSY || !backoff(attempt))
+            break;
+        sqlite3_free(errMsg);
+        errMsg = nullptr;
+    }
+    if(rc != SQLITE_OK) {
         std::string msg = errMsg ? errMsg : "Commit failed" ;
+        if(rc == SQLITE_BUSY) {
+            // still open, the owner's rollback() ends it. The commit hook may already have
+            // moved its changes, they belong to the open transaction again. Batches of earlier
+            // commits that are still waiting for delivery stay where they are
+            if(committedChanges.size() > batches) {
+                pendingChanges = std::move(committedChanges.back());
+                committedChanges.pop_back();
+            }
+            sqlite3_free(errMsg);
+            throw BusyError("Database is locked, couldn't commit: "+msg, ENGINE_BUSY);
+        }
         sqlite3_free(errMsg);
+        // e.g. a deferred foreign key leaves the transaction open, the engine treats it as ended
+        if(sqlite3_get_autocommit(db) == 0)
+            sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
         active = false;
+        savepoints.clear();
+        endReadOnly();
+        // only this transaction's batch is void, earlier commits still get delivered
+        if(committedChanges.size() > batches)
+            committedChanges.pop_back();
+        pendingChanges.clear();
         throw TransactionError("Failed to commit transaction "+msg, ENGINE_COMMIT_FAILURE);
     }
     active = false; 
+    savepoints.clear();
+    endReadOnly();
     Logger::info("[TRANSACTION]: Commit success");
+    lock.unlock();
+    dispatchChanges();
     return ENGINE_OK;
 }
 //rollback
@@ -293,9 +546,83 @@ int DBEngine::rollback() {
         Logger::error("[TRANSACTION]: "+msg);
     }
     active = false; 
+    savepoints.clear();
+    endReadOnly();
     Logger::info("[TRANSACTION]: Rollback success");
     return ENGINE_OK;
 }
+std::string DBEngine::savepoint() {
+    std::lock_guard<std::mutex> lock(mtx);
+    if(!active)
+        throw TransactionError("Savepoint needs an active transaction", ENGINE_ERROR);
+    std::string name = "sp_" + std::to_string(nextSavepoint++);
+    char* errMsg = nullptr;
+    if(sqlite3_exec(db, ("SAVEPOINT " + name + ";").c_str(), nullptr, nullptr, &errMsg) != SQLITE_OK) {
+        std::string msg = errMsg ? errMsg : "";
+        sqlite3_free(errMsg);
+        throw TransactionError("Failed to open savepoint "+msg, ENGINE_ERROR);
+    }
+    savepoints.push_back(SavepointMark{name, pendingChanges.size()});
+    Logger::info("[TRANSACTION]: Savepoint " + name);
+    return name;
+}
+void DBEngine::release(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if(savepoints.empty() || savepoints.back().name != name)
+        throw TransactionError("Savepoint " + name + " is not the innermost one", ENGINE_ERROR);
+    char* errMsg = nullptr;
+    if(sqlite3_exec(db, ("RELEASE " + name + ";").c_str(), nullptr, nullptr, &errMsg) != SQLITE_OK) {
+        std::string msg = errMsg ? errMsg : "";
+        sqlite3_free(errMsg);
+        throw TransactionError("Failed to release savepoint "+msg, ENGINE_ERROR);
+    }
+    savepoints.pop_back();
+}
+void DBEngine::rollbackTo(const std::string& name) {
+    std::lock_guard<std::mutex> lock(mtx);
+    if(!active)
+        return;     // the whole transaction has already ended, nothing left to undo
+    if(savepoints.empty() || savepoints.back().name != name)
+        throw TransactionError("Savepoint " + name + " is not the innermost one", ENGINE_ERROR);
+    char* errMsg = nullptr;
+    if(sqlite3_exec(db, ("ROLLBACK TO " + name + "; RELEASE " + name + ";").c_str(), nullptr, nullptr, &errMsg) != SQLITE_OK) {
+        std::string msg = errMsg ? errMsg : "Rollback failed";
+        sqlite3_free(errMsg);
+        Logger::error("[TRANSACTION]: "+msg);
+    }
+    // the rollback hook only fires for whole transactions, drop the undone changes here
+    if(pendingChanges.size() > savepoints.back().changes)
+        pendingChanges.resize(savepoints.back().changes);
+    savepoints.pop_back();
+    Logger::info("[TRANSACTION]: Rolled back to " + name);
+}
+
+bool DBEngine::backoff(int attempt) {
+    const BusyPolicy& policy = effective.busy;
+    if(attempt >= policy.maxRetries) {
+        busyFailures++;
+        return false;
+    }
+    long long delay = static_cast<long long>(policy.initialBackoffMs) * 1000;
+    for(int i = 0; i < attempt && delay < policy.maxBackoffMs * 1000LL; i++)
+        delay *= 2;
+    delay = std::min(delay, policy.maxBackoffMs * 1000LL);
+    // jitter keeps competing writers from waking up together
+    static thread_local std::minstd_rand rng(std::random_device{}());
+    long long wait = delay / 2 + static_cast<long long>(rng() % static_cast<unsigned long long>(delay / 2 + 1));
+    std::this_thread::sleep_for(std::chrono::microseconds(wait));
+    busyRetries++;
+    busyWaitedMicros += static_cast<unsigned long long>(wait);
+    Logger::info("[DB]: Database busy, retry " + std::to_string(attempt + 1));
+    return true;
+}
+BusyStats DBEngine::busyStats() const {
+    BusyStats stats;
+    stats.retries = busyRetries;
+    stats.waitedMicros = busyWaitedMicros;
+    stats.failures = busyFailures;
+    return stats;
+}
 
 const char* DBEngine::getLastErrorMsg() {
     return sqlite3_errmsg(db);
@@ -305,6 +632,137 @@ const char* DBEngine::getLastErrorMsg() {
 sqlite3* DBEngine::get() {
     return db;
 }
+
+// Change data capture
+int DBEngine::subscribe(ChangeCallback callback) {
+    int id = nextSubscriberId++;
+    subscribers.emplace_back(id, std::move(callback));
+    return id;
+}
+void DBEngine::unsubscribe(int id) {
+    for(auto it = subscribers.begin(); it != subscribers.end(); ++it) {
+        if(it->first == id) {
+            subscribers.erase(it);
+            return;
+        }
+    }
+}
+// sqlite hooks run inside sqlite3_step and must not touch the connection,
+// so they only buffer. Delivery happens in dispatchChanges()
+void DBEngine::onUpdate(void* self, int op, const char* dbName, const char* table, sqlite3_int64 rowid) {
+    DBEngine* engine = static_cast<DBEngine*>(self);
+    // temp tables are connection-local scratch space, not data other components care about
+    if(engine->subscribers.empty() || std::strcmp(dbName, "temp") == 0)
+        return;
+    ChangeType type = ChangeType::UPDATED;
+    if(op == SQLITE_INSERT)
+        type = ChangeType::INSERTED;
+    else if(op == SQLITE_DELETE)
+        type = ChangeType::DELETED;
+    engine->pendingChanges.push_back(RowChange{type, table, rowid});
+}
+int DBEngine::onCommit(void* self) {
+    DBEngine* engine = static_cast<DBEngine*>(self);
+    if(!engine->pendingChanges.empty()) {
+        engine->committedChanges.push_back(std::move(engine->pendingChanges));
+        engine->pendingChanges.clear();
+    }
+    return 0;   // non-zero would turn the commit into a rollback
+}
+void DBEngine::onRollback(void* self) {
+    static_cast<DBEngine*>(self)->pendingChanges.clear();
+}
+void DBEngine::dropChangesSince(size_t mark) {
+    // a failure that rolled back the whole transaction has cleared them already
+    if(pendingChanges.size() > mark)
+        pendingChanges.resize(mark);
+}
+void DBEngine::dispatchChanges() {
+    // a subscriber writing from its callback commits again, that batch is picked up by the outer loop
+    if(dispatching || committedChanges.empty())
+        return;
+    dispatching = true;
+    try {
+        while(!committedChanges.empty()) {
+            std::vector<ChangeBatch> batches;
+            batches.swap(committedChanges);
+            for(const ChangeBatch& batch : batches) {
+                // copy so callbacks may unsubscribe themselves
+                auto targets = subscribers;
+                for(auto& sub : targets)
+                    sub.second(batch);
+            }
+        }
+    }
+    catch(...) {
+        dispatching = false;
+        throw;
+    }
+    dispatching = false;
+    Logger::info("[DB]: Delivered committed changes");
+}
+std::future<void> DBEngine::backup(const std::string& path, int pagesPerStep, std::chrono::milliseconds pause, BackupCallback progress) {
+    if(pagesPerStep <= 0)
+        pagesPerStep = -1;      // everything in one step
+    {
+        std::lock_guard<std::mutex> lock(backupMtx);
+        if(closing)
+            throw BackupError("[DB] Engine is closing, backup refused", ENGINE_BACKUP_ERROR);
+        activeBackups++;
+    }
+    return std::async(std::launch::async, [this, path, pagesPerStep, pause, progress]() {
+        try {
+            runBackup(path, pagesPerStep, pause, progress);
+        }
+        catch(...) {
+            std::lock_guard<std::mutex> lock(backupMtx);
+            activeBackups--;
+            backupDone.notify_all();
+            throw;
+        }
+        std::lock_guard<std::mutex> lock(backupMtx);
+        activeBackups--;
+        backupDone.notify_all();
+    });
+}
+void DBEngine::runBackup(const std::string& path, int pagesPerStep, std::chrono::milliseconds pause, const BackupCallback& progress) {
+    sqlite3* target = nullptr;
+    if(sqlite3_open(path.c_str(), &target) != SQLITE_OK) {
+        std::string msg = target ? sqlite3_errmsg(target) : "out of memory";
+        sqlite3_close(target);
+        throw BackupError("[DB] Couldn't open backup target " + path + ": " + msg, ENGINE_BACKUP_ERROR);
+    }
+    sqlite3_backup* backup = sqlite3_backup_init(target, "main", db, "main");
+    if(!backup) {
+        std::string msg = sqlite3_errmsg(target);
+        sqlite3_close(target);
+        throw BackupError("[DB] Couldn't start backup to " + path + ": " + msg, ENGINE_BACKUP_ERROR);
+    }
+    Logger::info("[DB]: Backup to " + path + " started");
+
+    int rc;
+    while(true) {
+        rc = sqlite3_backup_step(backup, pagesPerStep);
+        if(progress)
+            progress(BackupProgress{sqlite3_backup_remaining(backup), sqlite3_backup_pagecount(backup)});
+        if(rc != SQLITE_OK && rc != SQLITE_BUSY && rc != SQLITE_LOCKED)
+            break;
+        if(closing)
+            break;
+        // yield so writers are not starved
+        std::this_thread::sleep_for(pause);
+    }
+    sqlite3_backup_finish(backup);
+    std::string msg = sqlite3_errmsg(target);
+    sqlite3_close(target);
+
+    if(rc != SQLITE_DONE) {
+        if(closing)
+            throw BackupError("[DB] Backup to " + path + " cancelled", ENGINE_BACKUP_ERROR);
+        throw BackupError("[DB] Backup to " + path + " failed: " + msg, ENGINE_BACKUP_ERROR);
+    }
+    Logger::info("[DB]: Backup to " + path + " complete");
+}
 // end of Class: DBEngine
 
 
@@ -315,24 +773,66 @@ sqlite3* DBEngine::get() {
  * Class: Transaction
  *
  */
-Transaction::Transaction(DBEngine* dbEngine) : db(dbEngine) {
-    db->begin();           // db initiates a transaction 
+Transaction::Transaction(DBEngine* dbEngine, TransactionMode mode) : db(dbEngine) {
+    if(db->isActive())
+        savepoint = db->savepoint();    // nested in the caller's transaction
+    else
+        db->begin(mode);       // db initiates a transaction 
 }
 Transaction::~Transaction() {
     if(!committed) {
-        db->rollback();    // db rollbacks the transaction
+        if(savepoint.empty()) {
+            db->rollback();    // db rollbacks the transaction
+            return;
+        }
+        try {
+            db->rollbackTo(savepoint);
+        }
+        catch(const std::exception& e) {
+            Logger::error(std::string("[TRANSACTION]: ") + e.what());
+        }
     }
 }
 int Transaction::getTransactionState() {
     return state;
 };
 void Transaction::commit() {
-    db->commit();           // db commits changes
+    if(!savepoint.empty())
+        db->release(savepoint);
+    else
+        db->commit();           // db commits changes
     committed = true;       
 }
 // end of Class: Transaction
 
 
+/*
+ * Class: Savepoint
+ */
+Savepoint::Savepoint(DBEngine* dbEngine) : db(dbEngine) {
+    name = db->savepoint();
+}
+Savepoint::~Savepoint() {
+    if(done)
+        return;
+    try {
+        db->rollbackTo(name);
+    }
+    catch(const std::exception& e) {
+        Logger::error(std::string("[TRANSACTION]: ") + e.what());
+    }
+}
+void Savepoint::release() {
+    db->release(name);
+    done = true;
+}
+void Savepoint::rollback() {
+    db->rollbackTo(name);
+    done = true;
+}
+// end of Class: Savepoint
+
+
 
 
 
@@ -343,34 +843,41 @@ void Transaction::commit() {
  * 
  */
 PreparedStatement::PreparedStatement(DBEngine* db, const std::string& sql):db_(db), _sql(sql) {
-    
+    throwIfError(open());
+}
+PreparedStatement::PreparedStatement(DBEngine* db, const std::string& sql, Unprepared):db_(db), _sql(sql) {}
+PreparedStatement::PreparedStatement(PreparedStatement&& other) noexcept
+    : db_(other.db_), stmt(other.stmt), finalized(other.finalized), prepared(other.prepared),
+      isCached(other.isCached), isReset(other.isReset), changeMark(other.changeMark), _sql(std::move(other._sql))
+#ifndef NDEBUG
+      , staticBindings(std::move(other.staticBindings))
+#endif
+{
+    other.stmt = nullptr;
+    other.finalized = true;
+}
+// borrow from cache or prepare, without throwing
+Status PreparedStatement::open() {
     Logger::info("Preparing statement");
     stmt = nullptr;
     sqlite3_stmt* _stmt = nullptr;
     int rc;
-    rc = db->getCached(sql, _stmt);
+    rc = db_->getCached(_sql, _stmt);
     if(rc == CACHE_OK){
         isCached = true;
     }
     else{
         int tmp = rc;
         isCached = false;
-        rc = db->prepare(sql, _stmt); 
+        rc = db_->prepare(_sql, _stmt); 
         if(rc != ENGINE_OK) {
-            stmt = nullptr;
             if(rc == ENGINE_SYNTAX_ERROR)
-            {
-                std::string msg = db_->getLastErrorMsg();
-                throw SyntaxError("SQL Error during execution: "+ msg, rc);
-            }
-            else {
-                std::string msg = db->getLastErrorMsg();
-                throw std::runtime_error("Unexpected exception occurred: "+msg);
-            }
+                return {ENGINE_SYNTAX_ERROR, SQLITE_ERROR, "SQL Error during execution: "};
+            return {ENGINE_ERROR, sqlite3_errcode(db_->get()), "Unexpected exception occurred: "};
         }
         else{
             if(tmp==CACHE_NOT_FOUND){
-                rc = db->addToCache(sql, _stmt);
+                rc = db_->addToCache(_sql, _stmt);
                 // add to cache, should not finalize
                 if(rc == CACHE_OK){
                     isCached = true;
@@ -382,6 +889,14 @@ PreparedStatement::PreparedStatement(DBEngine* db, const std::string& sql):db_(d
     _stmt = nullptr;
     prepared=true;
     Logger::info("Statement prepared");    
+    return {};
+}
+Expected<PreparedStatement> PreparedStatement::tryPrepare(DBEngine* db, const std::string& sql) {
+    PreparedStatement stmt(db, sql, Unprepared{});
+    Status status = stmt.open();
+    if(!status)
+        return status;
+    return stmt;
 }
 PreparedStatement::~PreparedStatement() {
     if(stmt) {
@@ -400,39 +915,91 @@ bool PreparedStatement::isFinalized() {
 }
 //step a stmt
 int PreparedStatement::step() {
+    Status status = tryStep();
+    if(status.row())
+        return ENGINE_ROW;
+    // every error throws, SQLite codes overlap the engine's (SQLITE_READONLY == ENGINE_ROW)
+    throwIfError(status);
+    return status.rc;
+}
+Status PreparedStatement::tryStep() {
     if (!stmt)
         // after statement is finalized, step operation is not permitted
-        throw StatementStateError("Cannot call step() on a finalized or uninitialized statement.", 1);
+        return {ENGINE_STATE_ERROR, SQLITE_MISUSE, "Cannot call step() on a finalized or uninitialized statement."};
+    if(!verifyStatic())
+        return {ENGINE_STATE_ERROR, SQLITE_MISUSE, "Buffer bound with bindStatic() changed before step()"};
     
     // after a step(), statement must be reset for binding or else should throw a state error
+    bool firstStep = isReset;
     isReset=false;         
+    if(firstStep)
+        changeMark = db_->changeMark();
        
     int rc=sqlite3_step(stmt);
-    if(rc==SQLITE_CONSTRAINT) {
-        reset(); // statement is reset after exception because calling finalize after an invalid step() throws
-        throw ConstraintError("Database constraint violated: ", rc); 
+    // an autocommit statement that has not returned rows yet can run again from the start.
+    // Inside a transaction the caller must roll back instead, waiting could deadlock
+    for(int attempt = 0; rc == SQLITE_BUSY && firstStep && !db_->isActive() && db_->backoff(attempt); attempt++) {
+        sqlite3_reset(stmt);        // bindings are kept
+        rc = sqlite3_step(stmt);
     }
-    if(rc == SQLITE_MISUSE){
-        reset();
-        Logger::info("SQL: "+_sql);
-        throw std::runtime_error("SQLite Misuse: "+ std::string(db_->getLastErrorMsg()));
+    if(rc == SQLITE_ROW)
+        return {ENGINE_ROW, rc};
+    if(rc == SQLITE_DONE) {
+        Logger::info("Statement executed");
+        if(!db_->isActive())
+            db_->dispatchChanges();     // statement ran in autocommit mode and has committed
+        return {ENGINE_OK, rc};
     }
-    if(rc==SQLITE_ERROR) {
-        reset();
-        throw SyntaxError("SQL Error during execution: ", rc);
+    // SQLite undid the statement, the transaction goes on without its changes
+    if(db_->isActive())
+        db_->dropChangesSince(changeMark);
+    // statement is reset after an error because calling finalize after an invalid step() throws
+    reset();
+    switch(rc) {
+        case SQLITE_BUSY:
+            return {ENGINE_BUSY, rc, "Database is locked: "};
+        case SQLITE_CONSTRAINT:
+            return {ENGINE_CONSTRAINT, rc, "Database constraint violated: "};
+        case SQLITE_MISUSE:
+            return {ENGINE_MISUSE, rc, "SQLite Misuse: "};
+        case SQLITE_ERROR:
+            return {ENGINE_SYNTAX_ERROR, rc, "SQL Error during execution: "};
+        case SQLITE_MISMATCH:
+            return {ENGINE_MISMATCH, rc, "Datatype mismatch on column binding "};
+        case SQLITE_READONLY:
+            // e.g. a write inside a READ_ONLY_SNAPSHOT transaction (PRAGMA query_only)
+            return {ENGINE_STEP_ERROR, rc, "Write refused, the database is read-only: "};
+        default:
+            return {ENGINE_STEP_ERROR, rc, "Step failed: "};
     }
-    if(rc==SQLITE_MISMATCH) {
-        reset(); 
-        throw DatatypeMismatchError("Datatype mismatch on column binding ", rc);
-    }
-    if(rc == SQLITE_ROW) {
-        return ENGINE_ROW;
+}
+void PreparedStatement::throwIfError(const Status& status) {
+    if(status.ok())
+        return;
+    std::string what = status.what;
+    switch(status.code) {
+        case ENGINE_BUSY:
+            throw BusyError(what + db_->getLastErrorMsg(), ENGINE_BUSY);
+        case ENGINE_CONSTRAINT:
+            throw ConstraintError(what, status.rc);
+        case ENGINE_MISUSE:
+            Logger::info("SQL: "+_sql);
+            throw std::runtime_error(what + db_->getLastErrorMsg());
+        case ENGINE_SYNTAX_ERROR:
+            throw SyntaxError(what + db_->getLastErrorMsg(), status.rc);
+        case ENGINE_MISMATCH:
+            throw DatatypeMismatchError(what, status.rc);
+        case ENGINE_RANGE:
+            throw BindRangeException(what, status.rc);
+        case ENGINE_NOMEM:
+            throw ResourceException(what, status.rc);
+        case ENGINE_STATE_ERROR:
+            throw StatementStateError(what, 1);
+        case ENGINE_ERROR:
+            throw std::runtime_error(what + db_->getLastErrorMsg());
+        default:
+            throw DatabaseException(what + db_->getLastErrorMsg(), status.rc);
     }
-    // handle other errors: BUSY etc
-    //TODO: replace with proper logging message
-    Logger::info("Statement executed");
-
-    return rc;
 }
 //reset a stmt
 void PreparedStatement::reset() {
@@ -446,6 +1013,8 @@ void PreparedStatement::reset() {
 void PreparedStatement::finalize() {
     if(!stmt) { return; }
     if(isCached) {
+        // a statement left mid-result would hold its read (or RETURNING write) transaction open
+        sqlite3_reset(stmt);
         db_->releaseCached(stmt);
         stmt = nullptr;
         Logger::info("Statement released");
@@ -459,91 +1028,166 @@ void PreparedStatement::finalize() {
 }
 //bindings:
 /*
-* TODO: imlpement exceptions for
 * Error codes:
 * SQLITE_OK: 0 Success // Return or proceed
 * SQLITE_RANGE: 25 Parameter index is out of range // BindRangeError
 * SQLITE_NOMEM: 7 Out of memory // Resource exception
 */
-//bind text  
-void PreparedStatement::bind(int index, const char* value) {
+Status PreparedStatement::bindable() {
     if(!stmt)
-        throw StatementStateError("Cannot call bind() on a finalized or uninitialized statement.", 1); 
+        return {ENGINE_STATE_ERROR, SQLITE_MISUSE, "Cannot call bind() on a finalized or uninitialized statement."};
     if(!isReset)
-        throw StatementStateError("Statement must be reset() before binding", 1);
-    int rc=sqlite3_bind_text(stmt, index, value, -1, SQLITE_TRANSIENT);
-    if(rc != SQLITE_OK) {
-        if(rc == SQLITE_RANGE)
-            throw BindRangeException("Parameter index is out of range " + std::to_string(index) + "(text)", rc);
-        if(rc == SQLITE_NOMEM)
-            throw ResourceException("Out of memory", rc);
-    }
+        return {ENGINE_STATE_ERROR, SQLITE_MISUSE, "Statement must be reset() before binding"};
+    return {};
+}
+Status PreparedStatement::bindResult(int rc, const char* type) {
+    if(rc == SQLITE_OK)
+        return {};
+    if(rc == SQLITE_RANGE)
+        return {ENGINE_RANGE, rc, type};
+    if(rc == SQLITE_NOMEM)
+        return {ENGINE_NOMEM, rc, "Out of memory"};
+    return {ENGINE_BIND_ERROR, rc, "Couldn't bind parameter: "};
+}
+//bind text  
+Status PreparedStatement::tryBind(int index, const char* value) {
+    Status status = bindable();
+    if(!status)
+        return status;
+    trackStatic(index, nullptr, 0);
+    return bindResult(sqlite3_bind_text(stmt, index, value, -1, SQLITE_TRANSIENT), "Parameter index is out of range (text)");
 }
 //bind text string
-void PreparedStatement::bind(int index, std::string value) {
-    if(!stmt)
-        throw StatementStateError("Cannot call bind() on a finalized or uninitialized statement.", 1);
-    if(!isReset)
-        throw StatementStateError("Statement must be reset() before binding", 1);
-    int rc=sqlite3_bind_text(stmt, index, value.c_str(), -1, SQLITE_TRANSIENT);
-    if(rc != SQLITE_OK) {
-        if(rc == SQLITE_RANGE)
-            throw BindRangeException("Parameter index is out of range " + std::to_string(index) + "(text)", rc);
-        if(rc == SQLITE_NOMEM)
-            throw ResourceException("Out of memory", rc);
-    }
+Status PreparedStatement::tryBind(int index, const std::string& value) {
+    return tryBind(index, std::string_view(value));
+}
+//bind text view, copied by SQLite
+Status PreparedStatement::tryBind(int index, std::string_view value) {
+    Status status = bindable();
+    if(!status)
+        return status;
+    trackStatic(index, nullptr, 0);
+    // a null pointer would bind NULL, an empty view is ''
+    return bindResult(sqlite3_bind_text(stmt, index, value.data() ? value.data() : "", static_cast<int>(value.size()), SQLITE_TRANSIENT),
+                      "Parameter index is out of range (text)");
+}
+//bind blob, copied by SQLite
+Status PreparedStatement::tryBind(int index, const void* data, int size) {
+    Status status = bindable();
+    if(!status)
+        return status;
+    trackStatic(index, nullptr, 0);
+    return bindResult(sqlite3_bind_blob(stmt, index, data ? data : "", size, SQLITE_TRANSIENT), "Parameter index is out of range (blob)");
+}
+//bind text without copying
+Status PreparedStatement::tryBindStatic(int index, std::string_view value) {
+    Status status = bindable();
+    if(!status)
+        return status;
+    const char* data = value.data() ? value.data() : "";
+    status = bindResult(sqlite3_bind_text(stmt, index, data, static_cast<int>(value.size()), SQLITE_STATIC),
+                        "Parameter index is out of range (text)");
+    if(status)
+        trackStatic(index, data, static_cast<int>(value.size()));
+    return status;
+}
+//bind blob without copying
+Status PreparedStatement::tryBindStatic(int index, const void* data, int size) {
+    Status status = bindable();
+    if(!status)
+        return status;
+    if(!data)
+        data = "";
+    status = bindResult(sqlite3_bind_blob(stmt, index, data, size, SQLITE_STATIC), "Parameter index is out of range (blob)");
+    if(status)
+        trackStatic(index, data, size);
+    return status;
 }
 //bind int
-void PreparedStatement::bind(int index, int value) {
-    if(!isReset)
-        throw StatementStateError("Statement must be reset() before binding", 1);
-    int rc=sqlite3_bind_int(stmt, index, value);
-    if(rc != SQLITE_OK) {
-        if(rc == SQLITE_RANGE)
-            throw BindRangeException("Parameter index is out of range " + std::to_string(index) + "(text)", rc);
-        if(rc == SQLITE_NOMEM)
-            throw ResourceException("Out of memory", rc);
-    }
+Status PreparedStatement::tryBind(int index, int value) {
+    Status status = bindable();
+    if(!status)
+        return status;
+    trackStatic(index, nullptr, 0);
+    return bindResult(sqlite3_bind_int(stmt, index, value), "Parameter index is out of range (int)");
+}
+//bind int64
+Status PreparedStatement::tryBind(int index, long long value) {
+    Status status = bindable();
+    if(!status)
+        return status;
+    trackStatic(index, nullptr, 0);
+    return bindResult(sqlite3_bind_int64(stmt, index, value), "Parameter index is out of range (int64)");
 }
 //bind double
-void PreparedStatement::bind(int index, double value) {
-    if(!isReset)
-        throw StatementStateError("Statement must be reset() before binding", 1);
-
-    int rc=sqlite3_bind_double(stmt, index, value);
-    if(rc != SQLITE_OK) {
-        if(rc == SQLITE_RANGE)
-            throw BindRangeException("Parameter index is out of range " + std::to_string(index) + "(text)", rc);
-        if(rc == SQLITE_NOMEM)
-            throw ResourceException("Out of memory", rc);
-    }
+Status PreparedStatement::tryBind(int index, double value) {
+    Status status = bindable();
+    if(!status)
+        return status;
+    trackStatic(index, nullptr, 0);
+    return bindResult(sqlite3_bind_double(stmt, index, value), "Parameter index is out of range (double)");
 }
 //bind null
-void PreparedStatement::bind(int index) {
-    if(!isReset)
-        throw StatementStateError("Statement must be reset() before binding", 1);
-
-    int rc=sqlite3_bind_null(stmt, index);
-    if(rc != SQLITE_OK) {
-        if(rc == SQLITE_RANGE)
-            throw BindRangeException("Parameter index is out of range " + std::to_string(index) + "(text)", rc);
-        if(rc == SQLITE_NOMEM)
-            throw ResourceException("Out of memory", rc);
-    }
+Status PreparedStatement::tryBind(int index) {
+    Status status = bindable();
+    if(!status)
+        return status;
+    trackStatic(index, nullptr, 0);
+    return bindResult(sqlite3_bind_null(stmt, index), "Parameter index is out of range (null)");
 }
 //bind bool
-void PreparedStatement::bind(int index, bool value) {
-    if(!isReset)
-        throw StatementStateError("Statement must be reset() before binding", 1);
-
-    int rc=sqlite3_bind_int(stmt, index, value ? 1:0);
-    if(rc != SQLITE_OK) {
-        if(rc == SQLITE_RANGE)
-            throw BindRangeException("Parameter index is out of range " + std::to_string(index) + "(text)", rc);
-        if(rc == SQLITE_NOMEM)
-            throw ResourceException("Out of memory", rc);
+Status PreparedStatement::tryBind(int index, bool value) {
+    Status status = bindable();
+    if(!status)
+        return status;
+    trackStatic(index, nullptr, 0);
+    return bindResult(sqlite3_bind_int(stmt, index, value ? 1:0), "Parameter index is out of range (bool)");
+}
+// throwing binds
+void PreparedStatement::bind(int index, const char* value) { throwIfError(tryBind(index, value)); }
+void PreparedStatement::bind(int index, const std::string& value) { throwIfError(tryBind(index, value)); }
+void PreparedStatement::bind(int index, std::string_view value) { throwIfError(tryBind(index, value)); }
+void PreparedStatement::bind(int index, const void* data, int size) { throwIfError(tryBind(index, data, size)); }
+void PreparedStatement::bindStatic(int index, std::string_view value) { throwIfError(tryBindStatic(index, value)); }
+void PreparedStatement::bindStatic(int index, const void* data, int size) { throwIfError(tryBindStatic(index, data, size)); }
+void PreparedStatement::bind(int index, int value) { throwIfError(tryBind(index, value)); }
+void PreparedStatement::bind(int index, long long value) { throwIfError(tryBind(index, value)); }
+void PreparedStatement::bind(int index, double value) { throwIfError(tryBind(index, value)); }
+void PreparedStatement::bind(int index) { throwIfError(tryBind(index)); }
+void PreparedStatement::bind(int index, bool value) { throwIfError(tryBind(index, value)); }
+#ifndef NDEBUG
+static unsigned long long checksum(const void* data, int size) {
+    // FNV-1a
+    unsigned long long h = 1469598103934665603ULL;
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for(int i = 0; i < size; i++)
+        h = (h ^ p[i]) * 1099511628211ULL;
+    return h;
+}
+// remembers a static buffer, or forgets the index when it was rebound by copy (data == nullptr)
+void PreparedStatement::trackStatic(int index, const void* data, int size) {
+    for(size_t i = 0; i < staticBindings.size(); i++) {
+        if(staticBindings[i].index == index) {
+            staticBindings.erase(staticBindings.begin() + static_cast<long>(i));
+            break;
+        }
+    }
+    if(data)
+        staticBindings.push_back({index, data, size, checksum(data, size)});
+}
+bool PreparedStatement::verifyStatic() {
+    for(const StaticBinding& b : staticBindings) {
+        if(checksum(b.data, b.size) != b.checksum) {
+            Logger::error("Buffer bound with bindStatic() to parameter " + std::to_string(b.index) + " changed before step()");
+            return false;
+        }
     }
+    return true;
 }
+#else
+void PreparedStatement::trackStatic(int, const void*, int) {}
+bool PreparedStatement::verifyStatic() { return true; }
+#endif
 // get column count
 int PreparedStatement::columnCount() {
     return sqlite3_column_count(stmt);
@@ -1,6 +1,7 @@
 #ifndef DB_H
 #define DB_H
 #include <string>
+#include <string_view>
 #include <vector>
 #include <sqlite3.h>
 #include <mutex>
@@ -12,6 +13,11 @@
 #include <memory>
 #include <unordered_map>
 #include <list>
+#include <functional>
+#include <future>
+#include <chrono>
+#include <atomic>
+#include <condition_variable>
 
 namespace Engine {
 
@@ -20,25 +26,54 @@ class Transactions;
 class PreparedStatement;
 class LRUCache;
 
-static DBEngine* Init(const std::string& path, bool debug=false, size_t cache_capacity=16);
-
-enum ENGINE_CODES {
-    ENGINE_OK,
-    ENGINE_ERROR,
-    ENGINE_CONNECTION_ERROR,
-    ENGINE_ROLLBACK_FAILURE,
-    ENGINE_COMMIT_FAILURE,
-    ENGINE_SYNTAX_ERROR,
-    ENGINE_STEP_ERROR,
-    ENGINE_BIND_ERROR,
-    ENGINE_ROW,
-    ENGINE_FINALIZE_ERROR,
-    ENGINE_BUSY,
-    ENGINE_CACHE_OK,
-    ENGINE_CACHE_BUSY,
-    ENGINE_CACHE_NOT_FOUND
+/*
+ * What to do when another connection holds the lock. SQLite first waits up to busy_timeout
+ * in its own handler; when that still ends in SQLITE_BUSY the engine retries BEGIN, COMMIT
+ * and autocommit statements with exponential backoff and jitter: the n-th wait is random in
+ * [d/2, d] with d = min(initialBackoffMs * 2^n, maxBackoffMs). After maxRetries it throws BusyError.
+ */
+struct BusyPolicy {
+    int maxRetries = 8;
+    int initialBackoffMs = 5;
+    int maxBackoffMs = 500;
+};
+
+struct BusyStats {
+    unsigned long long retries = 0;         // backoff waits taken
+    unsigned long long waitedMicros = 0;    // time spent in them
+    unsigned long long failures = 0;        // operations that gave up with BusyError
+};
+
+/*
+ * Connection settings applied right after sqlite3_open. The defaults are the "interactive" preset.
+ * Text values take the PRAGMA spellings. pageSize and autoVacuum only affect a database that has no
+ * tables yet (an existing file changes auto_vacuum with a full VACUUM).
+ * After applying, the engine reads every value back, see DBEngine::config().
+ */
+struct DBConfig {
+    std::string journalMode = "WAL";        // DELETE, TRUNCATE, PERSIST, MEMORY, WAL, OFF
+    std::string synchronous = "NORMAL";     // OFF, NORMAL, FULL, EXTRA
+    int cacheSize = -16000;                 // pages, or KiB when negative
+    long long mmapSize = 64LL << 20;        // bytes, 0 disables memory mapped I/O
+    std::string tempStore = "MEMORY";       // DEFAULT, FILE, MEMORY
+    int pageSize = 4096;
+    std::string autoVacuum = "INCREMENTAL"; // NONE, FULL, INCREMENTAL. Free pages are returned by PRAGMA incremental_vacuum
+    int busyTimeout = 5000;                 // milliseconds
+    bool foreignKeys = true;
+    BusyPolicy busy;
+
+    // Low latency for the GUI and small writes
+    static DBConfig interactive();
+    // Large imports: no fsync, big cache. A crash can lose the last transactions, not corrupt the file
+    static DBConfig bulkLoad();
+    // Mostly readers, e.g. reporting: large cache and memory map
+    static DBConfig readMostly();
+    // "interactive", "bulk-load" or "read-mostly". Throws ConfigError for anything else
+    static DBConfig preset(const std::string& name);
 };
 
+static DBEngine* Init(const std::string& path, bool debug=false, size_t cache_capacity=16, const DBConfig& config=DBConfig());
+
 enum CACHE_RESULT {
     CACHE_OK,   // cache added or cache retrieved success
     CACHE_BUSY, // cache present but in use
@@ -147,15 +182,62 @@ inline bool Row::get<bool>(int col) const {
     return getInt(col)!=0;
 }
 
+/*
+ * Change data capture
+ * Row level changes reported by sqlite3_update_hook are buffered per transaction
+ * and delivered to subscribers as one batch after the transaction commits.
+ * A rolled back transaction delivers nothing.
+ * WITHOUT ROWID tables and internal tables (sqlite_sequence, FTS shadow tables)
+ * are reported as sqlite3_update_hook reports them, i.e. not at all for the former.
+ */
+enum class ChangeType {
+    INSERTED,
+    UPDATED,
+    DELETED
+};
+
+struct RowChange {
+    ChangeType type;
+    std::string table;
+    sqlite3_int64 rowid;
+};
+
+using ChangeBatch = std::vector<RowChange>;
+using ChangeCallback = std::function<void(const ChangeBatch&)>;
+
+// Online backup progress, in pages
+struct BackupProgress {
+    int remaining;
+    int total;
+};
+using BackupCallback = std::function<void(const BackupProgress&)>;
+
+/*
+ * How a transaction takes its locks.
+ * DEFERRED waits until the first write, which can then fail with SQLITE_BUSY when another
+ * connection writes meanwhile; only safe for transactions that may not write at all.
+ * IMMEDIATE takes the write lock at BEGIN, where a busy lock can be waited for. The default.
+ * EXCLUSIVE also keeps readers out, outside WAL mode.
+ * READ_ONLY_SNAPSHOT reads one consistent state of the database however many queries run,
+ * writes fail (PRAGMA query_only). In WAL mode writers are not blocked meanwhile.
+ */
+enum class TransactionMode {
+    DEFERRED,
+    IMMEDIATE,
+    EXCLUSIVE,
+    READ_ONLY_SNAPSHOT
+};
+
 // Database
 class DBEngine {
     public:
         
-        DBEngine(const std::string& dbPath, bool debug=false, size_t cacheSize=16);   
+        // Throws ConfigError when config holds a value SQLite does not know
+        DBEngine(const std::string& dbPath, bool debug=false, size_t cacheSize=16, const DBConfig& config=DBConfig());   
         ~DBEngine();                                            
 
         // Begins a new transaction. allows only one active transaction per db instance
-        int begin();
+        int begin(TransactionMode mode=TransactionMode::IMMEDIATE);
 
         // Commits the current transaction
         int commit();
@@ -165,6 +247,18 @@ class DBEngine {
 
         // Returns true if transaction active
         bool isActive() const { return active; }
+        // Returns true inside a READ_ONLY_SNAPSHOT transaction
+        bool isReadOnly() const { return readOnly; }
+
+        // Savepoints nest inside the open transaction, last opened first closed.
+        // savepoint() returns the generated name. Throws TransactionError without a transaction
+        std::string savepoint();
+        // Keeps the savepoint's changes as part of the enclosing transaction
+        void release(const std::string& name);
+        // Undoes everything since the savepoint was opened and closes it
+        void rollbackTo(const std::string& name);
+        // Open savepoints
+        size_t depth() const { return savepoints.size(); }
         
         // Execute an arbitary SQL statement
         int execute(const std::string& sql, const std::string& msg); 
@@ -178,7 +272,34 @@ class DBEngine {
         int releaseCached(sqlite3_stmt* stmt);
 
         sqlite3* get();
+
+        // Settings in effect after open, as read back from SQLite
+        const DBConfig& config() const { return effective; }
+
+        // Sleeps before retry number attempt (from 0) of an operation that got SQLITE_BUSY.
+        // Returns false, counting a failure, once the policy allows no more retries
+        bool backoff(int attempt);
+        BusyStats busyStats() const;
         
+        // Subscribe to committed changes, returns an id for unsubscribe()
+        int subscribe(ChangeCallback callback);
+        void unsubscribe(int id);
+        // Delivers batches committed since the last call. The engine calls this after every
+        // commit, subscribers are free to query or write from their callback.
+        void dispatchChanges();
+        // Changes captured so far in the open transaction. A statement that fails is undone by
+        // SQLite but its rows already went through the update hook, dropChangesSince(mark) forgets them
+        size_t changeMark() const { return pendingChanges.size(); }
+        void dropChangesSince(size_t mark);
+
+        // Copies the database to path on a background thread while it stays in use.
+        // Each step copies pagesPerStep pages and holds the database only for that step,
+        // writers get their turn during the pause between steps. Writes made meanwhile
+        // through this engine end up in the copy. The future throws BackupError on failure.
+        // The destructor cancels running backups and waits for them.
+        std::future<void> backup(const std::string& path, int pagesPerStep=256,
+                                 std::chrono::milliseconds pause=std::chrono::milliseconds(5),
+                                 BackupCallback progress=nullptr);
         
         DBEngine(const DBEngine&) = delete;
         DBEngine& operator=(const DBEngine&) = delete;
@@ -186,17 +307,51 @@ class DBEngine {
         DBEngine& operator=(DBEngine&&) = default;
 
     private:
+        void configure(const DBConfig& config, bool inMemory);
+        void endReadOnly();
+        int execStatements(const char*& next, std::string& errMsg);
         sqlite3* db = nullptr;
+        DBConfig effective;
+        std::atomic<unsigned long long> busyRetries{0};
+        std::atomic<unsigned long long> busyWaitedMicros{0};
+        std::atomic<unsigned long long> busyFailures{0};
         bool active = false;                            // track active transactions
+        bool readOnly = false;                          // query_only is on for the open transaction
+        struct SavepointMark {
+            std::string name;
+            size_t changes;                             // pendingChanges.size() when opened
+        };
+        std::vector<SavepointMark> savepoints;
+        unsigned long long nextSavepoint = 0;
         std::mutex mtx;
         size_t cacheSize;
         LRUCache* stmtCache;
+
+        // change data capture
+        static void onUpdate(void* self, int op, const char* dbName, const char* table, sqlite3_int64 rowid);
+        static int onCommit(void* self);
+        static void onRollback(void* self);
+        ChangeBatch pendingChanges;                     // changes of the open transaction
+        std::vector<ChangeBatch> committedChanges;      // committed, not yet delivered
+        std::vector<std::pair<int, ChangeCallback>> subscribers;
+        int nextSubscriberId = 1;
+        bool dispatching = false;
+
+        // online backup
+        void runBackup(const std::string& path, int pagesPerStep, std::chrono::milliseconds pause, const BackupCallback& progress);
+        std::mutex backupMtx;
+        std::condition_variable backupDone;
+        int activeBackups = 0;
+        std::atomic<bool> closing{false};
 };
 
 
 /* 
  * If the 'Transaction' is destroyed without 'commit()', changes are automatically rolled back
  * Transaction class is the recommended way to manage transactions, you can still use DBEngine.begin()
+ * Transactions nest: one created while another is open becomes a savepoint of it, its commit()
+ * only releases the savepoint and its rollback leaves the outer transaction's work intact.
+ * Nothing reaches the disk before the outermost commit().
  */
 enum class TransactionState {
     NONE,
@@ -208,7 +363,8 @@ enum class TransactionState {
 
 class Transaction {
     public:
-        explicit Transaction(DBEngine* dbEngine);
+        // mode only applies to an outermost transaction, a nested one is a savepoint of its parent
+        explicit Transaction(DBEngine* dbEngine, TransactionMode mode=TransactionMode::IMMEDIATE);
         ~Transaction();
         int getTransactionState();
         void commit();
@@ -216,12 +372,36 @@ class Transaction {
         DBEngine* db;
         bool committed = false;
         int state;
+        std::string savepoint;      // set when nested
+};
+
+/*
+ * Partial rollback point inside the open transaction. release() keeps the changes made since
+ * it was created, destroying it without release() undoes just those changes.
+ * Throws TransactionError when no transaction is open.
+ */
+class Savepoint {
+    public:
+        explicit Savepoint(DBEngine* dbEngine);
+        ~Savepoint();
+        void release();
+        // Undo now instead of at destruction
+        void rollback();
+
+        Savepoint(const Savepoint&) = delete;
+        Savepoint& operator=(const Savepoint&) = delete;
+    private:
+        DBEngine* db;
+        std::string name;
+        bool done = false;
 };
 
 // Prepared statements
 class PreparedStatement {
     public:
         PreparedStatement(DBEngine* db, const std::string& sql);
+        PreparedStatement(PreparedStatement&& other) noexcept;
+        PreparedStatement& operator=(PreparedStatement&&) = delete;
         ~PreparedStatement();
         //bind int
         void bind(int index, int value);
@@ -234,14 +414,47 @@ class PreparedStatement {
         //bind text
         void bind(int index, const char* value);
         //bind text string
-        void bind(int index, std::string value);
+        void bind(int index, const std::string& value);
+        //bind text view
+        void bind(int index, std::string_view value);
         //bind blob
         void bind(int index, const void*data, int size);
         //bind bool
         void bind(int index, bool value);
+        /*
+         * Static binds: SQLite keeps the pointer instead of copying (SQLITE_STATIC), the caller
+         * must keep the buffer alive and unchanged until the parameter is rebound or the
+         * statement is reset for the last time. Debug builds checksum each buffer at bind and
+         * throw StatementStateError from step() when it changed.
+         */
+        void bindStatic(int index, std::string_view value);
+        void bindStatic(int index, const void* data, int size);
         int step();
         void reset();
         void finalize();
+
+        /*
+         * Non-throwing API for hot loops that expect failures (duplicate rows in a bulk insert).
+         * Same checks as the throwing calls, which are wrappers over these, but errors come back
+         * as a Status: ENGINE_CONSTRAINT, ENGINE_MISMATCH, ENGINE_MISUSE, ENGINE_BUSY,
+         * ENGINE_SYNTAX_ERROR, ENGINE_RANGE, ENGINE_NOMEM, ENGINE_STATE_ERROR, and ENGINE_STEP_ERROR
+         * for any other SQLite error. A failed step has already reset the statement.
+         */
+        static Expected<PreparedStatement> tryPrepare(DBEngine* db, const std::string& sql);
+        Status tryStep();
+        Status tryBind(int index, int value);
+        Status tryBind(int index, long long value);
+        Status tryBind(int index, double value);
+        Status tryBind(int index);
+        Status tryBind(int index, const char* value);
+        Status tryBind(int index, const std::string& value);
+        Status tryBind(int index, std::string_view value);
+        Status tryBind(int index, const void* data, int size);
+        Status tryBind(int index, bool value);
+        Status tryBindStatic(int index, std::string_view value);
+        Status tryBindStatic(int index, const void* data, int size);
+        // Throws the exception the throwing API raises for status, does nothing when it is ok
+        void throwIfError(const Status& status);
         
         bool isFinalized();
         bool isPrepared();
@@ -257,14 +470,32 @@ class PreparedStatement {
         sqlite3_stmt* get();
 
     private:
+        struct Unprepared {};
+        PreparedStatement(DBEngine* db, const std::string& sql, Unprepared);
+        Status open();
+        Status bindable();
+        Status bindResult(int rc, const char* type);
+
         DBEngine* db_;
-        sqlite3_stmt* stmt;
+        sqlite3_stmt* stmt = nullptr;
         bool finalized = false;
-        bool prepared;
-        bool isCached;
+        bool prepared = false;
+        bool isCached = false;
         //TODO: Implement states
         bool isReset=true;
+        size_t changeMark = 0;      // db_->changeMark() when the current run started
         std::string _sql;
+#ifndef NDEBUG
+        struct StaticBinding {
+            int index;
+            const void* data;
+            int size;
+            unsigned long long checksum;
+        };
+        std::vector<StaticBinding> staticBindings;
+#endif
+        void trackStatic(int index, const void* data, int size);
+        bool verifyStatic();
 };
 
 } // namespace Engine
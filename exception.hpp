@@ -50,5 +50,17 @@ namespace Engine {
     class DatatypeMismatchError : public DatabaseException {
         using DatabaseException::DatabaseException;
     };
+    // Thrown when the database stayed locked by another connection through every retry
+    class BusyError : public DatabaseException {
+        using DatabaseException::DatabaseException;
+    };
+    // Thrown when a DBConfig value is invalid
+    class ConfigError : public DatabaseException {
+        using DatabaseException::DatabaseException;
+    };
+    // Thrown when an online backup can't open its target, fails or is cancelled
+    class BackupError : public DatabaseException {
+        using DatabaseException::DatabaseException;
+    };
 
 }
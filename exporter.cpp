@@ -0,0 +1,232 @@
+#include "exporter.hpp"
+#include "logger.hpp"
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+using namespace Engine;
+
+namespace App {
+
+    namespace {
+
+        // Fixed size output buffer, written to the stream only when full
+        class OutputBuffer {
+            public:
+                OutputBuffer(std::ostream& out, size_t capacity)
+                    : out(out), buf(capacity < 4096 ? 4096 : capacity) {}
+                ~OutputBuffer() { flush(); }
+
+                void put(char c) {
+                    if(used == buf.size())
+                        flush();
+                    buf[used++] = c;
+                }
+                void append(const char* p, size_t n) {
+                    if(n > buf.size() - used) {
+                        flush();
+                        if(n > buf.size()) {
+                            out.write(p, static_cast<std::streamsize>(n));
+                            return;
+                        }
+                    }
+                    std::memcpy(buf.data() + used, p, n);
+                    used += n;
+                }
+                void append(const char* s) { append(s, std::strlen(s)); }
+                void flush() {
+                    if(used) {
+                        out.write(buf.data(), static_cast<std::streamsize>(used));
+                        used = 0;
+                    }
+                }
+
+            private:
+                std::ostream& out;
+                std::vector<char> buf;
+                size_t used = 0;
+        };
+
+    }
+
+    static const char* exportQuery(ExportKind kind, bool byEvent) {
+        switch(kind) {
+            case ExportKind::RECIPIENTS:
+                return "SELECT ID AS id, Name AS name, Relationship AS relationship FROM RECIPIENTS WHERE UserID = ? AND DeletedAt IS NULL ORDER BY ID;";
+            case ExportKind::EVENTS:
+                return "SELECT ID AS id, Name AS name, Date AS date FROM EVENTS WHERE UserID = ? AND DeletedAt IS NULL ORDER BY ID;";
+            default:
+                break;
+        }
+        // status as a name so exports stay readable and CsvImporter accepts them. Every query
+        // takes the user first
+        if(byEvent)
+            return R"(
+            SELECT g.ID AS id, r.Name AS recipient, e.Name AS event, e.Date AS event_date, g.Name AS name,
+                   g.Link AS link, CAST(g.Budget AS REAL) AS budget, CAST(g.Price AS REAL) AS price,
+                   CASE g.Status WHEN 1 THEN 'ordered' WHEN 2 THEN 'purchased' WHEN 3 THEN 'cancelled' ELSE 'idea' END AS status,
+                   g.Date AS date
+            FROM GIFTS g
+            JOIN RECIPIENTS r ON r.ID = g.RecipientID
+            JOIN EVENTS e ON e.ID = g.EventID
+            WHERE g.UserID = ? AND g.EventID = ? AND g.DeletedAt IS NULL
+            ORDER BY g.ID;
+            )";
+        return R"(
+            SELECT g.ID AS id, r.Name AS recipient, e.Name AS event, e.Date AS event_date, g.Name AS name,
+                   g.Link AS link, CAST(g.Budget AS REAL) AS budget, CAST(g.Price AS REAL) AS price,
+                   CASE g.Status WHEN 1 THEN 'ordered' WHEN 2 THEN 'purchased' WHEN 3 THEN 'cancelled' ELSE 'idea' END AS status,
+                   g.Date AS date
+            FROM GIFTS g
+            JOIN RECIPIENTS r ON r.ID = g.RecipientID
+            JOIN EVENTS e ON e.ID = g.EventID
+            WHERE g.UserID = ? AND g.DeletedAt IS NULL
+            ORDER BY g.ID;
+            )";
+    }
+
+    static void writeCsvText(OutputBuffer& out, const char* p, size_t n) {
+        bool quote = false;
+        for(size_t i = 0; i < n && !quote; i++)
+            quote = p[i] == ',' || p[i] == '"' || p[i] == '\n' || p[i] == '\r';
+        if(!quote) {
+            out.append(p, n);
+            return;
+        }
+        out.put('"');
+        const char* run = p;
+        for(const char* c = p; c < p + n; c++) {
+            if(*c == '"') {
+                out.append(run, static_cast<size_t>(c - run + 1));
+                out.put('"');
+                run = c + 1;
+            }
+        }
+        out.append(run, static_cast<size_t>(p + n - run));
+        out.put('"');
+    }
+
+    static void writeJsonText(OutputBuffer& out, const char* p, size_t n) {
+        static const char hex[] = "0123456789abcdef";
+        out.put('"');
+        const char* run = p;
+        for(const char* c = p; c < p + n; c++) {
+            unsigned char ch = static_cast<unsigned char>(*c);
+            if(ch >= 0x20 && ch != '"' && ch != '\\')
+                continue;
+            out.append(run, static_cast<size_t>(c - run));
+            run = c + 1;
+            switch(ch) {
+                case '"': out.append("\\\"", 2); break;
+                case '\\': out.append("\\\\", 2); break;
+                case '\n': out.append("\\n", 2); break;
+                case '\r': out.append("\\r", 2); break;
+                case '\t': out.append("\\t", 2); break;
+                default: {
+                    char esc[6] = {'\\', 'u', '0', '0', hex[ch >> 4], hex[ch & 0xF]};
+                    out.append(esc, sizeof(esc));
+                }
+            }
+        }
+        out.append(run, static_cast<size_t>(p + n - run));
+        out.put('"');
+    }
+
+    // Writes a numeric column, returns false for text, blob and null
+    static bool writeNumber(OutputBuffer& out, sqlite3_stmt* stmt, int col) {
+        char num[32];
+        switch(sqlite3_column_type(stmt, col)) {
+            case SQLITE_INTEGER: {
+                std::to_chars_result r = std::to_chars(num, num + sizeof(num), sqlite3_column_int64(stmt, col));
+                out.append(num, static_cast<size_t>(r.ptr - num));
+                return true;
+            }
+            case SQLITE_FLOAT: {
+                int n = std::snprintf(num, sizeof(num), "%.15g", sqlite3_column_double(stmt, col));
+                out.append(num, static_cast<size_t>(n));
+                return true;
+            }
+            default:
+                return false;
+        }
+    }
+
+    /*
+     * Class: Exporter
+     */
+    Exporter::Exporter(GiftPlanner& planner, size_t bufferSize)
+        : planner(planner), bufferSize(bufferSize) {}
+
+    size_t Exporter::exportTo(std::ostream& out, ExportKind kind, ExportFormat format, int eventId) {
+        bool byEvent = kind == ExportKind::GIFTS && eventId >= 0;
+        PreparedStatement stmt(planner.engine(), exportQuery(kind, byEvent));
+        stmt.bind(1, planner.currentUser());
+        if(byEvent)
+            stmt.bind(2, eventId);
+        sqlite3_stmt* s = stmt.get();
+        int columns = sqlite3_column_count(s);
+        OutputBuffer buf(out, bufferSize);
+
+        // column names are escaped once, not per row
+        std::vector<std::string> keys(columns);
+        for(int c = 0; c < columns; c++) {
+            const char* name = sqlite3_column_name(s, c);
+            keys[c] = (format == ExportFormat::NDJSON ? (c ? ",\"" : "{\"") : (c ? "," : "")) + std::string(name);
+            if(format == ExportFormat::NDJSON)
+                keys[c] += "\":";
+        }
+        if(format == ExportFormat::CSV) {
+            for(const std::string& key : keys)
+                buf.append(key.data(), key.size());
+            buf.put('\n');
+        }
+
+        size_t rows = 0;
+        while(stmt.step() == ENGINE_ROW) {
+            for(int c = 0; c < columns; c++) {
+                if(format == ExportFormat::CSV) {
+                    if(c)
+                        buf.put(',');
+                    if(writeNumber(buf, s, c) || sqlite3_column_type(s, c) == SQLITE_NULL)
+                        continue;
+                    const char* text = reinterpret_cast<const char*>(sqlite3_column_text(s, c));
+                    writeCsvText(buf, text, static_cast<size_t>(sqlite3_column_bytes(s, c)));
+                }
+                else {
+                    buf.append(keys[c].data(), keys[c].size());
+                    if(writeNumber(buf, s, c))
+                        continue;
+                    if(sqlite3_column_type(s, c) == SQLITE_NULL) {
+                        buf.append("null", 4);
+                        continue;
+                    }
+                    const char* text = reinterpret_cast<const char*>(sqlite3_column_text(s, c));
+                    writeJsonText(buf, text, static_cast<size_t>(sqlite3_column_bytes(s, c)));
+                }
+            }
+            if(format == ExportFormat::NDJSON)
+                buf.put('}');
+            buf.put('\n');
+            rows++;
+        }
+        buf.flush();
+        out.flush();
+        Logger::info("[Export]: " + std::to_string(rows) + " rows");
+        return rows;
+    }
+
+    size_t Exporter::exportFile(const std::string& path, ExportKind kind, ExportFormat format, int eventId) {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if(!file)
+            throw std::runtime_error("Couldn't open " + path);
+        size_t rows = exportTo(file, kind, format, eventId);
+        if(!file)
+            throw std::runtime_error("Couldn't write " + path);
+        return rows;
+    }
+    // end of Class: Exporter
+
+}
@@ -0,0 +1,43 @@
+#ifndef EXPORTER_H
+#define EXPORTER_H
+#include "app.hpp"
+#include <ostream>
+#include <string>
+
+namespace App {
+
+    enum class ExportKind {
+        RECIPIENTS,     // id, name, relationship
+        EVENTS,         // id, name, date
+        GIFTS           // id, recipient, event, event_date, name, link, budget, price, status, date
+    };
+
+    enum class ExportFormat {
+        CSV,            // header line, RFC 4180 quoting
+        NDJSON          // one JSON object per line, keys are the CSV column names
+    };
+
+    /*
+     * Streaming exporter.
+     *
+     * Rows go from sqlite3_step straight into one output buffer that is flushed when full, values
+     * are read as raw column text and escaped in place. Nothing is allocated per row, so memory use
+     * does not depend on the size of the database.
+     * The gifts columns match what CsvImporter reads, an export can be imported into another database.
+     */
+    class Exporter {
+        public:
+            explicit Exporter(GiftPlanner& planner, size_t bufferSize=1 << 20);
+            // Writes every row of kind, gifts can be limited to one event. Returns the number of rows
+            size_t exportTo(std::ostream& out, ExportKind kind, ExportFormat format, int eventId=-1);
+            // Throws std::runtime_error if the file can't be written
+            size_t exportFile(const std::string& path, ExportKind kind, ExportFormat format, int eventId=-1);
+
+        private:
+            GiftPlanner& planner;
+            size_t bufferSize;
+    };
+
+}
+
+#endif
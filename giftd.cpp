@@ -0,0 +1,70 @@
+#include <iostream>
+#include <csignal>
+#include <app.hpp>
+#include "server.hpp"
+#include "backup.hpp"
+#include "compactor.hpp"
+#include <memory>
+#include "logger.hpp"
+
+/*
+ * giftd: owns the gift database and serves it to local clients (GUI, scripts, reminders)
+ * over a Unix domain socket. See rpc.hpp for the protocol.
+ *
+ * Usage: giftd <database> [socket] [snapshot-dir]
+ * With a snapshot directory the database is backed up online every hour, the last 24 are kept.
+ * Maintenance (statistics, WAL checkpoints, integrity checks, removing deleted rows) runs in
+ * the background, see MaintenanceScheduler.
+ */
+
+static Rpc::Server* server = nullptr;
+
+static void onSignal(int) {
+    if(server)
+        server->stop();
+}
+
+int main(int argc, char** argv) {
+    if(argc < 2) {
+        std::cerr << "Usage: giftd <database> [socket] [snapshot-dir]\n";
+        return 2;
+    }
+    Logger::enabled = false;
+
+    App::GiftPlanner planner;
+    try {
+        planner.init(argv[1]);
+        planner.initialize_tables();
+
+        std::unique_ptr<Engine::BackupScheduler> snapshots;
+        if(argc > 3) {
+            snapshots = std::make_unique<Engine::BackupScheduler>(planner.engine(), argv[3], std::chrono::hours(1), 24, "giftd");
+            snapshots->start();
+        }
+        App::Compactor compactor;
+        Engine::MaintenanceScheduler maintenance(planner.engine());
+        maintenance.addDefaults();
+        compactor.schedule(maintenance);
+        maintenance.start();
+
+        Rpc::Server rpc(planner, argc > 2 ? argv[2] : Rpc::DEFAULT_SOCKET);
+        rpc.listen();
+        server = &rpc;
+        std::signal(SIGINT, onSignal);
+        std::signal(SIGTERM, onSignal);
+        rpc.run();
+        server = nullptr;
+        maintenance.stop();
+        if(snapshots)
+            snapshots->stop();
+
+        Rpc::Server::Stats stats = rpc.getStats();
+        std::cerr << "giftd: served " << stats.requests << " requests from " << stats.connections
+                  << " connections in " << stats.batches << " write batches\n";
+    }
+    catch(const std::exception& e) {
+        std::cerr << "giftd: " << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,543 @@
+#include "importer.hpp"
+#include "logger.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace Engine;
+
+namespace App {
+
+    namespace {
+
+        // Read-only memory mapping of a whole file
+        class MappedFile {
+            public:
+                explicit MappedFile(const std::string& path) {
+#ifdef _WIN32
+                    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+                    if(file == INVALID_HANDLE_VALUE)
+                        throw std::runtime_error("Couldn't open " + path);
+                    LARGE_INTEGER len;
+                    GetFileSizeEx(file, &len);
+                    length = static_cast<size_t>(len.QuadPart);
+                    if(length == 0)
+                        return;
+                    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                    if(mapping)
+                        bytes = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+                    fd = ::open(path.c_str(), O_RDONLY);
+                    if(fd < 0)
+                        throw std::runtime_error("Couldn't open " + path);
+                    struct stat st;
+                    fstat(fd, &st);
+                    length = static_cast<size_t>(st.st_size);
+                    if(length == 0)
+                        return;
+                    void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+                    if(p != MAP_FAILED) {
+                        bytes = static_cast<const char*>(p);
+                        madvise(p, length, MADV_SEQUENTIAL);
+                    }
+#endif
+                    if(!bytes)
+                        throw std::runtime_error("Couldn't map " + path);
+                }
+                ~MappedFile() {
+#ifdef _WIN32
+                    if(bytes) UnmapViewOfFile(bytes);
+                    if(mapping) CloseHandle(mapping);
+                    if(file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+                    if(bytes) munmap(const_cast<char*>(bytes), length);
+                    if(fd >= 0) ::close(fd);
+#endif
+                }
+                const char* data() const { return bytes; }
+                size_t size() const { return length; }
+
+                MappedFile(const MappedFile&) = delete;
+                MappedFile& operator=(const MappedFile&) = delete;
+            private:
+                const char* bytes = nullptr;
+                size_t length = 0;
+#ifdef _WIN32
+                HANDLE file = INVALID_HANDLE_VALUE;
+                HANDLE mapping = nullptr;
+#else
+                int fd = -1;
+#endif
+        };
+
+        struct CsvField {
+            const char* data;
+            size_t size;
+            std::string str() const { return std::string(data, size); }
+            std::string_view view() const { return std::string_view(data, size); }
+        };
+
+        // Records of one chunk as flat arrays, fields point into the mapping
+        struct ParsedChunk {
+            std::vector<CsvField> fields;
+            std::vector<size_t> rows;               // index of each record's first field
+            std::deque<std::string> unescaped;      // storage for fields that contained ""
+        };
+
+    }
+
+    // Finds the first newline at or after p that is not inside quotes. inQuote is the state at p
+    static const char* nextRecordEnd(const char* p, const char* end, bool inQuote) {
+        for(; p < end; ++p) {
+            if(*p == '"')
+                inQuote = !inQuote;
+            else if(*p == '\n' && !inQuote)
+                return p;
+        }
+        return end;
+    }
+
+    static ParsedChunk parseChunk(const char* p, const char* end) {
+        ParsedChunk chunk;
+        while(p < end) {
+            chunk.rows.push_back(chunk.fields.size());
+            while(true) {
+                CsvField field;
+                if(p < end && *p == '"') {
+                    const char* start = ++p;
+                    bool escaped = false;
+                    while(p < end) {
+                        if(*p == '"') {
+                            if(p + 1 < end && p[1] == '"') {
+                                escaped = true;
+                                p += 2;
+                                continue;
+                            }
+                            break;
+                        }
+                        ++p;
+                    }
+                    field = CsvField{start, static_cast<size_t>(p - start)};
+                    if(p < end)
+                        ++p;    // closing quote
+                    // anything between the closing quote and the separator is dropped
+                    while(p < end && *p != ',' && *p != '\n' && *p != '\r')
+                        ++p;
+                    if(escaped) {
+                        std::string value;
+                        value.reserve(field.size);
+                        for(size_t i = 0; i < field.size; i++) {
+                            value += field.data[i];
+                            if(field.data[i] == '"')
+                                i++;
+                        }
+                        chunk.unescaped.push_back(std::move(value));
+                        field = CsvField{chunk.unescaped.back().data(), chunk.unescaped.back().size()};
+                    }
+                }
+                else {
+                    const char* start = p;
+                    while(p < end && *p != ',' && *p != '\n' && *p != '\r')
+                        ++p;
+                    field = CsvField{start, static_cast<size_t>(p - start)};
+                }
+                chunk.fields.push_back(field);
+                if(p < end && *p == ',') {
+                    ++p;
+                    continue;
+                }
+                if(p < end && *p == '\r')
+                    ++p;
+                if(p < end && *p == '\n')
+                    ++p;
+                break;
+            }
+        }
+        return chunk;
+    }
+
+    static std::string lower(std::string s) {
+        for(char& c : s)
+            c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        return s;
+    }
+
+    static bool parseNumber(const CsvField& f, double& out) {
+        char buf[64];
+        if(f.size == 0 || f.size >= sizeof(buf))
+            return false;
+        std::memcpy(buf, f.data, f.size);
+        buf[f.size] = '\0';
+        char* endp = nullptr;
+        out = std::strtod(buf, &endp);
+        return endp == buf + f.size;
+    }
+
+    // Dates may be dd-mm-YYYY or ISO, they are stored as ISO
+    static bool parseIsoDate(const CsvField& f, DateText& out) {
+        std::optional<Date> date = parseDate(f.view());
+        if(!date)
+            return false;
+        out = formatDate(*date);
+        return true;
+    }
+
+    static int parseStatus(const CsvField& f) {
+        std::string s = lower(f.str());
+        if(s.empty() || s == "idea" || s == "0") return static_cast<int>(GiftStatus::IDEA);
+        if(s == "ordered" || s == "1") return static_cast<int>(GiftStatus::ORDERED);
+        if(s == "purchased" || s == "2") return static_cast<int>(GiftStatus::PURCHASED);
+        if(s == "cancelled" || s == "canceled" || s == "3") return static_cast<int>(GiftStatus::CANCELLED);
+        return -1;
+    }
+
+    /*
+     * The search index triggers cost one FTS insert per row, which dominates a bulk load.
+     * Each batch drops them inside its transaction, indexes its new rows with one
+     * INSERT ... SELECT per table and recreates them before the commit, so other
+     * connections never see a database without them.
+     */
+    struct IndexedTable {
+        const char* table;
+        const char* trigger;
+        const char* backfill;   // completed with the highest ID seen before the batch
+    };
+    static const IndexedTable INDEXED_TABLES[] = {
+        {"GIFTS", "GIFTS_SEARCH_INSERT", "INSERT INTO SEARCH_INDEX(rowid, Title, Detail, Owner) SELECT ID * 4, Name, Link, 'u' || UserID FROM GIFTS WHERE ID > "},
+        {"RECIPIENTS", "RECIPIENTS_SEARCH_INSERT", "INSERT INTO SEARCH_INDEX(rowid, Title, Detail, Owner) SELECT ID * 4 + 1, Name, Relationship, 'u' || UserID FROM RECIPIENTS WHERE ID > "},
+        {"EVENTS", "EVENTS_SEARCH_INSERT", "INSERT INTO SEARCH_INDEX(rowid, Title, Owner) SELECT ID * 4 + 2, Name, 'u' || UserID FROM EVENTS WHERE ID > "}
+    };
+
+    struct SuspendedTrigger {
+        const IndexedTable* table;
+        std::string sql;
+        long long maxId;
+    };
+
+    static std::vector<SuspendedTrigger> suspendSearchTriggers(DBEngine* db) {
+        std::vector<SuspendedTrigger> suspended;
+        for(const IndexedTable& t : INDEXED_TABLES) {
+            PreparedStatement trigger(db, "SELECT sql FROM sqlite_master WHERE type = 'trigger' AND name = ?;");
+            trigger.bind(1, std::string(t.trigger));
+            if(trigger.step() != ENGINE_ROW)
+                continue;
+            SuspendedTrigger entry{&t, Row(trigger.get()).get<std::string>(0), 0};
+            PreparedStatement maxId(db, std::string("SELECT COALESCE(MAX(ID), 0) FROM ") + t.table + ";");
+            if(maxId.step() == ENGINE_ROW)
+                entry.maxId = Row(maxId.get()).get<long long>(0);
+            if(db->execute(std::string("DROP TRIGGER ") + t.trigger + ";", "suspend search trigger") != ENGINE_OK)
+                throw std::runtime_error(std::string("Couldn't suspend ") + t.trigger);
+            suspended.push_back(std::move(entry));
+        }
+        return suspended;
+    }
+
+    static void restoreSearchTriggers(DBEngine* db, const std::vector<SuspendedTrigger>& suspended) {
+        for(const SuspendedTrigger& entry : suspended) {
+            if(db->execute(entry.table->backfill + std::to_string(entry.maxId) + ";", "index imported rows") != ENGINE_OK ||
+               db->execute(entry.sql + ";", "restore search trigger") != ENGINE_OK)
+                throw std::runtime_error(std::string("Couldn't restore ") + entry.table->trigger);
+        }
+    }
+
+    /*
+     * Class: CsvImporter
+     */
+    CsvImporter::CsvImporter(GiftPlanner& planner, unsigned threads, size_t batchRows)
+        : planner(planner), threads(threads), batchRows(batchRows) {
+        if(this->threads == 0)
+            this->threads = std::max(1u, std::thread::hardware_concurrency());
+        if(this->batchRows == 0)
+            this->batchRows = 50000;
+    }
+
+    ImportStats CsvImporter::importFile(ImportKind kind, const std::string& path) {
+        auto started = std::chrono::steady_clock::now();
+        ImportStats stats;
+        MappedFile file(path);
+        const char* data = file.data();
+        const char* end = data + file.size();
+        if(file.size() == 0)
+            return stats;
+
+        // header
+        const char* headerEnd = nextRecordEnd(data, end, false);
+        ParsedChunk header = parseChunk(data, headerEnd);
+        std::unordered_map<std::string, size_t> columns;
+        for(size_t i = 0; i < header.fields.size(); i++)
+            columns.emplace(lower(header.fields[i].str()), i);
+        auto column = [&](const char* name, bool required) -> long {
+            auto it = columns.find(name);
+            if(it != columns.end())
+                return static_cast<long>(it->second);
+            if(required)
+                throw std::runtime_error(path + ": missing column '" + name + "'");
+            return -1;
+        };
+        const char* body = headerEnd < end ? headerEnd + 1 : end;
+
+        // chunk boundaries: a few chunks per thread so parsing overlaps with writing
+        const size_t target = std::max<size_t>(1 << 20, static_cast<size_t>(end - body) / (threads * 4));
+        std::vector<const char*> bounds{body};
+        for(const char* p = body; static_cast<size_t>(end - p) > target;) {
+            const char* t = p + target;
+            bool inQuote = (std::count(p, t, '"') & 1) != 0;
+            const char* q = nextRecordEnd(t, end, inQuote);
+            if(q >= end)
+                break;
+            p = q + 1;
+            bounds.push_back(p);
+        }
+        bounds.push_back(end);
+
+        // parse on workers, at most `threads` chunks in flight
+        std::deque<std::future<ParsedChunk>> inFlight;
+        size_t nextChunk = 0;
+        auto launch = [&]() {
+            while(nextChunk + 1 < bounds.size() && inFlight.size() < threads) {
+                const char* b = bounds[nextChunk];
+                const char* e = bounds[nextChunk + 1];
+                inFlight.push_back(std::async(std::launch::async, parseChunk, b, e));
+                nextChunk++;
+            }
+        };
+
+        DBEngine* db = planner.engine();
+        std::optional<Transaction> tx;
+        size_t sinceCommit = 0;
+        auto reject = [&](const std::string& why) {
+            stats.skipped++;
+            if(stats.errors.size() < 20)
+                stats.errors.push_back("row " + std::to_string(stats.rows) + ": " + why);
+        };
+        // steps an upsert and reads back the row's ID, a constraint violation only skips the row
+        // (without unwinding an exception)
+        int id = 0;
+        auto insert = [&](PreparedStatement& stmt) {
+            Status status = stmt.tryStep();
+            if(status.code == ENGINE_CONSTRAINT) {
+                reject("constraint violated");
+                return false;
+            }
+            stmt.throwIfError(status);
+            if(status.row())
+                id = sqlite3_column_int(stmt.get(), 0);
+            stmt.reset();
+            return true;
+        };
+
+        // rows already in the database are updated in place, importing a file twice changes nothing.
+        // A deleted row with the same key is brought back. Rows go to the planner's current user,
+        // the UserID parameter is last and bound once, reset() keeps it
+        int user = planner.currentUser();
+        PreparedStatement insertRecipient(db, "INSERT INTO RECIPIENTS(Name, Relationship, UserID) VALUES(?, ?, ?) "
+                                              "ON CONFLICT(UserID, Name, Relationship) DO UPDATE SET Relationship = excluded.Relationship, DeletedAt = NULL RETURNING ID;");
+        PreparedStatement insertEvent(db, "INSERT INTO EVENTS(Name, Date, UserID) VALUES(?, ?, ?) "
+                                          "ON CONFLICT(UserID, Name) DO UPDATE SET Date = excluded.Date, DeletedAt = NULL RETURNING ID;");
+        insertRecipient.bind(3, user);
+        insertEvent.bind(3, user);
+        std::optional<PreparedStatement> insertGift;
+        std::unordered_map<std::string, int> recipientIds;
+        std::unordered_map<std::string, int> eventIds;
+        long colName = -1, colRelationship = -1, colDate = -1;
+        long colRecipient = -1, colEvent = -1, colEventDate = -1, colLink = -1, colBudget = -1, colPrice = -1, colStatus = -1;
+
+        if(kind == ImportKind::RECIPIENTS) {
+            colName = column("name", true);
+            colRelationship = column("relationship", false);
+        }
+        else if(kind == ImportKind::EVENTS) {
+            colName = column("name", true);
+            colDate = column("date", true);
+        }
+        else {
+            colRecipient = column("recipient", true);
+            colEvent = column("event", true);
+            colName = column("name", true);
+            colEventDate = column("event_date", false);
+            colLink = column("link", false);
+            colBudget = column("budget", false);
+            colPrice = column("price", false);
+            colStatus = column("status", false);
+            colDate = column("date", false);
+            insertGift.emplace(db, "INSERT INTO GIFTS(RecipientID, EventID, Name, Link, Budget, Price, Status, Date, UserID) "
+                                   "VALUES(?, ?, ?, ?, ?, ?, ?, COALESCE(?, date('now', 'localtime')), ?) "
+                                   "ON CONFLICT(RecipientID, EventID, Name) DO UPDATE SET Link = excluded.Link, Budget = excluded.Budget, "
+                                   "Price = excluded.Price, Status = excluded.Status, "
+                                   "Date = CASE WHEN GIFTS.Status = excluded.Status AND GIFTS.DeletedAt IS NULL THEN GIFTS.Date ELSE excluded.Date END, "
+                                   "DeletedAt = NULL RETURNING ID;");
+            insertGift->bind(9, user);
+            // name -> id, the oldest row wins when names repeat. Deleted rows aren't referenced
+            PreparedStatement recipients(db, "SELECT ID, Name FROM RECIPIENTS WHERE UserID = ? AND DeletedAt IS NULL ORDER BY ID;");
+            recipients.bind(1, user);
+            while(recipients.step() == ENGINE_ROW) {
+                Row r(recipients.get());
+                recipientIds.emplace(r.get<std::string>(1), r.get<int>(0));
+            }
+            PreparedStatement events(db, "SELECT ID, Name FROM EVENTS WHERE UserID = ? AND DeletedAt IS NULL;");
+            events.bind(1, user);
+            while(events.step() == ENGINE_ROW) {
+                Row r(events.get());
+                eventIds.emplace(r.get<std::string>(1), r.get<int>(0));
+            }
+        }
+
+        launch();
+        tx.emplace(db, TransactionMode::IMMEDIATE);
+        std::vector<SuspendedTrigger> suspended = suspendSearchTriggers(db);
+        while(!inFlight.empty()) {
+            ParsedChunk chunk = inFlight.front().get();
+            inFlight.pop_front();
+            launch();
+
+            for(size_t row = 0; row < chunk.rows.size(); row++) {
+                size_t first = chunk.rows[row];
+                size_t count = (row + 1 < chunk.rows.size() ? chunk.rows[row + 1] : chunk.fields.size()) - first;
+                const CsvField* f = chunk.fields.data() + first;
+                if(count == 1 && f[0].size == 0)
+                    continue;   // blank line
+                stats.rows++;
+                auto field = [&](long col) -> const CsvField* {
+                    return col >= 0 && static_cast<size_t>(col) < count ? &f[col] : nullptr;
+                };
+                const CsvField* name = field(colName);
+                if(!name || name->size == 0) {
+                    reject("missing name");
+                    continue;
+                }
+
+                if(kind == ImportKind::RECIPIENTS) {
+                    const CsvField* rel = field(colRelationship);
+                    insertRecipient.bindStatic(1, name->view());
+                    insertRecipient.bindStatic(2, rel ? rel->view() : std::string_view());
+                    if(!insert(insertRecipient))
+                        continue;
+                }
+                else if(kind == ImportKind::EVENTS) {
+                    const CsvField* date = field(colDate);
+                    if(!date || date->size == 0) {
+                        reject("missing date");
+                        continue;
+                    }
+                    DateText iso;
+                    if(!parseIsoDate(*date, iso)) {
+                        reject("invalid date");
+                        continue;
+                    }
+                    insertEvent.bindStatic(1, name->view());
+                    insertEvent.bindStatic(2, iso.view());
+                    if(!insert(insertEvent))
+                        continue;
+                }
+                else {
+                    const CsvField* recipient = field(colRecipient);
+                    const CsvField* event = field(colEvent);
+                    if(!recipient || recipient->size == 0 || !event || event->size == 0) {
+                        reject("missing recipient or event");
+                        continue;
+                    }
+                    double budget = 0.0, price = 0.0;
+                    const CsvField* budgetField = field(colBudget);
+                    const CsvField* priceField = field(colPrice);
+                    if((budgetField && budgetField->size && !parseNumber(*budgetField, budget)) ||
+                       (priceField && priceField->size && !parseNumber(*priceField, price))) {
+                        reject("invalid number");
+                        continue;
+                    }
+                    const CsvField* statusField = field(colStatus);
+                    int status = statusField ? parseStatus(*statusField) : 0;
+                    if(status < 0) {
+                        reject("invalid status");
+                        continue;
+                    }
+
+                    std::string recipientName = recipient->str();
+                    auto rit = recipientIds.find(recipientName);
+                    if(rit == recipientIds.end()) {
+                        insertRecipient.bindStatic(1, recipientName);
+                        insertRecipient.bindStatic(2, std::string_view());
+                        if(!insert(insertRecipient))
+                            continue;
+                        rit = recipientIds.emplace(recipientName, id).first;
+                        stats.recipientsCreated++;
+                    }
+                    const CsvField* date = field(colDate);
+                    DateText iso, eventIso;
+                    if(date && date->size && !parseIsoDate(*date, iso)) {
+                        reject("invalid date");
+                        continue;
+                    }
+                    std::string eventName = event->str();
+                    auto eit = eventIds.find(eventName);
+                    if(eit == eventIds.end()) {
+                        // an event needs a date, an empty one would fall out of every date range
+                        const CsvField* eventDate = field(colEventDate);
+                        if(!eventDate || eventDate->size == 0) {
+                            reject("missing event date");
+                            continue;
+                        }
+                        if(!parseIsoDate(*eventDate, eventIso)) {
+                            reject("invalid event date");
+                            continue;
+                        }
+                        insertEvent.bindStatic(1, eventName);
+                        insertEvent.bindStatic(2, eventIso.view());
+                        if(!insert(insertEvent))
+                            continue;
+                        eit = eventIds.emplace(eventName, id).first;
+                        stats.eventsCreated++;
+                    }
+
+                    const CsvField* link = field(colLink);
+                    PreparedStatement& stmt = *insertGift;
+                    stmt.bind(1, rit->second);
+                    stmt.bind(2, eit->second);
+                    stmt.bindStatic(3, name->view());
+                    stmt.bindStatic(4, link ? link->view() : std::string_view());
+                    stmt.bind(5, budget);
+                    stmt.bind(6, price);
+                    stmt.bind(7, status);
+                    if(date && date->size)
+                        stmt.bindStatic(8, iso.view());
+                    else
+                        stmt.bind(8);
+                    if(!insert(stmt))
+                        continue;
+                }
+                stats.inserted++;
+
+                if(++sinceCommit >= batchRows) {
+                    restoreSearchTriggers(db, suspended);
+                    tx->commit();
+                    tx.reset();
+                    tx.emplace(db, TransactionMode::IMMEDIATE);
+                    suspended = suspendSearchTriggers(db);
+                    sinceCommit = 0;
+                }
+            }
+        }
+        restoreSearchTriggers(db, suspended);
+        tx->commit();
+
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        Logger::info("[Import]: " + std::to_string(stats.inserted) + " rows from " + path);
+        return stats;
+    }
+    // end of Class: CsvImporter
+
+}
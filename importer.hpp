@@ -0,0 +1,53 @@
+#ifndef IMPORTER_H
+#define IMPORTER_H
+#include "app.hpp"
+#include <string>
+#include <vector>
+
+namespace App {
+
+    enum class ImportKind {
+        RECIPIENTS,     // name, relationship
+        EVENTS,         // name, date
+        GIFTS           // recipient, event, name, link, budget, price, status, date
+    };
+
+    struct ImportStats {
+        size_t rows = 0;
+        size_t inserted = 0;                // rows written, existing rows are updated in place
+        size_t skipped = 0;                 // rows rejected by a constraint or with missing fields
+        size_t recipientsCreated = 0;       // gifts import: recipients that did not exist yet
+        size_t eventsCreated = 0;           // gifts import: events that did not exist yet
+        std::vector<std::string> errors;    // first few problems, by data row: the header isn't counted
+                                            // and a row with quoted line breaks counts once
+        double seconds = 0.0;
+    };
+
+    /*
+     * Streaming CSV importer.
+     *
+     * The file is memory mapped and split into chunks at record boundaries. Chunks are parsed on
+     * worker threads into flat field arrays that point into the mapping. The calling thread is the
+     * single writer: it resolves recipient and event names to IDs through in-memory hash maps and
+     * upserts with reused prepared statements, committing every batchRows rows.
+     *
+     * The first line is a header, columns are matched by name (case-insensitive) so their order
+     * does not matter and unknown columns are ignored. Fields follow RFC 4180: optional double
+     * quotes, "" for a literal quote, quoted fields may span lines.
+     * Gifts that name an unknown recipient or event create it, a new event takes the row's event_date.
+     */
+    class CsvImporter {
+        public:
+            explicit CsvImporter(GiftPlanner& planner, unsigned threads=0, size_t batchRows=50000);
+            // Throws std::runtime_error if the file can't be read or a required column is missing
+            ImportStats importFile(ImportKind kind, const std::string& path);
+
+        private:
+            GiftPlanner& planner;
+            unsigned threads;
+            size_t batchRows;
+    };
+
+}
+
+#endif
@@ -5,8 +5,13 @@
 #include <variant>
 #include <vector>
 #include <app.hpp>
+#include <typeahead.hpp>
+#include <compactor.hpp>
+#include <reminders.hpp>
+#include <calendar.hpp>
+#include <deque>
+#include <atomic>
 #include <limits>
-#include <iomanip>
 #include <ctime>
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
@@ -57,71 +62,12 @@ class Manager {
     int getEventId() { return eventId; };
     std::string getEventName() { return eventName; }
     std::string getEventDate() { return eventDate; }
-    std::string getUserName() { return user.name; }
+    const std::string& getUserName() { return user.name; }
     
 };
 
 static Manager appManager;
 
-std::string getDateStr(const int day, const int month, const int year){
-    std::tm date_info = {};
-    date_info.tm_mday = day;
-    date_info.tm_mon = month -1; // month is 0 indexed
-    date_info.tm_year = year - 1900; // Year is years since 1900
-    std::ostringstream oss;
-    oss << std::put_time(&date_info, "%d-%m-%Y");
-    std::string date_str = oss.str();
-    return date_str;
-}
-
-struct Date{
-    int day;
-    int month;
-    int year;
-    std::time_t time;
-};
-
-Date parseDate(const std::string& date_str){
-    Date date;
-    std::tm t ={};
-    std::istringstream ss(date_str);
-    ss>>std::get_time(&t, "%d-%m-%Y");
-    if(ss.fail())
-        throw std::runtime_error("Couldn't parse date string.");
-    else {
-        date.day = t.tm_mday;
-        date.month = t.tm_mon + 1; // month starts at 0
-        date.year = t.tm_year + 1900;
-        date.time = std::mktime(&t);
-    }
-    return date;
-}
-
-static bool isDateValid(int day, int month , int year){
-    //check leap
-    bool isLeap = (year % 4 == 0 && year % 100 != 0) || (year % 400 == 0);
-    if(year <2024) return false;
-    if (month >0 && month <=12){
-        if(day < 1 || day >31) return false;
-        else if(month == 2){
-            if(isLeap){
-                if(day > 29) return false;
-            }
-            else{
-                if(day > 28) return false;
-            }
-        }
-        else {
-            if(month % 2 == 1 && day > 30){
-                return false;
-            }
-        }
-        
-        return true;  
-    }
-    return false;    
-}
-
 //===========================================================
 //                      ImGui
 //===========================================================
@@ -203,7 +149,7 @@ static void SetupScreen() {
         ImGui::SameLine();
         if(ImGui::Button("Continue")){
             user.name = name;
-            MyApp.setup(user);
+            MyApp.useUser(MyApp.setup(user).id);
             ChangeMenus(2);
         }
     }
@@ -250,7 +196,12 @@ static void DisplayGiftsTab() {
     }
 
     static std::vector<RecipientGifts> gifts = {};
+    static int LoadedEventId = -1;      // gifts are reloaded only when another event is selected
+    static bool Duplicate = false;
 
+    // another user may have fewer events
+    if(SelectedEventIdx >= static_cast<int>(events.size()))
+        SelectedEventIdx = 0;
     if(events.empty())
         SelectedEventNamePreview = "None";
     else
@@ -273,8 +224,11 @@ static void DisplayGiftsTab() {
 
     if(!events.empty()) { 
         EventId = events[SelectedEventIdx].eventId;
-        gifts = MyApp.fetchRecipientsAndGifts(EventId);
-        GiftCount = MyApp.getGiftCount(EventId);
+        if(EventId != LoadedEventId) {
+            gifts = MyApp.fetchRecipientsAndGifts(EventId);
+            LoadedEventId = EventId;
+        }
+        GiftCount = static_cast<int>(gifts.size());
     }
     
     ImGui::SeparatorText("Add Gift");
@@ -316,11 +270,31 @@ static void DisplayGiftsTab() {
         g.budgetLimit = Budget;
         g.price = Price;
         if(!flag) {
-            MyApp.addGift(g);
-            gifts = MyApp.fetchRecipientsAndGifts(EventId);
-            
+            try {
+                Gift added = MyApp.addGift(g);
+                // patch the view with the new row instead of reloading the whole event
+                RecipientGifts row;
+                row.recipientId = added.recipientId;
+                row.giftId = added.id;
+                row.recipientName = people[PeopleSelectedIdx].name;
+                row.recipientRelationship = people[PeopleSelectedIdx].relationship;
+                row.giftName = added.name;
+                row.giftLink = added.link;
+                row.giftBudget = added.budgetLimit;
+                row.giftPrice = added.price;
+                row.giftStatus = added.status;
+                row.eventName = events[SelectedEventIdx].eventName;
+                row.eventDate = events[SelectedEventIdx].eventDate;
+                gifts.push_back(row);
+                GiftCount = static_cast<int>(gifts.size());
+                Duplicate = false;
+            }
+            catch(const ConstraintError&) {
+                Duplicate = true;
+            }
         }
     }
+    if(Duplicate) ImGui::Text("This gift already exists");
 
     if(ImGui::BeginTable("Gifts", 8, flags, outer_size)) {
         ImGui::TableSetupScrollFreeze(0, 1);
@@ -335,13 +309,13 @@ static void DisplayGiftsTab() {
         ImGui::TableHeadersRow();
         
         const char* GiftStatus[] = {"Idea", "Ordered", "Purchased", "Cancelled"};
-        int i = 0;
         ImGuiListClipper clipper;
         clipper.Begin(GiftCount);
         while (clipper.Step())
         {
             for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++)
             {
+                const int i = row;
                 ImGui::TableNextRow();
                 ImGui::PushID(i);
                 int idx = 0;
@@ -370,51 +344,102 @@ static void DisplayGiftsTab() {
                 ImGui::TableSetColumnIndex(idx+7);
                 ImGui::TextLinkOpenURL("Link", gifts[i].giftLink.c_str());
                 ImGui::PopID();
-                i++;
             }
         }       
         ImGui::EndTable(); 
     } // table
 }
 
+static Date today() {
+    std::time_t now = std::time(nullptr);
+    std::tm local = *std::localtime(&now);
+    return Date{local.tm_year + 1900, local.tm_mon + 1, local.tm_mday};
+}
+
+// Month grid, weeks start on Monday. Only the shown month is read, see EventCalendar
+static void CalendarView(EventCalendar& calendar, int year, int month){
+    static const char* weekdays[] = {"Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "Sun"};
+    static ImGuiTableFlags flags = ImGuiTableFlags_Borders | ImGuiTableFlags_NoSavedSettings | ImGuiTableFlags_SizingStretchSame;
+    const std::vector<EventCalendar::Entry>& entries = calendar.month(year, month);
+    const int first = Date{year, month, 1}.weekday();
+    const int days = daysInMonth(year, month);
+    const Date now = today();
+
+    if(ImGui::BeginTable("Calendar", 7, flags)){
+        for(const char* weekday : weekdays)
+            ImGui::TableSetupColumn(weekday);
+        ImGui::TableHeadersRow();
+        size_t next = 0;
+        for(int cell = 0; cell < first + days; cell++){
+            if(cell % 7 == 0)
+                ImGui::TableNextRow(ImGuiTableRowFlags_None, ImGui::GetTextLineHeightWithSpacing() * 3);
+            ImGui::TableSetColumnIndex(cell % 7);
+            if(cell < first)
+                continue;
+            Date date{year, month, cell - first + 1};
+            if(date == now)
+                ImGui::TextColored(ImVec4(1.0f, 0.8f, 0.2f, 1.0f), "%d", date.day);
+            else
+                ImGui::Text("%d", date.day);
+            // entries are by date, each day takes the ones up to it
+            for(; next < entries.size() && entries[next].date == date; next++)
+                ImGui::TextWrapped("%s", entries[next].event.eventName.c_str());
+        }
+        ImGui::EndTable();
+    }
+}
+
 static void EventsTab(){
     
-    const float TEXT_BASE_WIDTH = ImGui::CalcTextSize("A").x;
     const float TEXT_BASE_HEIGHT = ImGui::GetTextLineHeightWithSpacing();
     static ImGuiTableFlags flags = ImGuiTableFlags_Borders | ImGuiTableFlags_Resizable | ImGuiTableFlags_NoSavedSettings | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY | ImGuiTableFlags_BordersOuter | ImGuiTableFlags_BordersV | ImGuiTableFlags_Reorderable | ImGuiTableFlags_Hideable;
 
     ImVec2 outer_size = ImVec2(0.0f, TEXT_BASE_HEIGHT * 12);    // table height
     
     GiftPlanner& MyApp = appManager.getApp();
-    int EventCount = MyApp.getEventCount();
+    // follows every change to EVENTS, nothing here reloads by hand
+    static EventCalendar calendar(MyApp);
     static char chbuf1[100];
-    static std::string name ="";
-    static std::string date = "";
     static int day, month, year;
     static bool valid = true;   // by default true for displaying error correctly
-    static std::vector<Event> events = MyApp.getEvents();
+    static Date shown = today();
     
     ImGui::SeparatorText("Create Event");
     ImGui::InputText("Event Name", chbuf1, IM_ARRAYSIZE(chbuf1));
-    name = chbuf1;
     ImGui::InputInt("Day", &day);
     ImGui::InputInt("Month", &month);
     ImGui::InputInt("Year", &year);
     if(ImGui::Button("Add")) {
-       valid = isDateValid(day, month, year);
+       Date date{year, month, day};
+       valid = date.valid() && year >= 2024;
        if(valid)
        {
            Event e;
-           e.eventName = name;
-           e.eventDate = getDateStr(day, month, year);
+           e.eventName = chbuf1;
+           e.eventDate = formatDate(date, DateFormat::DISPLAY).c_str();
            MyApp.addEvent(e);
-           events = MyApp.getEvents();
-           EventCount = MyApp.getEventCount();
        }
     }
     
     if(!valid) ImGui::Text("Invalid Date");
-    ImGui::SeparatorText("Events");
+
+    ImGui::SeparatorText("Calendar");
+    static const char* months[] = {"January", "February", "March", "April", "May", "June", "July",
+                                   "August", "September", "October", "November", "December"};
+    if(ImGui::ArrowButton("##previous", ImGuiDir_Left))
+        shown = shown.month == 1 ? Date{shown.year - 1, 12, 1} : Date{shown.year, shown.month - 1, 1};
+    ImGui::SameLine();
+    ImGui::Text("%s %d", months[shown.month - 1], shown.year);
+    ImGui::SameLine();
+    if(ImGui::ArrowButton("##next", ImGuiDir_Right))
+        shown = shown.month == 12 ? Date{shown.year + 1, 1, 1} : Date{shown.year, shown.month + 1, 1};
+    ImGui::SameLine();
+    if(ImGui::Button("Today"))
+        shown = today();
+    CalendarView(calendar, shown.year, shown.month);
+
+    ImGui::SeparatorText("Next 30 days");
+    std::vector<EventCalendar::Entry> upcoming = calendar.agenda(today(), 30);
     if(ImGui::BeginTable("Events", 3, flags, outer_size)){
         ImGui::TableSetupScrollFreeze(0,1);
         ImGui::TableSetupColumn("No.", ImGuiTableColumnFlags_None);
@@ -422,22 +447,18 @@ static void EventsTab(){
         ImGui::TableSetupColumn("Date", ImGuiTableColumnFlags_None);
         ImGui::TableHeadersRow();
         ImGuiListClipper clipper;
-        clipper.Begin(EventCount);
-        int i = 0;
+        clipper.Begin(static_cast<int>(upcoming.size()));
         while(clipper.Step())
         {
             for (int row = clipper.DisplayStart; row<clipper.DisplayEnd; row++){
+                const Event& event = upcoming[row].event;
                 ImGui::TableNextRow();
-                int idx = 0;
-                ImGui::TableSetColumnIndex(idx);
-                ImGui::Text("%d", events[i].eventId);
-                ImGui::TableNextColumn();
-                ImGui::TableSetColumnIndex(idx+1);
-                ImGui::Text("%s", events[i].eventName.c_str());
-                ImGui::TableNextColumn();
-                ImGui::TableSetColumnIndex(idx+2);
-                ImGui::Text("%s", events[i].eventDate.c_str());
-                i++;
+                ImGui::TableSetColumnIndex(0);
+                ImGui::Text("%d", event.eventId);
+                ImGui::TableSetColumnIndex(1);
+                ImGui::Text("%s", event.eventName.c_str());
+                ImGui::TableSetColumnIndex(2);
+                ImGui::Text("%s", event.eventDate.c_str());
             }
         }
         ImGui::EndTable();
@@ -458,7 +479,31 @@ static void PeopleTab(){
     static std::string name ="";
     static std::string relationship ="";
     static std::vector<Recipient> people = MyApp.getRecipients();
-    static ImGuiTextFilter filter;
+    static int peopleUser = MyApp.currentUser();
+    if(peopleUser != MyApp.currentUser()) {
+        people = MyApp.getRecipients();
+        peopleUser = MyApp.currentUser();
+    }
+    static char searchbuf[100];
+    // searches run on the type-ahead worker with their own connection, it follows the UI's user
+    static std::atomic<int> searchUser{1};
+    searchUser = MyApp.currentUser();
+    static std::shared_ptr<GiftPlanner> searcher = [](){
+        auto planner = std::make_shared<GiftPlanner>();
+        planner->init("test_app2.db");
+        return planner;
+    }();
+    static TypeAhead search([](const std::string& query, int limit) {
+        if(searcher->currentUser() != searchUser)
+            searcher->useUser(searchUser);
+        return searcher->search(query, limit, SearchKind::RECIPIENT);
+    });
+    // results of the previous user must not stay on screen
+    static int searchedUser = MyApp.currentUser();
+    if(searchedUser != MyApp.currentUser()) {
+        search.invalidate();
+        searchedUser = MyApp.currentUser();
+    }
 
     static ImGuiComboFlags ComboFlags = 0;
     const char* relations[] = {"Friend", "Family", "Work"};
@@ -488,20 +533,49 @@ static void PeopleTab(){
     if(ImGui::Button("Add")){
         Recipient r;
         r.name = name; r.relationship = relationship;
-        MyApp.addRecipient(r);
-        people = MyApp.getRecipients();
+        people.push_back(MyApp.addRecipient(r));
     }
 
     ImGui::SeparatorText("People");
-    filter.Draw();
-    for (int i = 0; i < people.size(); i++){
-        if(filter.PassFilter(people[i].name.c_str())){
+    ImGui::InputText("Search", searchbuf, IM_ARRAYSIZE(searchbuf));
+    search.update(searchbuf);
+    if(search.pending())
+        ImGui::Text("Searching...");
+    if(search.query().empty() && !search.pending()){
+        for (int i = 0; i < people.size(); i++){
             ImGui::BulletText("%s", people[i].name.c_str()); ImGui::SameLine();
             ImGui::Text("| %s", people[i].relationship.c_str());
         }
     }
+    else {
+        for (const SearchResult& r : search.results()){
+            ImGui::BulletText("%s", r.title.c_str()); ImGui::SameLine();
+            ImGui::Text("| %s", r.detail.c_str());
+        }
+    }
     
 }
+static void SpendingTab(){
+    GiftPlanner& MyApp = appManager.getApp();
+    static int bucket = static_cast<int>(SeriesBucket::MONTH);
+    const char* buckets[] = {"Day", "Week", "Month"};
+
+    SpendingTimeline& timeline = MyApp.spendingTimeline();
+    ImGui::Text("Total spent: %.2f", timeline.total());
+    ImGui::Combo("Group by", &bucket, buckets, IM_ARRAYSIZE(buckets));
+    if(timeline.empty()) {
+        ImGui::Text("Nothing purchased yet");
+        return;
+    }
+
+    // never push more points than the plot is wide, a collapsed window has no width at all
+    const float width = ImGui::GetContentRegionAvail().x;
+    if(width < 2.0f)
+        return;
+    const Series& points = timeline.plot(static_cast<SeriesBucket>(bucket), static_cast<size_t>(width));
+    ImGui::PlotLines("##spending", points.ys.data(), static_cast<int>(points.size()), 0, NULL, 0.0f, FLT_MAX, ImVec2(width, 200.0f));
+}
+
 static void MenuTabs() {
     
     ImGuiTabBarFlags tab_bar_flags = ImGuiTabBarFlags_None;
@@ -525,12 +599,45 @@ static void MenuTabs() {
             PeopleTab();
             ImGui::EndTabItem();
         }
+        if (ImGui::BeginTabItem("Spending"))
+        {
+            SpendingTab();
+            ImGui::EndTabItem();
+        }
         ImGui::EndTabBar();
     }
     
     ImGui::Separator();
 }
 
+// Reminders that fired recently, shown for TOAST_SECONDS in the bottom right corner
+struct Toast {
+    std::string message;
+    double shownAt;
+};
+static std::deque<Toast> toasts;
+static const double TOAST_SECONDS = 8.0;
+
+static void ShowToasts() {
+    double now = ImGui::GetTime();
+    while(!toasts.empty() && now - toasts.front().shownAt > TOAST_SECONDS)
+        toasts.pop_front();
+    if(toasts.empty())
+        return;
+    const ImGuiViewport* viewport = ImGui::GetMainViewport();
+    ImVec2 corner(viewport->WorkPos.x + viewport->WorkSize.x - 10.0f, viewport->WorkPos.y + viewport->WorkSize.y - 10.0f);
+    ImGui::SetNextWindowPos(corner, ImGuiCond_Always, ImVec2(1.0f, 1.0f));
+    ImGui::SetNextWindowViewport(viewport->ID);
+    ImGui::SetNextWindowBgAlpha(0.8f);
+    ImGuiWindowFlags flags = ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoSavedSettings |
+                             ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoNav | ImGuiWindowFlags_NoDocking;
+    if(ImGui::Begin("Reminders", NULL, flags)) {
+        for(const Toast& toast : toasts)
+            ImGui::TextUnformatted(toast.message.c_str());
+    }
+    ImGui::End();
+}
+
 int main() {
    
 //=========================================================
@@ -612,6 +719,17 @@ int main() {
     appManager.initApp("test_app2.db");
     GiftPlanner& MyApp = appManager.getApp();
     MyApp.initialize_tables();
+    // statistics, checkpoints and removing deleted rows happen in the background
+    Compactor compactor;
+    Engine::MaintenanceScheduler maintenance(MyApp.engine());
+    maintenance.addDefaults();
+    compactor.schedule(maintenance);
+    maintenance.start();
+    // polled every frame, a comparison until the next reminder is due
+    ReminderService reminders(MyApp);
+    reminders.subscribe([](const Reminder& r) {
+        toasts.push_back(Toast{r.message, ImGui::GetTime()});
+    });
     static const char* username;
     //TODO: Remove comment 
     if(MyApp.setupComplete()){
@@ -666,11 +784,26 @@ int main() {
             ImGui::Begin("Main Menu",NULL, window_flags);       
 
             ImGui::Text("Welcome...%s", username);
+            // everyone sharing the database has their own events, recipients and gifts
+            ImGui::SameLine();
+            ImGui::SetNextItemWidth(160);
+            if(ImGui::BeginCombo("User", username)) {
+                for(const User& u : MyApp.getUsers()) {
+                    if(ImGui::Selectable(u.name.c_str(), u.id == MyApp.currentUser()) && u.id != MyApp.currentUser()) {
+                        MyApp.useUser(u.id);
+                        appManager.setUser(u);
+                        username = appManager.getUserName().c_str();
+                    }
+                }
+                ImGui::EndCombo();
+            }
             ImGui::SeparatorText("");
             MenuTabs();
                         
             ImGui::End();
         } //main menu
+        reminders.poll();
+        ShowToasts();
 
 
         // Rendering
@@ -0,0 +1,199 @@
+#include "maintenance.hpp"
+#include "logger.hpp"
+
+namespace Engine {
+
+    static long long steadyNow() {
+        return std::chrono::steady_clock::now().time_since_epoch().count();
+    }
+
+    // Interrupts the running statement once the task's deadline has passed
+    static int onProgress(void* deadline) {
+        return std::chrono::steady_clock::now() >= *static_cast<std::chrono::steady_clock::time_point*>(deadline);
+    }
+
+    /*
+     * Class: MaintenanceScheduler
+     */
+    MaintenanceScheduler::MaintenanceScheduler(DBEngine* db, std::chrono::seconds idleAfter, std::chrono::seconds tick)
+        : db(db), idleAfter(idleAfter), tick(tick), lastCommit(steadyNow()) {
+        const char* file = sqlite3_db_filename(db->get(), "main");
+        if(!file || !*file)
+            throw ConfigError("[Maintenance] An in-memory database has no second connection", ENGINE_CONFIG_ERROR);
+        conn = std::make_unique<DBEngine>(file, Logger::enabled, 8, db->config());
+        // ANALYZE samples this many rows per index instead of reading them all
+        conn->execute("PRAGMA analysis_limit = 1000;", "Limit ANALYZE");
+        subscription = db->subscribe([this](const ChangeBatch&) { lastCommit = steadyNow(); });
+    }
+
+    MaintenanceScheduler::~MaintenanceScheduler() {
+        stop();
+        db->unsubscribe(subscription);
+    }
+
+    void MaintenanceScheduler::add(const std::string& name, std::chrono::seconds interval, std::chrono::milliseconds budget,
+                                   MaintenanceTask task, bool whenIdle) {
+        std::lock_guard<std::mutex> lock(runMtx);
+        Entry entry;
+        entry.interval = interval;
+        entry.budget = budget;
+        entry.task = std::move(task);
+        entry.whenIdle = whenIdle;
+        entry.stats.task = name;
+        entries.push_back(std::move(entry));
+    }
+
+    void MaintenanceScheduler::addDefaults(int walLimit) {
+        add("optimize", std::chrono::hours(1), std::chrono::milliseconds(500), [](MaintenanceContext& ctx) {
+            bool analyzed;
+            {
+                PreparedStatement stat(ctx.conn, "SELECT COUNT(*) FROM sqlite_master WHERE name = 'sqlite_stat1';");
+                stat.step();
+                analyzed = Row(stat.get()).get<int>(0) > 0;
+            }
+            // PRAGMA optimize goes by the tables this connection has queried, which are none.
+            // 0x10000 makes it consider every table (SQLite 3.46+, older versions ignore the bit)
+            if(ctx.conn->execute(analyzed ? "PRAGMA optimize = 0x10002;" : "ANALYZE;", "Optimize") != ENGINE_OK)
+                throw DatabaseException(std::string("[Maintenance] optimize failed: ") + ctx.conn->getLastErrorMsg(), ENGINE_ERROR);
+            ctx.result = analyzed ? "optimized" : "analyzed";
+            return true;
+        }, true);
+
+        add("checkpoint", std::chrono::minutes(1), std::chrono::milliseconds(200), [walLimit](MaintenanceContext& ctx) {
+            sqlite3* handle = ctx.conn->get();
+            int frames = 0, copied = 0;
+            int rc = sqlite3_wal_checkpoint_v2(handle, nullptr, SQLITE_CHECKPOINT_PASSIVE, &frames, &copied);
+            if(rc != SQLITE_OK && rc != SQLITE_BUSY)
+                throw DatabaseException(std::string("[Maintenance] checkpoint failed: ") + sqlite3_errmsg(handle), rc);
+            if(frames < 0) {
+                ctx.result = "not in WAL mode";
+                return true;
+            }
+            ctx.result = std::to_string(copied) + "/" + std::to_string(frames) + " frames";
+            if(frames == 0 || (!ctx.idle && frames <= walLimit))
+                return true;
+            // TRUNCATE waits for readers to move off the WAL, for no longer than the budget
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(ctx.deadline - std::chrono::steady_clock::now());
+            sqlite3_busy_timeout(handle, left.count() > 0 ? static_cast<int>(left.count()) : 0);
+            rc = sqlite3_wal_checkpoint_v2(handle, nullptr, SQLITE_CHECKPOINT_TRUNCATE, &frames, &copied);
+            sqlite3_busy_timeout(handle, ctx.conn->config().busyTimeout);
+            if(rc == SQLITE_BUSY) {
+                ctx.result += ", truncate busy";
+                return false;
+            }
+            if(rc != SQLITE_OK)
+                throw DatabaseException(std::string("[Maintenance] checkpoint failed: ") + sqlite3_errmsg(handle), rc);
+            ctx.result += ", truncated";
+            return true;
+        });
+
+        add("quick_check", std::chrono::hours(24), std::chrono::seconds(2), [](MaintenanceContext& ctx) {
+            PreparedStatement check(ctx.conn, "PRAGMA quick_check(1);");
+            int rc = check.step();
+            if(rc != ENGINE_ROW)
+                throw DatabaseException(std::string("[Maintenance] quick_check failed: ") + ctx.conn->getLastErrorMsg(), rc);
+            ctx.result = Row(check.get()).get<std::string>(0);
+            if(ctx.result != "ok")
+                Logger::error("[Maintenance]: quick_check: " + ctx.result);
+            return true;
+        }, true);
+    }
+
+    void MaintenanceScheduler::start() {
+        std::lock_guard<std::mutex> lock(mtx);
+        if(running)
+            return;
+        running = true;
+        worker = std::thread(&MaintenanceScheduler::loop, this);
+    }
+
+    void MaintenanceScheduler::stop() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            running = false;
+        }
+        cv.notify_all();
+        if(worker.joinable())
+            worker.join();
+    }
+
+    void MaintenanceScheduler::loop() {
+        std::unique_lock<std::mutex> lock(mtx);
+        while(running) {
+            lock.unlock();
+            runDue();
+            lock.lock();
+            if(cv.wait_for(lock, tick, [this]() { return !running; }))
+                break;
+        }
+    }
+
+    bool MaintenanceScheduler::idle() const {
+        std::chrono::steady_clock::duration quiet(steadyNow() - lastCommit.load());
+        return quiet >= idleAfter;
+    }
+
+    void MaintenanceScheduler::runDue() {
+        std::lock_guard<std::mutex> lock(runMtx);
+        bool quiet = idle();
+        for(Entry& entry : entries) {
+            if(entry.whenIdle && !quiet)
+                continue;
+            if(entry.pending || std::chrono::steady_clock::now() - entry.lastRun >= entry.interval)
+                runEntry(entry, quiet);
+        }
+    }
+
+    bool MaintenanceScheduler::run(const std::string& name) {
+        std::lock_guard<std::mutex> lock(runMtx);
+        for(Entry& entry : entries) {
+            if(entry.stats.task == name)
+                return runEntry(entry, idle());
+        }
+        throw ConfigError("[Maintenance] Unknown task: " + name, ENGINE_CONFIG_ERROR);
+    }
+
+    std::vector<MaintenanceStats> MaintenanceScheduler::stats() {
+        std::lock_guard<std::mutex> lock(runMtx);
+        std::vector<MaintenanceStats> all;
+        for(const Entry& entry : entries)
+            all.push_back(entry.stats);
+        return all;
+    }
+
+    bool MaintenanceScheduler::runEntry(Entry& entry, bool idle) {
+        auto start = std::chrono::steady_clock::now();
+        MaintenanceContext ctx{conn.get(), start + entry.budget, idle, ""};
+        sqlite3_progress_handler(conn->get(), 1000, &onProgress, &ctx.deadline);
+        bool done = false, failed = false;
+        try {
+            done = entry.task(ctx);
+        }
+        catch(const std::exception& e) {
+            // statements interrupted by the progress handler fail too, that's only the budget
+            if(!ctx.expired()) {
+                failed = true;
+                entry.stats.failures++;
+                ctx.result = e.what();
+                Logger::error("[Maintenance]: " + entry.stats.task + ": " + e.what());
+            }
+        }
+        sqlite3_progress_handler(conn->get(), 0, nullptr, nullptr);
+        if(conn->isActive())
+            conn->rollback();
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        entry.lastRun = start;
+        // unfinished work continues on the next tick, a failure waits for the next interval
+        entry.pending = !done && !failed;
+        entry.stats.runs++;
+        if(done)
+            entry.stats.completed++;
+        entry.stats.lastDuration = elapsed;
+        entry.stats.totalDuration += elapsed;
+        entry.stats.lastResult = ctx.result.empty() ? (done ? "ok" : "budget exhausted") : ctx.result;
+        return done;
+    }
+    // end of Class: MaintenanceScheduler
+
+}
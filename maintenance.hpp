@@ -0,0 +1,109 @@
+#ifndef MAINTENANCE_H
+#define MAINTENANCE_H
+#include "db.hpp"
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+
+namespace Engine {
+
+    // What a maintenance task gets for one run
+    struct MaintenanceContext {
+        DBEngine* conn;                                 // the scheduler's own connection
+        std::chrono::steady_clock::time_point deadline; // end of the task's budget
+        bool idle;                                      // no commits on the watched database for a while
+        std::string result;                             // short summary, kept in MaintenanceStats
+
+        bool expired() const { return std::chrono::steady_clock::now() >= deadline; }
+    };
+    // Returns false when the budget ran out before the work was done, the task is then due again
+    using MaintenanceTask = std::function<bool(MaintenanceContext&)>;
+
+    struct MaintenanceStats {
+        std::string task;
+        unsigned long long runs = 0;
+        unsigned long long completed = 0;       // runs that finished their work within the budget
+        unsigned long long failures = 0;        // runs that threw
+        std::chrono::microseconds lastDuration{0};
+        std::chrono::microseconds totalDuration{0};
+        std::string lastResult;
+    };
+
+    /*
+     * Runs housekeeping next to a live database: statistics for the query planner, WAL
+     * checkpoints, integrity checks and anything registered with add().
+     * Tasks run one at a time on a timer thread and on a connection of their own, so they never
+     * share a transaction with the application. A task is due once its interval has passed,
+     * tasks added with whenIdle also wait until nothing has been committed through the watched
+     * DBEngine for idleAfter. Each run has a time budget: a progress handler interrupts SQL that
+     * outlives it, and a task that stops early stays due and continues on the next tick.
+     * An in-memory database has no second connection, the constructor throws ConfigError for one.
+     */
+    class MaintenanceScheduler {
+        public:
+            MaintenanceScheduler(DBEngine* db, std::chrono::seconds idleAfter=std::chrono::seconds(30),
+                                 std::chrono::seconds tick=std::chrono::seconds(5));
+            ~MaintenanceScheduler();
+
+            void add(const std::string& name, std::chrono::seconds interval, std::chrono::milliseconds budget,
+                     MaintenanceTask task, bool whenIdle=false);
+            /*
+             * The standard tasks:
+             *   optimize     hourly when idle, 500 ms. ANALYZE once if the database has no statistics
+             *                yet, PRAGMA optimize after that (analysis_limit keeps both cheap)
+             *   checkpoint   every minute, 200 ms. Passive, never waits for readers or writers. The
+             *                WAL is truncated when idle or once it holds more than walLimit pages
+             *   quick_check  daily when idle, 2 s. A damaged database is logged as an error
+             */
+            void addDefaults(int walLimit=4096);
+
+            // Starts the timer thread, due tasks run on its first tick
+            void start();
+            void stop();
+            // Runs every due task once, what the timer thread does each tick
+            void runDue();
+            // Runs one task now whatever its triggers, returns whether it completed.
+            // Throws ConfigError for an unknown name
+            bool run(const std::string& name);
+            std::vector<MaintenanceStats> stats();
+
+            MaintenanceScheduler(const MaintenanceScheduler&) = delete;
+            MaintenanceScheduler& operator=(const MaintenanceScheduler&) = delete;
+
+        private:
+            struct Entry {
+                std::chrono::seconds interval{0};
+                std::chrono::milliseconds budget{0};
+                MaintenanceTask task;
+                bool whenIdle = false;
+                bool pending = true;                    // due regardless of interval: new, or out of budget
+                std::chrono::steady_clock::time_point lastRun;
+                MaintenanceStats stats;
+            };
+            bool runEntry(Entry& entry, bool idle);
+            bool idle() const;
+            void loop();
+
+            DBEngine* db;
+            std::unique_ptr<DBEngine> conn;
+            int subscription;
+            std::chrono::seconds idleAfter;
+            std::chrono::seconds tick;
+            std::atomic<long long> lastCommit;          // steady clock ticks
+            std::vector<Entry> entries;
+            std::mutex runMtx;                          // one task at a time, guards entries
+            std::thread worker;
+            std::mutex mtx;
+            std::condition_variable cv;
+            bool running = false;
+    };
+
+}
+
+#endif
@@ -0,0 +1,257 @@
+#ifndef QUERY_H
+#define QUERY_H
+#include "db.hpp"
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/*
+ * Typed queries: the SQL text, the parameter types and the result column types are fixed
+ * where the query is declared,
+ *
+ *     static constexpr Query<Params<int, std::string>, Columns<int, std::string>>
+ *         FIND("SELECT ID, Name FROM RECIPIENTS WHERE ID > ? AND Relationship = ?;");
+ *     for(auto& [id, name] : FIND.all(db, 10, "friend")) ...
+ *
+ * Declared constexpr, a query whose ? count doesn't match Params<...> doesn't compile, and
+ * passing the wrong number of arguments or an argument that doesn't convert is a static_assert.
+ * Arguments are bound in one call by their declared type (a price declared double is bound
+ * as a double, text is bound from a string_view without building a std::string), rows are
+ * decoded into std::tuple<C...> or into any aggregate S{C...}.
+ * Only anonymous ? parameters are supported. The column count is checked when the statement runs.
+ */
+
+namespace Engine {
+
+    template <typename... T> struct Params {};
+    template <typename... T> struct Columns {};
+
+    // Number of ? parameters in sql, ignoring string literals, quoted identifiers and comments
+    constexpr int countParameters(std::string_view sql) {
+        int count = 0;
+        for(size_t i = 0; i < sql.size(); i++) {
+            char c = sql[i];
+            if(c == '\'' || c == '"' || c == '`') {
+                // a doubled quote inside a literal just closes and reopens it
+                for(i++; i < sql.size() && sql[i] != c; i++) {}
+            }
+            else if(c == '[') {
+                for(i++; i < sql.size() && sql[i] != ']'; i++) {}
+            }
+            else if(c == '-' && i + 1 < sql.size() && sql[i + 1] == '-') {
+                for(; i < sql.size() && sql[i] != '\n'; i++) {}
+            }
+            else if(c == '/' && i + 1 < sql.size() && sql[i + 1] == '*') {
+                for(i += 2; i + 1 < sql.size() && !(sql[i] == '*' && sql[i + 1] == '/'); i++) {}
+                i++;
+            }
+            else if(c == '?') {
+                count++;
+            }
+        }
+        return count;
+    }
+
+    namespace detail {
+
+        template <typename T> struct isOptional : std::false_type {};
+        template <typename T> struct isOptional<std::optional<T>> : std::true_type {};
+
+        template <typename T> struct alwaysFalse : std::false_type {};
+
+        // Whether an argument of type A can be bound as parameter type P; text takes anything viewable as a string_view
+        template <typename P, typename A>
+        constexpr bool bindable() {
+            if constexpr (isOptional<P>::value)
+                return std::is_same_v<std::decay_t<A>, std::nullopt_t> || std::is_convertible_v<A, P> ||
+                       bindable<typename P::value_type, A>();
+            else if constexpr (std::is_same_v<P, std::string>)
+                return std::is_convertible_v<A, std::string_view>;
+            else
+                return std::is_convertible_v<A, P>;
+        }
+
+        inline void checkBind(int rc, int index) {
+            if(rc == SQLITE_OK)
+                return;
+            if(rc == SQLITE_RANGE)
+                throw BindRangeException("Parameter index is out of range " + std::to_string(index), rc);
+            if(rc == SQLITE_NOMEM)
+                throw ResourceException("Out of memory", rc);
+            throw DatabaseException("Couldn't bind parameter " + std::to_string(index), rc);
+        }
+
+        // Binds value as the declared parameter type P
+        template <typename P, typename A>
+        void bindAs(sqlite3_stmt* stmt, int index, A&& value) {
+            using V = std::decay_t<A>;
+            int rc;
+            if constexpr (isOptional<P>::value) {
+                if constexpr (std::is_same_v<V, std::nullopt_t>) {
+                    rc = sqlite3_bind_null(stmt, index);
+                }
+                else if constexpr (isOptional<V>::value) {
+                    if(!value)
+                        rc = sqlite3_bind_null(stmt, index);
+                    else
+                        return bindAs<typename P::value_type>(stmt, index, *value);
+                }
+                else {
+                    return bindAs<typename P::value_type>(stmt, index, std::forward<A>(value));
+                }
+            }
+            else if constexpr (std::is_same_v<P, std::string>) {
+                std::string_view text(value);
+                // copied by SQLite, the argument may be a temporary
+                rc = sqlite3_bind_text(stmt, index, text.data(), static_cast<int>(text.size()), SQLITE_TRANSIENT);
+            }
+            else if constexpr (std::is_same_v<P, bool>) {
+                rc = sqlite3_bind_int(stmt, index, static_cast<bool>(value) ? 1 : 0);
+            }
+            else if constexpr (std::is_floating_point_v<P>) {
+                rc = sqlite3_bind_double(stmt, index, static_cast<double>(value));
+            }
+            else if constexpr (std::is_integral_v<P> || std::is_enum_v<P>) {
+                rc = sqlite3_bind_int64(stmt, index, static_cast<sqlite3_int64>(value));
+            }
+            else {
+                static_assert(alwaysFalse<P>::value, "Unsupported Query parameter type");
+            }
+            checkBind(rc, index);
+        }
+
+        // Reads column col as T, NULL becomes an empty optional (or 0 / "" otherwise)
+        template <typename T>
+        T readColumn(sqlite3_stmt* stmt, int col) {
+            if constexpr (isOptional<T>::value) {
+                if(sqlite3_column_type(stmt, col) == SQLITE_NULL)
+                    return std::nullopt;
+                return readColumn<typename T::value_type>(stmt, col);
+            }
+            else if constexpr (std::is_same_v<T, std::string>) {
+                const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, col));
+                if(!text)
+                    return std::string();
+                return std::string(text, static_cast<size_t>(sqlite3_column_bytes(stmt, col)));
+            }
+            else if constexpr (std::is_same_v<T, bool>) {
+                return sqlite3_column_int(stmt, col) != 0;
+            }
+            else if constexpr (std::is_floating_point_v<T>) {
+                return static_cast<T>(sqlite3_column_double(stmt, col));
+            }
+            else if constexpr (std::is_integral_v<T> || std::is_enum_v<T>) {
+                return static_cast<T>(sqlite3_column_int64(stmt, col));
+            }
+            else {
+                static_assert(alwaysFalse<T>::value, "Unsupported Query column type");
+            }
+        }
+
+    }
+
+    template <typename In, typename Out> class Query;
+
+    /* Class: Query */
+    template <typename... P, typename... C>
+    class Query<Params<P...>, Columns<C...>> {
+        public:
+            using Result = std::tuple<C...>;
+
+            // Throws in a constant expression (a compile error) when the ? count is wrong
+            constexpr explicit Query(const char* sql) : sql(sql) {
+                if(countParameters(sql) != static_cast<int>(sizeof...(P)))
+                    throw std::logic_error("Query: number of ? parameters doesn't match Params<...>");
+            }
+
+            const char* text() const { return sql; }
+
+            // Runs a statement that returns no rows: INSERT, UPDATE, DELETE. Returns the rows it changed
+            template <typename... A>
+            int exec(DBEngine* db, A&&... args) const {
+                PreparedStatement stmt(db, sql);
+                bindAll(stmt.get(), std::index_sequence_for<P...>{}, std::forward<A>(args)...);
+                stmt.throwIfError(finish(stmt));
+                return sqlite3_changes(db->get());
+            }
+
+            // Calls fn with each row, decoded as std::tuple<C...> or as S{C...}
+            template <typename S = Result, typename F, typename... A>
+            void each(DBEngine* db, F&& fn, A&&... args) const {
+                PreparedStatement stmt(db, sql);
+                sqlite3_stmt* s = stmt.get();
+                checkColumns(s);
+                bindAll(s, std::index_sequence_for<P...>{}, std::forward<A>(args)...);
+                Status status;
+                while((status = stmt.tryStep()).row())
+                    fn(decode<S>(s, std::index_sequence_for<C...>{}));
+                stmt.throwIfError(status);
+            }
+
+            template <typename S = Result, typename... A>
+            std::vector<S> all(DBEngine* db, A&&... args) const {
+                std::vector<S> rows;
+                each<S>(db, [&rows](S&& row) { rows.push_back(std::move(row)); }, std::forward<A>(args)...);
+                return rows;
+            }
+
+            // First row, if any
+            template <typename S = Result, typename... A>
+            std::optional<S> one(DBEngine* db, A&&... args) const {
+                PreparedStatement stmt(db, sql);
+                sqlite3_stmt* s = stmt.get();
+                checkColumns(s);
+                bindAll(s, std::index_sequence_for<P...>{}, std::forward<A>(args)...);
+                Status status = stmt.tryStep();
+                if(status.row()) {
+                    S row = decode<S>(s, std::index_sequence_for<C...>{});
+                    // INSERT ... RETURNING finishes (and in autocommit mode commits) at SQLITE_DONE
+                    if(!sqlite3_stmt_readonly(s))
+                        stmt.throwIfError(finish(stmt));
+                    return row;
+                }
+                stmt.throwIfError(status);
+                return std::nullopt;
+            }
+
+        private:
+            // Steps past any remaining rows. Errors come back as a Status, never as a row: a failed
+            // step has reset the statement and stepping it again would run it again
+            static Status finish(PreparedStatement& stmt) {
+                Status status;
+                while((status = stmt.tryStep()).row()) {}
+                return status;
+            }
+
+            template <size_t... I, typename... A>
+            static void bindAll([[maybe_unused]] sqlite3_stmt* stmt, std::index_sequence<I...>, A&&... args) {
+                static_assert(sizeof...(A) == sizeof...(P), "Wrong number of Query arguments");
+                static_assert((detail::bindable<P, A&&>() && ...), "Query argument doesn't convert to its parameter type");
+                (detail::bindAs<P>(stmt, static_cast<int>(I) + 1, std::forward<A>(args)), ...);
+            }
+
+            template <typename S, size_t... I>
+            static S decode(sqlite3_stmt* stmt, std::index_sequence<I...>) {
+                // braced initialisation reads the columns left to right
+                return S{detail::readColumn<C>(stmt, static_cast<int>(I))...};
+            }
+
+            static void checkColumns(sqlite3_stmt* stmt) {
+                int count = sqlite3_column_count(stmt);
+                if(count != static_cast<int>(sizeof...(C)))
+                    throw SyntaxError("Query returns " + std::to_string(count) + " columns, Columns<...> has " +
+                                      std::to_string(sizeof...(C)), ENGINE_SYNTAX_ERROR);
+            }
+
+            const char* sql;
+    };
+    // end of Class: Query
+
+}
+
+#endif
@@ -0,0 +1,87 @@
+#include "reminders.hpp"
+#include "logger.hpp"
+#include <algorithm>
+
+namespace App {
+
+    long long unixNow() {
+        return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    /*
+     * Class: ReminderService
+     */
+    ReminderService::ReminderService(GiftPlanner& planner, std::chrono::seconds horizon)
+        : planner(planner), horizon(horizon), wheel(unixNow()) {
+        // deleting an event or gift silences its reminders, a new date moves them
+        subscription = planner.engine()->subscribe([this](const Engine::ChangeBatch& changes) {
+            if(firing)
+                return;
+            for(const Engine::RowChange& change : changes) {
+                if(change.table == "REMINDERS" || change.table == "EVENTS" || change.table == "GIFTS") {
+                    stale = true;
+                    return;
+                }
+            }
+        });
+    }
+
+    ReminderService::~ReminderService() {
+        planner.engine()->unsubscribe(subscription);
+    }
+
+    int ReminderService::subscribe(Listener listener) {
+        listeners[nextListener] = std::move(listener);
+        return nextListener++;
+    }
+
+    void ReminderService::unsubscribe(int id) {
+        listeners.erase(id);
+    }
+
+    size_t ReminderService::poll() {
+        return poll(unixNow());
+    }
+
+    size_t ReminderService::poll(long long now) {
+        if(stale || now >= loadedUntil || loadedUser != planner.currentUser())
+            reload(now);
+        else if(now < wake)
+            return 0;
+        size_t fired = wheel.advance(now);
+        wake = std::min<long long>(wheel.nextWake().value_or(loadedUntil), loadedUntil);
+        return fired;
+    }
+
+    long long ReminderService::nextWake() {
+        return stale || loadedUser != planner.currentUser() ? unixNow() : wake;
+    }
+
+    void ReminderService::reload(long long now) {
+        // a new wheel starts at now, reminders already due are overdue in it and fire at once
+        wheel = TimerWheel(now);
+        loadedUntil = now + horizon.count();
+        loadedUser = planner.currentUser();
+        for(const Reminder& reminder : planner.getPendingReminders(loadedUntil))
+            wheel.schedule(reminder.dueAt, [this, reminder]() { fire(reminder); });
+        stale = false;
+        Logger::info("[Reminders]: " + std::to_string(wheel.size()) + " due in the next " +
+                     std::to_string(horizon.count()) + " s");
+    }
+
+    void ReminderService::fire(const Reminder& reminder) {
+        for(auto& entry : listeners)
+            entry.second(reminder);
+        firing = true;
+        try {
+            planner.markReminderFired(reminder.id);
+        }
+        catch(...) {
+            firing = false;
+            throw;
+        }
+        firing = false;
+    }
+    // end of Class: ReminderService
+
+}
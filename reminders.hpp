@@ -0,0 +1,66 @@
+#ifndef REMINDERS_H
+#define REMINDERS_H
+#include "app.hpp"
+#include "timerwheel.hpp"
+#include <map>
+#include <functional>
+#include <chrono>
+
+namespace App {
+
+    /*
+     * Delivers GiftPlanner's reminders when they come due.
+     * The reminders due within the horizon are loaded once (an index range scan) into a
+     * TimerWheel, after that poll() is a comparison against the next wake-up time until something
+     * is due. Owners call poll() from the thread that uses the planner, e.g. once per UI frame,
+     * or sleep until nextWake(). Listeners run inside poll(), a reminder is marked fired once
+     * they have all seen it. Reminders are reloaded after reminders, events or gifts change
+     * through the planner, when the horizon runs out and when the planner's current user changes,
+     * only the current user's reminders fire. Reminders that came due while nothing
+     * was polling fire on the first poll().
+     */
+    class ReminderService {
+        public:
+            using Listener = std::function<void(const Reminder&)>;
+
+            explicit ReminderService(GiftPlanner& planner, std::chrono::seconds horizon=std::chrono::hours(24));
+            ~ReminderService();
+
+            int subscribe(Listener listener);
+            void unsubscribe(int id);
+            // Fires the reminders due by now (unix seconds) and returns how many fired
+            size_t poll(long long now);
+            size_t poll();
+            // The unix time poll() next has work, before that it returns at once
+            long long nextWake();
+            // Reload on the next poll(), for changes made through another connection
+            void invalidate() { stale = true; }
+            // Reminders waiting in the wheel
+            size_t pending() const { return wheel.size(); }
+
+            ReminderService(const ReminderService&) = delete;
+            ReminderService& operator=(const ReminderService&) = delete;
+
+        private:
+            void reload(long long now);
+            void fire(const Reminder& reminder);
+
+            GiftPlanner& planner;
+            std::chrono::seconds horizon;
+            TimerWheel wheel;
+            long long loadedUntil = 0;
+            int loadedUser = 0;                     // whose reminders are in the wheel
+            long long wake = 0;                     // wheel's next wake-up or loadedUntil
+            bool stale = true;
+            bool firing = false;                    // our own markReminderFired commits
+            int subscription;
+            std::map<int, Listener> listeners;
+            int nextListener = 0;
+    };
+
+    // Current unix time in seconds
+    long long unixNow();
+
+}
+
+#endif
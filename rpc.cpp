@@ -0,0 +1,279 @@
+#include "rpc.hpp"
+#include <cstring>
+#include <stdexcept>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace Rpc {
+
+    bool isWrite(Op op) {
+        switch(op) {
+            case Op::ADD_RECIPIENT:
+            case Op::ADD_EVENT:
+            case Op::ADD_GIFT:
+            case Op::MARK_PURCHASED:
+            case Op::UPSERT_RECIPIENT:
+            case Op::UPSERT_EVENT:
+            case Op::UPSERT_GIFT:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    /*
+     * Class: Writer
+     */
+    void Writer::u32(uint32_t v) {
+        char b[4] = {static_cast<char>(v), static_cast<char>(v >> 8), static_cast<char>(v >> 16), static_cast<char>(v >> 24)};
+        buf.append(b, 4);
+    }
+    void Writer::f64(double v) {
+        uint64_t bits;
+        std::memcpy(&bits, &v, sizeof(bits));
+        u32(static_cast<uint32_t>(bits));
+        u32(static_cast<uint32_t>(bits >> 32));
+    }
+    void Writer::str(const std::string& v) {
+        u32(static_cast<uint32_t>(v.size()));
+        buf.append(v);
+    }
+    void Writer::frame(uint32_t id, uint8_t code, std::string& out) {
+        Writer header;
+        header.u32(static_cast<uint32_t>(buf.size() + HEADER_SIZE - 4));
+        header.u32(id);
+        header.u8(code);
+        out.append(header.buf);
+        out.append(buf);
+        buf.clear();
+    }
+    // end of Class: Writer
+
+    /*
+     * Class: Reader
+     */
+    bool Reader::take(size_t n) {
+        if(!good || static_cast<size_t>(end - p) < n) {
+            good = false;
+            return false;
+        }
+        return true;
+    }
+    uint8_t Reader::u8() {
+        if(!take(1))
+            return 0;
+        return static_cast<uint8_t>(*p++);
+    }
+    uint32_t Reader::u32() {
+        if(!take(4))
+            return 0;
+        const unsigned char* b = reinterpret_cast<const unsigned char*>(p);
+        p += 4;
+        return static_cast<uint32_t>(b[0]) | static_cast<uint32_t>(b[1]) << 8 |
+               static_cast<uint32_t>(b[2]) << 16 | static_cast<uint32_t>(b[3]) << 24;
+    }
+    double Reader::f64() {
+        uint64_t lo = u32();
+        uint64_t hi = u32();
+        uint64_t bits = lo | hi << 32;
+        double v;
+        std::memcpy(&v, &bits, sizeof(v));
+        return v;
+    }
+    std::string Reader::str() {
+        uint32_t n = u32();
+        if(!take(n))
+            return "";
+        std::string v(p, n);
+        p += n;
+        return v;
+    }
+    // end of Class: Reader
+
+    int nextFrame(const std::string& buf, size_t& consumed, Frame& frame) {
+        if(buf.size() - consumed < HEADER_SIZE)
+            return 0;
+        Reader header(buf.data() + consumed, HEADER_SIZE);
+        uint32_t length = header.u32();
+        if(length < HEADER_SIZE - 4 || length > MAX_FRAME)
+            return -1;
+        if(buf.size() - consumed < 4 + static_cast<size_t>(length))
+            return 0;
+        frame.id = header.u32();
+        frame.code = header.u8();
+        frame.payload.assign(buf.data() + consumed + HEADER_SIZE, length - (HEADER_SIZE - 4));
+        consumed += 4 + length;
+        return 1;
+    }
+
+    // Entity codecs
+    void encode(Writer& w, const App::Recipient& r) {
+        w.i32(r.id);
+        w.str(r.name);
+        w.str(r.relationship);
+    }
+    void encode(Writer& w, const App::Event& e) {
+        w.i32(e.eventId);
+        w.str(e.eventName);
+        w.str(e.eventDate);
+    }
+    void encode(Writer& w, const App::Gift& g) {
+        w.i32(g.id);
+        w.i32(g.recipientId);
+        w.i32(g.eventId);
+        w.str(g.name);
+        w.str(g.link);
+        w.f64(g.budgetLimit);
+        w.f64(g.price);
+        w.u8(static_cast<uint8_t>(g.status));
+    }
+    void encode(Writer& w, const App::RecipientGifts& g) {
+        w.i32(g.recipientId);
+        w.i32(g.giftId);
+        w.str(g.recipientName);
+        w.str(g.recipientRelationship);
+        w.str(g.giftName);
+        w.str(g.giftLink);
+        w.f64(g.giftBudget);
+        w.f64(g.giftPrice);
+        w.u8(static_cast<uint8_t>(g.giftStatus));
+        w.str(g.eventName);
+        w.str(g.eventDate);
+    }
+    void encode(Writer& w, const App::SearchResult& r) {
+        w.u8(static_cast<uint8_t>(r.kind));
+        w.i32(r.id);
+        w.str(r.title);
+        w.str(r.detail);
+        w.f64(r.score);
+    }
+    void decode(Reader& r, App::Recipient& out) {
+        out.id = r.i32();
+        out.name = r.str();
+        out.relationship = r.str();
+    }
+    void decode(Reader& r, App::Event& out) {
+        out.eventId = r.i32();
+        out.eventName = r.str();
+        out.eventDate = r.str();
+    }
+    void decode(Reader& r, App::Gift& out) {
+        out.id = r.i32();
+        out.recipientId = r.i32();
+        out.eventId = r.i32();
+        out.name = r.str();
+        out.link = r.str();
+        out.budgetLimit = r.f64();
+        out.price = r.f64();
+        out.status = static_cast<App::GiftStatus>(r.u8());
+    }
+    void decode(Reader& r, App::RecipientGifts& out) {
+        out.recipientId = r.i32();
+        out.giftId = r.i32();
+        out.recipientName = r.str();
+        out.recipientRelationship = r.str();
+        out.giftName = r.str();
+        out.giftLink = r.str();
+        out.giftBudget = r.f64();
+        out.giftPrice = r.f64();
+        out.giftStatus = static_cast<App::GiftStatus>(r.u8());
+        out.eventName = r.str();
+        out.eventDate = r.str();
+    }
+    void decode(Reader& r, App::SearchResult& out) {
+        out.kind = static_cast<App::SearchKind>(r.u8());
+        out.id = r.i32();
+        out.title = r.str();
+        out.detail = r.str();
+        out.score = r.f64();
+    }
+
+    /*
+     * Class: Client
+     */
+    Client::~Client() {
+        close();
+    }
+    void Client::connect(const std::string& path) {
+        close();
+        sockaddr_un addr{};
+        if(path.size() >= sizeof(addr.sun_path))
+            throw std::runtime_error("Socket path too long: " + path);
+        fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if(fd < 0)
+            throw std::runtime_error(std::string("socket() failed: ") + std::strerror(errno));
+        addr.sun_family = AF_UNIX;
+        std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        if(::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            int err = errno;
+            close();
+            throw std::runtime_error("Couldn't connect to " + path + ": " + std::strerror(err));
+        }
+    }
+    void Client::close() {
+        if(fd >= 0)
+            ::close(fd);
+        fd = -1;
+        in.clear();
+        consumed = 0;
+    }
+    uint32_t Client::send(Op op, Writer& payload) {
+        if(fd < 0)
+            throw std::runtime_error("Client is not connected");
+        uint32_t id = nextId++;
+        out.clear();
+        payload.frame(id, static_cast<uint8_t>(op), out);
+        size_t sent = 0;
+        while(sent < out.size()) {
+            ssize_t n = ::send(fd, out.data() + sent, out.size() - sent, MSG_NOSIGNAL);
+            if(n < 0) {
+                if(errno == EINTR)
+                    continue;
+                throw std::runtime_error(std::string("send() failed: ") + std::strerror(errno));
+            }
+            sent += static_cast<size_t>(n);
+        }
+        return id;
+    }
+    uint32_t Client::send(Op op) {
+        Writer empty;
+        return send(op, empty);
+    }
+    Frame Client::receive() {
+        Frame frame;
+        char chunk[64 * 1024];
+        while(true) {
+            int rc = nextFrame(in, consumed, frame);
+            if(rc == 1)
+                break;
+            if(rc < 0)
+                throw std::runtime_error("Malformed response from server");
+            if(consumed > 0) {
+                in.erase(0, consumed);
+                consumed = 0;
+            }
+            ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+            if(n < 0 && errno == EINTR)
+                continue;
+            if(n <= 0)
+                throw std::runtime_error("Connection closed by server");
+            in.append(chunk, static_cast<size_t>(n));
+        }
+        return frame;
+    }
+    Frame Client::call(Op op, Writer& payload) {
+        send(op, payload);
+        Frame frame = receive();
+        if(frame.code != static_cast<uint8_t>(Status::OK))
+            throw std::runtime_error("Server error: " + frame.payload);
+        return frame;
+    }
+    Frame Client::call(Op op) {
+        Writer empty;
+        return call(op, empty);
+    }
+    // end of Class: Client
+
+}
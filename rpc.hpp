@@ -0,0 +1,158 @@
+#ifndef RPC_H
+#define RPC_H
+#include "app.hpp"
+#include <string>
+#include <vector>
+#include <cstdint>
+
+/*
+ * Binary protocol for serving GiftPlanner over a Unix domain socket (see server.hpp).
+ *
+ * Every message is a frame:
+ *     u32 length      bytes that follow the length field
+ *     u32 id          chosen by the client, echoed in the response
+ *     u8  code        Op for requests, Status for responses
+ *     ... payload
+ * Integers are little-endian, doubles are IEEE-754 little-endian, strings are u32 length + bytes.
+ * Clients may pipeline: send many requests before reading responses. Responses on one
+ * connection come back in request order.
+ */
+namespace Rpc {
+
+    enum class Op : uint8_t {
+        PING,
+        ADD_RECIPIENT,      // Recipient                       -> Recipient (with its ID)
+        ADD_EVENT,          // Event                           -> Event
+        ADD_GIFT,           // Gift                            -> Gift
+        MARK_PURCHASED,     // i32 giftId                      -> -
+        GET_EVENTS,         // -                               -> u32 n, Event * n
+        GET_RECIPIENTS,     // -                               -> u32 n, Recipient * n
+        FETCH_GIFTS,        // i32 eventId, i32 limit, i32 offset -> u32 n, RecipientGifts * n
+        SEARCH,             // str query, i32 limit            -> u32 n, SearchResult * n
+        COUNTS,             // -                               -> i32 events, i32 recipients, i32 purchased
+        UPSERT_RECIPIENT,   // Recipient                       -> i32 id
+        UPSERT_EVENT,       // Event                           -> i32 id
+        UPSERT_GIFT,        // Gift                            -> i32 id
+        USE_USER            // i32 userId                      -> -, later requests on the connection are that user's
+    };
+
+    enum class Status : uint8_t {
+        OK,
+        FAILED              // payload is an error message
+    };
+
+    const uint32_t MAX_FRAME = 16 * 1024 * 1024;
+    const size_t HEADER_SIZE = 9;           // length + id + code
+    const size_t MAX_PAYLOAD = MAX_FRAME - (HEADER_SIZE - 4);
+    const char* const DEFAULT_SOCKET = "/tmp/giftplanner.sock";
+
+    // true for ops that modify the database, the server runs them in a shared write transaction
+    bool isWrite(Op op);
+
+    class Writer {
+        public:
+            void u8(uint8_t v) { buf.push_back(static_cast<char>(v)); }
+            void u32(uint32_t v);
+            void i32(int32_t v) { u32(static_cast<uint32_t>(v)); }
+            void f64(double v);
+            void str(const std::string& v);
+            // appends already encoded bytes
+            void raw(const std::string& v) { buf.append(v); }
+
+            // Frames the current payload. The writer is cleared for the next message
+            void frame(uint32_t id, uint8_t code, std::string& out);
+
+            const std::string& data() const { return buf; }
+            void clear() { buf.clear(); }
+        private:
+            std::string buf;
+    };
+
+    // Reads a payload. Reading past the end returns zero values and marks the reader bad
+    class Reader {
+        public:
+            Reader(const char* data, size_t size) : p(data), end(data + size) {}
+            uint8_t u8();
+            uint32_t u32();
+            int32_t i32() { return static_cast<int32_t>(u32()); }
+            double f64();
+            std::string str();
+            bool ok() const { return good; }
+            bool atEnd() const { return p == end; }
+        private:
+            bool take(size_t n);
+            const char* p;
+            const char* end;
+            bool good = true;
+    };
+
+    struct Frame {
+        uint32_t id = 0;
+        uint8_t code = 0;
+        std::string payload;
+    };
+
+    /*
+     * Takes the next complete frame off the front of buf.
+     * Returns 1 when a frame was read, 0 when more bytes are needed, -1 on a malformed frame.
+     * consumed is advanced past the frame so many frames can be parsed before compacting buf.
+     */
+    int nextFrame(const std::string& buf, size_t& consumed, Frame& frame);
+
+    // Entity codecs shared by client and server
+    void encode(Writer& w, const App::Recipient& r);
+    void encode(Writer& w, const App::Event& e);
+    void encode(Writer& w, const App::Gift& g);
+    void encode(Writer& w, const App::RecipientGifts& g);
+    void encode(Writer& w, const App::SearchResult& r);
+    void decode(Reader& r, App::Recipient& out);
+    void decode(Reader& r, App::Event& out);
+    void decode(Reader& r, App::Gift& out);
+    void decode(Reader& r, App::RecipientGifts& out);
+    void decode(Reader& r, App::SearchResult& out);
+
+    template <typename T>
+    std::vector<T> decodeList(Reader& r) {
+        std::vector<T> items;
+        uint32_t n = r.u32();
+        for(uint32_t i = 0; i < n && r.ok(); i++) {
+            T item;
+            decode(r, item);
+            items.push_back(std::move(item));
+        }
+        return items;
+    }
+
+    /*
+     * Blocking client. send() writes the request without waiting for its response, so callers
+     * can pipeline many requests and collect the responses with receive() in order.
+     * call() is send + receive.
+     */
+    class Client {
+        public:
+            Client() {}
+            ~Client();
+            void connect(const std::string& path = DEFAULT_SOCKET);
+            void close();
+
+            uint32_t send(Op op, Writer& payload);
+            uint32_t send(Op op);
+            // Blocks until the next response arrives. Throws on connection errors
+            Frame receive();
+            // send + receive, throws std::runtime_error with the server message on Status::FAILED
+            Frame call(Op op, Writer& payload);
+            Frame call(Op op);
+
+            Client(const Client&) = delete;
+            Client& operator=(const Client&) = delete;
+        private:
+            int fd = -1;
+            uint32_t nextId = 1;
+            std::string out;
+            std::string in;
+            size_t consumed = 0;
+    };
+
+}
+
+#endif
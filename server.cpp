@@ -0,0 +1,397 @@
+#include "server.hpp"
+#include "logger.hpp"
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace Rpc {
+
+    static const int MAX_EVENTS = 64;
+    static const size_t MAX_PENDING_OUTPUT = 4 * 1024 * 1024;
+    static const size_t MAX_READ_PER_WAKEUP = 1024 * 1024;     // epoll is level triggered, the rest waits
+
+    /*
+     * Class: Server
+     */
+    Server::Server(App::GiftPlanner& planner, const std::string& socketPath)
+        : planner(planner), path(socketPath) {}
+
+    Server::~Server() {
+        for(auto& entry : connections) {
+            ::close(entry.first);
+            delete entry.second;
+        }
+        connections.clear();
+        if(listenFd >= 0) {
+            ::close(listenFd);
+            ::unlink(path.c_str());
+        }
+        if(epollFd >= 0)
+            ::close(epollFd);
+        if(wakeFd >= 0)
+            ::close(wakeFd);
+    }
+
+    void Server::listen() {
+        sockaddr_un addr{};
+        if(path.size() >= sizeof(addr.sun_path))
+            throw std::runtime_error("Socket path too long: " + path);
+        addr.sun_family = AF_UNIX;
+        std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+        listenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if(listenFd < 0)
+            throw std::runtime_error(std::string("socket() failed: ") + std::strerror(errno));
+        ::unlink(path.c_str());     // stale socket from a previous run
+        if(::bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0)
+            throw std::runtime_error("Couldn't bind " + path + ": " + std::strerror(errno));
+        if(::listen(listenFd, SOMAXCONN) != 0)
+            throw std::runtime_error(std::string("listen() failed: ") + std::strerror(errno));
+
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if(epollFd < 0 || wakeFd < 0)
+            throw std::runtime_error(std::string("epoll setup failed: ") + std::strerror(errno));
+
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.ptr = nullptr;      // nullptr marks the listening socket
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &ev);
+        ev.data.ptr = &wakeFd;      // address of wakeFd marks the stop signal
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &ev);
+        Logger::info("[Server]: Listening on " + path);
+    }
+
+    void Server::stop() {
+        running = false;
+        if(wakeFd >= 0) {
+            uint64_t one = 1;
+            ssize_t rc = ::write(wakeFd, &one, sizeof(one));
+            (void)rc;
+        }
+    }
+
+    void Server::run() {
+        if(listenFd < 0)
+            listen();
+        running = true;
+        epoll_event events[MAX_EVENTS];
+        while(running) {
+            int n = epoll_wait(epollFd, events, MAX_EVENTS, -1);
+            if(n < 0) {
+                if(errno == EINTR)
+                    continue;
+                throw std::runtime_error(std::string("epoll_wait() failed: ") + std::strerror(errno));
+            }
+            for(int i = 0; i < n; i++) {
+                void* tag = events[i].data.ptr;
+                if(tag == nullptr) {
+                    accept();
+                    continue;
+                }
+                if(tag == &wakeFd)
+                    continue;
+                Connection* conn = static_cast<Connection*>(tag);
+                if(events[i].events & (EPOLLHUP | EPOLLERR))
+                    conn->closed = true;
+                if(events[i].events & EPOLLIN)
+                    readFrom(conn);
+                if((events[i].events & EPOLLOUT) && !conn->closed)
+                    flush(conn);
+            }
+
+            if(!pending.empty()) {
+                execute(pending);
+                pending.clear();
+            }
+
+            // connections are deleted only after the batch, requests point at them
+            for(auto it = connections.begin(); it != connections.end();) {
+                if(it->second->closed) {
+                    ::close(it->first);
+                    delete it->second;
+                    it = connections.erase(it);
+                }
+                else {
+                    ++it;
+                }
+            }
+        }
+        Logger::info("[Server]: Stopped");
+    }
+
+    void Server::accept() {
+        while(true) {
+            int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if(fd < 0)
+                return;     // EAGAIN: no more pending connections
+            Connection* conn = new Connection(fd);
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.ptr = conn;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+            conn->events = EPOLLIN;
+            connections[fd] = conn;
+            stats.connections++;
+        }
+    }
+
+    void Server::readFrom(Connection* conn) {
+        char chunk[64 * 1024];
+        size_t received = 0;
+        while(received < MAX_READ_PER_WAKEUP) {
+            ssize_t n = ::recv(conn->fd, chunk, sizeof(chunk), 0);
+            if(n > 0) {
+                conn->in.append(chunk, static_cast<size_t>(n));
+                received += static_cast<size_t>(n);
+                continue;
+            }
+            if(n < 0 && errno == EINTR)
+                continue;
+            if(n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+                conn->closed = true;
+            break;
+        }
+
+        size_t consumed = 0;
+        Frame frame;
+        int rc;
+        while((rc = nextFrame(conn->in, consumed, frame)) == 1)
+            pending.push_back(Request{conn, std::move(frame)});
+        if(rc < 0) {
+            Logger::warn("[Server]: Malformed frame, closing connection");
+            conn->closed = true;
+        }
+        conn->in.erase(0, consumed);
+    }
+
+    void Server::flush(Connection* conn) {
+        while(conn->sent < conn->out.size()) {
+            ssize_t n = ::send(conn->fd, conn->out.data() + conn->sent, conn->out.size() - conn->sent, MSG_NOSIGNAL);
+            if(n > 0) {
+                conn->sent += static_cast<size_t>(n);
+                continue;
+            }
+            if(n < 0 && errno == EINTR)
+                continue;
+            if(n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                // socket buffer is full, continue when the client has read some
+                conn->writable = false;
+                watch(conn);
+                return;
+            }
+            conn->closed = true;
+            return;
+        }
+        conn->out.clear();
+        conn->sent = 0;
+        conn->writable = true;
+        watch(conn);
+    }
+
+    void Server::watch(Connection* conn) {
+        uint32_t events = 0;
+        if(conn->out.size() - conn->sent <= MAX_PENDING_OUTPUT)
+            events |= EPOLLIN;
+        if(!conn->writable)
+            events |= EPOLLOUT;
+        if(events == conn->events)
+            return;
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.ptr = conn;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, conn->fd, &ev);
+        conn->events = events;
+    }
+
+    void Server::execute(std::vector<Request>& batch) {
+        struct Reply {
+            Status status;
+            std::string payload;
+        };
+        std::vector<Reply> replies(batch.size());
+        bool hasWrites = false;
+        for(const Request& req : batch)
+            hasWrites = hasWrites || isWrite(static_cast<Op>(req.frame.code));
+
+        auto runAll = [&]() {
+            Writer reply;
+            for(size_t i = 0; i < batch.size(); i++) {
+                try {
+                    // connections of different users share the batch, the planner follows each request
+                    if(planner.currentUser() != batch[i].conn->user)
+                        planner.useUser(batch[i].conn->user);
+                    handle(batch[i].conn, batch[i].frame, reply);
+                    // the client drops frames over MAX_FRAME as malformed, a list this big has to be paged
+                    if(reply.data().size() > MAX_PAYLOAD)
+                        throw std::runtime_error("Reply of " + std::to_string(reply.data().size()) +
+                                                 " bytes is over the frame limit, request fewer rows");
+                    replies[i] = Reply{Status::OK, reply.data()};
+                }
+                catch(const std::exception& e) {
+                    replies[i] = Reply{Status::FAILED, e.what()};
+                }
+                reply.clear();
+            }
+        };
+
+        if(hasWrites) {
+            try {
+                planner.batch(runAll);
+                stats.batches++;
+            }
+            catch(const std::exception& e) {
+                // the commit failed, none of the writes in this batch happened
+                for(size_t i = 0; i < batch.size(); i++) {
+                    if(isWrite(static_cast<Op>(batch[i].frame.code)))
+                        replies[i] = Reply{Status::FAILED, e.what()};
+                }
+            }
+        }
+        else {
+            // reads of one wakeup see one consistent state
+            try {
+                planner.read(runAll);
+            }
+            catch(const std::exception& e) {
+                for(size_t i = 0; i < batch.size(); i++)
+                    replies[i] = Reply{Status::FAILED, e.what()};
+            }
+        }
+
+        stats.requests += batch.size();
+        if(batch.size() > stats.maxBatch)
+            stats.maxBatch = batch.size();
+
+        Writer frame;
+        for(size_t i = 0; i < batch.size(); i++) {
+            Connection* conn = batch[i].conn;
+            if(conn->closed)
+                continue;
+            frame.raw(replies[i].payload);
+            frame.frame(batch[i].frame.id, static_cast<uint8_t>(replies[i].status), conn->out);
+        }
+        for(size_t i = 0; i < batch.size(); i++) {
+            Connection* conn = batch[i].conn;
+            if(conn->closed)
+                continue;
+            if(conn->writable && !conn->out.empty())
+                flush(conn);
+            else
+                watch(conn);        // the backlog of a blocked connection grew
+        }
+    }
+
+    void Server::handle(Connection* conn, const Frame& request, Writer& reply) {
+        Reader in(request.payload.data(), request.payload.size());
+        Op op = static_cast<Op>(request.code);
+        switch(op) {
+            case Op::PING:
+                break;
+            case Op::ADD_RECIPIENT: {
+                App::Recipient r;
+                decode(in, r);
+                if(!in.ok()) throw std::runtime_error("Malformed request");
+                encode(reply, planner.addRecipient(r));
+                break;
+            }
+            case Op::ADD_EVENT: {
+                App::Event e;
+                decode(in, e);
+                if(!in.ok()) throw std::runtime_error("Malformed request");
+                encode(reply, planner.addEvent(e));
+                break;
+            }
+            case Op::ADD_GIFT: {
+                App::Gift g;
+                decode(in, g);
+                if(!in.ok()) throw std::runtime_error("Malformed request");
+                encode(reply, planner.addGift(g));
+                break;
+            }
+            case Op::UPSERT_RECIPIENT: {
+                App::Recipient r;
+                decode(in, r);
+                if(!in.ok()) throw std::runtime_error("Malformed request");
+                reply.i32(planner.upsertRecipient(r));
+                break;
+            }
+            case Op::UPSERT_EVENT: {
+                App::Event e;
+                decode(in, e);
+                if(!in.ok()) throw std::runtime_error("Malformed request");
+                reply.i32(planner.upsertEvent(e));
+                break;
+            }
+            case Op::UPSERT_GIFT: {
+                App::Gift g;
+                decode(in, g);
+                if(!in.ok()) throw std::runtime_error("Malformed request");
+                reply.i32(planner.upsertGift(g));
+                break;
+            }
+            case Op::MARK_PURCHASED: {
+                int32_t id = in.i32();
+                if(!in.ok()) throw std::runtime_error("Malformed request");
+                planner.markGiftAsPurchased(id);
+                break;
+            }
+            case Op::GET_EVENTS: {
+                std::vector<App::Event> events = planner.getEvents();
+                reply.u32(static_cast<uint32_t>(events.size()));
+                for(const App::Event& e : events)
+                    encode(reply, e);
+                break;
+            }
+            case Op::GET_RECIPIENTS: {
+                std::vector<App::Recipient> recipients = planner.getRecipients();
+                reply.u32(static_cast<uint32_t>(recipients.size()));
+                for(const App::Recipient& r : recipients)
+                    encode(reply, r);
+                break;
+            }
+            case Op::FETCH_GIFTS: {
+                int32_t eventId = in.i32();
+                int32_t limit = in.i32();
+                int32_t offset = in.i32();
+                if(!in.ok()) throw std::runtime_error("Malformed request");
+                std::vector<App::RecipientGifts> gifts = planner.fetchRecipientsAndGifts(eventId, limit, offset);
+                reply.u32(static_cast<uint32_t>(gifts.size()));
+                for(const App::RecipientGifts& g : gifts)
+                    encode(reply, g);
+                break;
+            }
+            case Op::SEARCH: {
+                std::string query = in.str();
+                int32_t limit = in.i32();
+                if(!in.ok()) throw std::runtime_error("Malformed request");
+                std::vector<App::SearchResult> results = planner.search(query, limit);
+                reply.u32(static_cast<uint32_t>(results.size()));
+                for(const App::SearchResult& r : results)
+                    encode(reply, r);
+                break;
+            }
+            case Op::COUNTS:
+                reply.i32(planner.getEventCount());
+                reply.i32(planner.getRecipientCount());
+                reply.i32(planner.totalGiftsPurchased());
+                break;
+            case Op::USE_USER: {
+                int32_t id = in.i32();
+                if(!in.ok()) throw std::runtime_error("Malformed request");
+                planner.useUser(id);
+                conn->user = id;
+                break;
+            }
+            default:
+                throw std::runtime_error("Unknown op " + std::to_string(request.code));
+        }
+    }
+    // end of Class: Server
+
+}
@@ -0,0 +1,86 @@
+#ifndef SERVER_H
+#define SERVER_H
+#include "app.hpp"
+#include "rpc.hpp"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <atomic>
+
+namespace Rpc {
+
+    /*
+     * Serves one GiftPlanner to many local clients over a Unix domain socket.
+     * The server owns the database, so tools no longer open their own DBEngine and fight over locks.
+     *
+     * Single threaded epoll loop. Each wakeup reads every ready connection, parses all complete
+     * frames (clients may pipeline), then runs the whole batch in arrival order. Writes from all
+     * clients in a batch share one transaction, so a busy server pays one commit per wakeup
+     * instead of one per request. A failing request only fails itself, so does one whose reply
+     * would be over MAX_FRAME (page FETCH_GIFTS with limit and offset).
+     * A connection whose unsent replies pass MAX_PENDING_OUTPUT is not read from until the client
+     * has taken some of them, a client that writes but never reads can't grow the server's memory.
+     */
+    class Server {
+        public:
+            struct Stats {
+                unsigned long long requests = 0;
+                unsigned long long batches = 0;         // write transactions committed
+                unsigned long long maxBatch = 0;        // most requests served in one wakeup
+                unsigned long long connections = 0;
+            };
+
+            Server(App::GiftPlanner& planner, const std::string& socketPath = DEFAULT_SOCKET);
+            ~Server();
+
+            // Binds the socket. Throws std::runtime_error on failure
+            void listen();
+            // Runs the event loop until stop() is called
+            void run();
+            // Safe to call from another thread or a signal handler
+            void stop();
+
+            Stats getStats() const { return stats; }
+
+            Server(const Server&) = delete;
+            Server& operator=(const Server&) = delete;
+
+        private:
+            struct Connection {
+                explicit Connection(int fd) : fd(fd) {}
+                int fd;
+                std::string in;
+                std::string out;
+                size_t sent = 0;
+                bool writable = true;       // false while waiting for EPOLLOUT
+                uint32_t events = 0;        // epoll events currently registered
+                bool closed = false;
+                int user = 1;               // set by USE_USER
+            };
+            struct Request {
+                Connection* conn;
+                Frame frame;
+            };
+
+            void accept();
+            void readFrom(Connection* conn);
+            void flush(Connection* conn);
+            // Registers EPOLLIN unless the reply backlog is over the cap, EPOLLOUT while blocked
+            void watch(Connection* conn);
+            void execute(std::vector<Request>& batch);
+            void handle(Connection* conn, const Frame& request, Writer& reply);
+
+            App::GiftPlanner& planner;
+            std::string path;
+            int listenFd = -1;
+            int epollFd = -1;
+            int wakeFd = -1;
+            std::atomic<bool> running{false};
+            std::unordered_map<int, Connection*> connections;
+            std::vector<Request> pending;
+            Stats stats;
+    };
+
+}
+
+#endif
@@ -2,8 +2,14 @@
 #include <gtest/gtest.h>
 #include <sqlite3.h>
 #include "../db.hpp"
+#include "../backup.hpp"
+#include "../maintenance.hpp"
+#include "../query.hpp"
 #include "../logger.hpp"
 #include <sstream>
+#include <cstdio>
+#include <filesystem>
+#include <thread>
 
 using namespace Engine;
 
@@ -150,6 +156,492 @@ TEST_F(DBEngineTest, ShouldCommitTransaction) {
     ASSERT_EQ(count, 1);
 }
 
+/*
+ * Change data capture tests
+ */
+TEST_F(DBEngineTest, ShouldDeliverChangesOnCommit) {
+    std::vector<ChangeBatch> received;
+    int id = db->subscribe([&](const ChangeBatch& batch) { received.push_back(batch); });
+    {
+        Transaction t(db);
+        db->execute("INSERT INTO test VALUES(1, 'a');", "insert into test table");
+        db->execute("UPDATE test SET name = 'b' WHERE id = 1;", "update test table");
+        ASSERT_TRUE(received.empty());      // nothing is delivered before commit
+        t.commit();
+    }
+    db->unsubscribe(id);
+    ASSERT_EQ(received.size(), 1u);
+    ASSERT_EQ(received[0].size(), 2u);
+    ASSERT_EQ(received[0][0].type, ChangeType::INSERTED);
+    ASSERT_EQ(received[0][0].table, "test");
+    ASSERT_EQ(received[0][1].type, ChangeType::UPDATED);
+}
+TEST_F(DBEngineTest, ShouldDropChangesOnRollback) {
+    int batches = 0;
+    int id = db->subscribe([&](const ChangeBatch&) { batches++; });
+    {
+        Transaction t(db);
+        db->execute("INSERT INTO test VALUES(1, 'a');", "insert into test table");
+    }
+    ASSERT_EQ(batches, 0);
+    // autocommit statements are delivered as their own batch
+    db->execute("INSERT INTO test VALUES(2, 'b');", "insert into test table");
+    ASSERT_EQ(batches, 1);
+    db->unsubscribe(id);
+    db->execute("INSERT INTO test VALUES(3, 'c');", "insert into test table");
+    ASSERT_EQ(batches, 1);
+}
+TEST_F(DBEngineTest, ShouldDropChangesOfFailedStatements) {
+    std::vector<ChangeBatch> received;
+    int id = db->subscribe([&](const ChangeBatch& batch) { received.push_back(batch); });
+    {
+        Transaction t(db);
+        db->execute("INSERT INTO test VALUES(1, 'a');", "insert into test table");
+        // the first row goes through the update hook before the second one aborts the statement
+        ASSERT_EQ(db->execute("INSERT INTO test VALUES(2, 'b'); INSERT INTO test VALUES(3, 'c'), (4, NULL);", "insert into test table"), ENGINE_ERROR);
+        PreparedStatement insert(db, "INSERT INTO test VALUES(5, 'e'), (6, NULL);");
+        ASSERT_THROW(insert.step(), ConstraintError);
+        t.commit();
+    }
+    db->unsubscribe(id);
+    ASSERT_EQ(received.size(), 1u);
+    ASSERT_EQ(received[0].size(), 2u);
+    ASSERT_EQ(received[0][0].rowid, 1);
+    ASSERT_EQ(received[0][1].rowid, 2);
+}
+TEST_F(DBEngineTest, FailedCommitKeepsEarlierBatches) {
+    db->execute("CREATE TABLE parent (id INTEGER PRIMARY KEY);"
+                "CREATE TABLE child (pid INT REFERENCES parent(id) DEFERRABLE INITIALLY DEFERRED);", "create tables");
+    std::vector<ChangeBatch> received;
+    bool nested = false;
+    int id = db->subscribe([&](const ChangeBatch& batch) {
+        received.push_back(batch);
+        if(nested)
+            return;
+        nested = true;
+        // committed from the callback, waits for delivery while the next commit fails
+        db->begin();
+        db->execute("INSERT INTO test VALUES(2, 'b');", "insert into test table");
+        db->commit();
+        db->begin();
+        db->execute("INSERT INTO child VALUES(42);", "insert orphan");
+        EXPECT_THROW(db->commit(), TransactionError);
+        EXPECT_FALSE(db->isActive());
+    });
+    db->execute("INSERT INTO test VALUES(1, 'a');", "insert into test table");
+    db->unsubscribe(id);
+    ASSERT_EQ(received.size(), 2u);
+    ASSERT_EQ(received[1].size(), 1u);
+    ASSERT_EQ(received[1][0].table, "test");
+    ASSERT_EQ(received[1][0].rowid, 2);
+    // the failed transaction was rolled back, the connection takes new ones
+    Transaction t(db);
+    t.commit();
+}
+TEST_F(DBEngineTest, MovedStatementKeepsItsChangeMark) {
+    std::vector<ChangeBatch> received;
+    int id = db->subscribe([&](const ChangeBatch& batch) { received.push_back(batch); });
+    {
+        Transaction t(db);
+        db->execute("INSERT INTO test VALUES(1, 'a'), (2, 'b');", "insert into test table");
+        // the second row overflows abs() after the first one was returned
+        PreparedStatement select(db, "SELECT CASE WHEN id = 2 THEN abs(-9223372036854775807 - 1) ELSE id END FROM test ORDER BY rowid;");
+        ASSERT_EQ(select.step(), ENGINE_ROW);
+        PreparedStatement moved(std::move(select));
+        ASSERT_THROW(moved.step(), DatabaseException);
+        t.commit();
+    }
+    db->unsubscribe(id);
+    ASSERT_EQ(received.size(), 1u);
+    ASSERT_EQ(received[0].size(), 2u);
+}
+
+/*
+ * Backup tests
+ */
+TEST_F(DBEngineTest, BackupCopiesWhileWritesContinue) {
+    {
+        Transaction t(db);
+        PreparedStatement insert(db, "INSERT INTO test VALUES(?, ?);");
+        for(int i = 0; i < 2000; i++) {
+            insert.bind(1, i);
+            insert.bind(2, "row with some padding to fill pages " + std::to_string(i));
+            insert.step();
+            insert.reset();
+        }
+        t.commit();
+    }
+    std::string path = ::testing::TempDir() + "engine_backup.db";
+    std::remove(path.c_str());
+    int steps = 0;
+    std::future<void> done = db->backup(path, 1, std::chrono::milliseconds(0), [&](const BackupProgress& p) {
+        // a write between steps must end up in the copy
+        if(++steps == 1 && p.remaining > 0)
+            db->execute("INSERT INTO test VALUES(9999, 'late');", "insert during backup");
+    });
+    ASSERT_NO_THROW(done.get());
+    ASSERT_GT(steps, 1);
+    {
+        DBEngine copy(path);
+        PreparedStatement count(&copy, "SELECT COUNT(*) FROM test;");
+        ASSERT_EQ(count.step(), ENGINE_ROW);
+        ASSERT_EQ(Row(count.get()).get<int>(0), 2001);
+    }
+    std::remove(path.c_str());
+    ASSERT_THROW(db->backup("/nonexistent/dir/backup.db").get(), BackupError);
+}
+TEST_F(DBEngineTest, BackupSchedulerKeepsNewestSnapshots) {
+    std::string dir = ::testing::TempDir() + "engine_snapshots";
+    std::filesystem::remove_all(dir);
+    BackupScheduler scheduler(db, dir, std::chrono::seconds(3600), 2);
+    std::string first = scheduler.snapshot();
+    scheduler.snapshot();
+    std::string last = scheduler.snapshot();
+    std::vector<std::string> kept = scheduler.snapshots();
+    std::filesystem::remove_all(dir);
+    ASSERT_EQ(kept.size(), 2u);
+    ASSERT_EQ(kept.back(), last);
+    ASSERT_NE(kept.front(), first);
+    ASSERT_THROW(BackupScheduler(db, dir, std::chrono::seconds(3600), 0), ConfigError);
+}
+
+/*
+ * Config tests
+ */
+TEST(DBConfigTest, ShouldApplyAndReadBackSettings) {
+    std::string path = ::testing::TempDir() + "engine_config.db";
+    std::remove(path.c_str());
+    {
+        DBEngine db(path, false, 16, DBConfig::preset("bulk-load"));
+        ASSERT_EQ(db.config().journalMode, "WAL");
+        ASSERT_EQ(db.config().synchronous, "OFF");
+        ASSERT_EQ(db.config().cacheSize, DBConfig::bulkLoad().cacheSize);
+        ASSERT_EQ(db.config().tempStore, "MEMORY");
+        ASSERT_EQ(db.config().autoVacuum, "INCREMENTAL");
+        ASSERT_TRUE(db.config().foreignKeys);
+
+        // foreign keys are enforced, so cascades run
+        db.execute("CREATE TABLE parent (id INTEGER PRIMARY KEY);", "create parent");
+        db.execute("CREATE TABLE child (pid INTEGER REFERENCES parent(id) ON DELETE CASCADE);", "create child");
+        db.execute("INSERT INTO parent VALUES(1); INSERT INTO child VALUES(1);", "insert rows");
+        ASSERT_EQ(db.execute("INSERT INTO child VALUES(2);", "insert orphan"), ENGINE_ERROR);
+        db.execute("DELETE FROM parent;", "delete parent");
+        PreparedStatement count(&db, "SELECT COUNT(*) FROM child;");
+        ASSERT_EQ(count.step(), ENGINE_ROW);
+        ASSERT_EQ(Row(count.get()).get<int>(0), 0);
+    }
+    std::remove(path.c_str());
+    std::remove((path + "-wal").c_str());
+    std::remove((path + "-shm").c_str());
+
+    ASSERT_THROW(DBConfig::preset("fast"), ConfigError);
+    DBConfig bad;
+    bad.journalMode = "SOMETIMES";
+    ASSERT_THROW(DBEngine(":memory:", false, 16, bad), ConfigError);
+}
+
+/*
+ * Maintenance tests
+ */
+TEST(MaintenanceTest, TasksRunOnTheirTriggersWithinBudget) {
+    std::string path = ::testing::TempDir() + "engine_maintenance.db";
+    for(const char* suffix : {"", "-wal", "-shm"})
+        std::remove((path + suffix).c_str());
+    {
+        DBEngine db(path);
+        db.execute("CREATE TABLE item (id INTEGER PRIMARY KEY, kind INT); CREATE INDEX item_kind ON item(kind);", "create");
+        db.execute("WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < 5000) "
+                   "INSERT INTO item SELECT i, i % 7 FROM n;", "fill");
+
+        // just written to: the idle tasks wait, the checkpoint truncates a WAL over its limit
+        MaintenanceScheduler maintenance(&db, std::chrono::seconds(3600));
+        maintenance.addDefaults(10);
+        maintenance.runDue();
+        std::vector<MaintenanceStats> stats = maintenance.stats();
+        ASSERT_EQ(stats.size(), 3u);
+        ASSERT_EQ(stats[0].runs, 0u);
+        ASSERT_EQ(stats[1].completed, 1u);
+        ASSERT_NE(stats[1].lastResult.find("truncated"), std::string::npos);
+        ASSERT_EQ(stats[2].runs, 0u);
+        ASSERT_EQ(std::filesystem::file_size(path + "-wal"), 0u);
+
+        // run() ignores the triggers. Statistics written by the maintenance connection are used by all
+        ASSERT_TRUE(maintenance.run("optimize"));
+        {
+            PreparedStatement analyzed(&db, "SELECT COUNT(*) FROM sqlite_stat1 WHERE idx = 'item_kind';");
+            ASSERT_EQ(analyzed.step(), ENGINE_ROW);
+            ASSERT_EQ(Row(analyzed.get()).get<int>(0), 1);
+        }
+        ASSERT_TRUE(maintenance.run("quick_check"));
+        ASSERT_EQ(maintenance.stats()[2].lastResult, "ok");
+        ASSERT_THROW(maintenance.run("defragment"), ConfigError);
+
+        // SQL that outlives the budget is interrupted, that is no failure
+        maintenance.add("endless", std::chrono::hours(1), std::chrono::milliseconds(20), [](MaintenanceContext& ctx) {
+            PreparedStatement count(ctx.conn, "WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n) SELECT COUNT(*) FROM n;");
+            return count.step() == ENGINE_ROW;
+        });
+        maintenance.add("broken", std::chrono::hours(1), std::chrono::milliseconds(20), [](MaintenanceContext&) -> bool {
+            throw std::runtime_error("broken");
+        });
+        ASSERT_FALSE(maintenance.run("endless"));
+        ASSERT_FALSE(maintenance.run("broken"));
+        stats = maintenance.stats();
+        ASSERT_EQ(stats[3].failures, 0u);
+        ASSERT_EQ(stats[3].lastResult, "budget exhausted");
+        ASSERT_LT(stats[3].lastDuration, std::chrono::seconds(1));
+        ASSERT_EQ(stats[4].failures, 1u);
+        ASSERT_EQ(stats[4].lastResult, "broken");
+
+        // idle at once: every default task is due on the first tick, then not until its interval
+        MaintenanceScheduler quiet(&db, std::chrono::seconds(0));
+        quiet.addDefaults();
+        quiet.runDue();
+        quiet.runDue();
+        for(const MaintenanceStats& s : quiet.stats())
+            ASSERT_EQ(s.runs, 1u) << s.task;
+    }
+    for(const char* suffix : {"", "-wal", "-shm"})
+        std::remove((path + suffix).c_str());
+
+    DBEngine memory(":memory:");
+    ASSERT_THROW(MaintenanceScheduler m(&memory), ConfigError);
+}
+
+/*
+ * Busy handling tests
+ */
+TEST(BusyPolicyTest, ShouldBackOffUntilLockIsReleased) {
+    std::string path = ::testing::TempDir() + "engine_busy.db";
+    std::remove(path.c_str());
+    DBConfig config;
+    config.busyTimeout = 0;                 // no waiting inside SQLite, only the engine's backoff
+    config.busy.maxRetries = 50;
+    config.busy.initialBackoffMs = 1;
+    config.busy.maxBackoffMs = 20;
+    DBEngine writer(path, false, 16, config);
+    DBEngine other(path, false, 16, config);
+    writer.execute("CREATE TABLE test (id INT);", "create test table");
+
+    writer.begin();
+    writer.execute("INSERT INTO test VALUES(1);", "insert");
+    std::thread release([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        writer.commit();
+    });
+    // blocked by writer until it commits, then succeeds
+    ASSERT_EQ(other.execute("INSERT INTO test VALUES(2);", "insert"), ENGINE_OK);
+    release.join();
+    ASSERT_GT(other.busyStats().retries, 0u);
+    ASSERT_GT(other.busyStats().waitedMicros, 0u);
+    ASSERT_EQ(other.busyStats().failures, 0u);
+
+    // statements before the busy one have committed and don't run again
+    other.execute("CREATE TEMP TABLE seen (id INT);", "create temp table");
+    writer.begin();
+    writer.execute("INSERT INTO test VALUES(4);", "insert");
+    std::thread resume([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        writer.commit();
+    });
+    ASSERT_EQ(other.execute("INSERT INTO temp.seen VALUES(1); INSERT INTO test VALUES(5);", "insert both"), ENGINE_OK);
+    resume.join();
+    PreparedStatement seen(&other, "SELECT COUNT(*) FROM temp.seen;");
+    ASSERT_EQ(seen.step(), ENGINE_ROW);
+    ASSERT_EQ(Row(seen.get()).get<int>(0), 1);
+
+    DBConfig impatient = config;
+    impatient.busy.maxRetries = 0;
+    DBEngine third(path, false, 16, impatient);
+    writer.begin();
+    ASSERT_THROW(third.begin(), BusyError);
+    PreparedStatement insert(&third, "INSERT INTO test VALUES(3);");
+    ASSERT_THROW(insert.step(), BusyError);
+    ASSERT_EQ(third.busyStats().failures, 2u);
+    writer.rollback();
+    std::remove(path.c_str());
+    std::remove((path + "-wal").c_str());
+    std::remove((path + "-shm").c_str());
+}
+
+TEST_F(DBEngineTest, NestedTransactionShouldRollBackAlone) {
+    std::vector<ChangeBatch> received;
+    int id = db->subscribe([&](const ChangeBatch& batch) { received.push_back(batch); });
+    {
+        Transaction outer(db);
+        db->execute("INSERT INTO test VALUES(1, 'kept');", "insert into test table");
+        {
+            Transaction inner(db);
+            ASSERT_EQ(db->depth(), 1u);
+            db->execute("INSERT INTO test VALUES(2, 'undone');", "insert into test table");
+        }
+        ASSERT_EQ(db->depth(), 0u);
+        {
+            Savepoint sp(db);
+            db->execute("INSERT INTO test VALUES(3, 'released');", "insert into test table");
+            sp.release();
+        }
+        outer.commit();
+    }
+    db->unsubscribe(id);
+    ASSERT_THROW(Savepoint sp(db), TransactionError);
+
+    PreparedStatement count(db, "SELECT COUNT(*) FROM test;");
+    ASSERT_EQ(count.step(), ENGINE_ROW);
+    ASSERT_EQ(Row(count.get()).get<int>(0), 2);
+    // one commit, and the rolled back insert is not reported
+    ASSERT_EQ(received.size(), 1u);
+    ASSERT_EQ(received[0].size(), 2u);
+    ASSERT_EQ(received[0][0].rowid, 1);
+    ASSERT_EQ(received[0][1].rowid, 2);     // reuses the undone row's rowid
+}
+
+TEST(TransactionModeTest, ReadOnlySnapshotShouldNotSeeLaterCommits) {
+    std::string path = ::testing::TempDir() + "engine_modes.db";
+    std::remove(path.c_str());
+    {
+        DBEngine writer(path);
+        DBEngine reader(path);
+        writer.execute("CREATE TABLE test (id INT);", "create test table");
+        writer.execute("INSERT INTO test VALUES(1);", "insert");
+        auto count = [&]() {
+            PreparedStatement stmt(&reader, "SELECT COUNT(*) FROM test;");
+            stmt.step();
+            return Row(stmt.get()).get<int>(0);
+        };
+        {
+            Transaction snapshot(&reader, TransactionMode::READ_ONLY_SNAPSHOT);
+            ASSERT_TRUE(reader.isReadOnly());
+            {
+                Transaction tx(&writer, TransactionMode::EXCLUSIVE);
+                writer.execute("INSERT INTO test VALUES(2);", "insert");
+                tx.commit();
+            }
+            ASSERT_EQ(count(), 1);
+            ASSERT_EQ(reader.execute("INSERT INTO test VALUES(3);", "write in snapshot"), ENGINE_ERROR);
+            snapshot.commit();
+        }
+        ASSERT_FALSE(reader.isReadOnly());
+        ASSERT_EQ(count(), 2);
+        {
+            Transaction tx(&reader, TransactionMode::DEFERRED);
+            ASSERT_EQ(reader.execute("INSERT INTO test VALUES(3);", "insert"), ENGINE_OK);
+            tx.commit();
+        }
+        ASSERT_EQ(count(), 3);
+    }
+    std::remove(path.c_str());
+    std::remove((path + "-wal").c_str());
+    std::remove((path + "-shm").c_str());
+}
+
+TEST_F(DBEngineTest, TypedQueryShouldBindAndDecode) {
+    static_assert(countParameters("SELECT '?', \"a?\" FROM t WHERE x = ? -- ?\n AND y = ? /* ? */") == 2);
+    static constexpr Query<Params<int, std::string>, Columns<>> insert("INSERT INTO test VALUES(?, ?);");
+    static constexpr Query<Params<int>, Columns<int, std::string>> select(
+        "SELECT id, name FROM test WHERE id >= ? ORDER BY id;");
+    static constexpr Query<Params<std::optional<int>, std::string>, Columns<std::optional<int>>> nullable(
+        "SELECT id FROM test WHERE id IS ? OR name = ?;");
+
+    struct Named {
+        int id;
+        std::string name;
+    };
+    insert.exec(db, 1, "bob");
+    std::string alice = "alice";
+    insert.exec(db, 2, alice);
+    insert.exec(db, 3, std::string_view("carol, with a comma").substr(0, 5));
+
+    std::vector<std::tuple<int, std::string>> rows = select.all(db, 2);
+    ASSERT_EQ(rows.size(), 2);
+    ASSERT_EQ(std::get<1>(rows[0]), "alice");
+    std::vector<Named> named = select.all<Named>(db, 1);
+    ASSERT_EQ(named.size(), 3);
+    ASSERT_EQ(named[2].name, "carol");
+    ASSERT_FALSE(select.one(db, 4).has_value());
+
+    std::optional<std::tuple<std::optional<int>>> found = nullable.one(db, std::nullopt, "bob");
+    ASSERT_TRUE(found.has_value());
+    ASSERT_EQ(std::get<0>(*found), 1);
+
+    // the declared columns must match what the statement returns
+    static constexpr Query<Params<>, Columns<int>> wrongColumns("SELECT id, name FROM test;");
+    ASSERT_THROW(wrongColumns.all(db), SyntaxError);
+
+    // a refused write throws instead of counting as a row (SQLITE_READONLY == ENGINE_ROW)
+    static constexpr Query<Params<int, std::string>, Columns<int>> returning("INSERT INTO test VALUES(?, ?) RETURNING id;");
+    db->execute("PRAGMA query_only = ON;", "read only");
+    EXPECT_THROW(insert.exec(db, 4, "dave"), DatabaseException);
+    EXPECT_THROW(returning.one(db, 4, "dave"), DatabaseException);
+    db->execute("PRAGMA query_only = OFF;", "writable");
+    ASSERT_EQ(returning.one(db, 4, "dave"), std::make_optional(std::make_tuple(4)));
+}
+
+TEST_F(DBEngineTest, StaticBindShouldNotCopyAndCheckLifetime) {
+    std::string name = "bob";
+    {
+        PreparedStatement insert(db, "INSERT INTO test VALUES(?, ?);");
+        insert.bind(1, 1);
+        insert.bindStatic(2, name);
+        ASSERT_EQ(insert.step(), SQLITE_DONE);
+        insert.reset();
+        insert.bind(1, 2);
+        insert.bindStatic(2, std::string_view());
+        ASSERT_EQ(insert.step(), SQLITE_DONE);
+    }
+    PreparedStatement select(db, "SELECT name FROM test ORDER BY id;");
+    ASSERT_EQ(select.step(), ENGINE_ROW);
+    ASSERT_EQ(Row(select.get()).get<std::string>(0), "bob");
+    ASSERT_EQ(select.step(), ENGINE_ROW);
+    ASSERT_EQ(sqlite3_column_type(select.get(), 0), SQLITE_TEXT);    // empty, not NULL
+    select.reset();
+
+#ifndef NDEBUG
+    PreparedStatement insert(db, "INSERT INTO test VALUES(?, ?);");
+    insert.bind(1, 3);
+    insert.bindStatic(2, name);
+    name[0] = 'B';
+    ASSERT_THROW(insert.step(), StatementStateError);
+    // a copying bind replaces the static one
+    insert.bind(2, name);
+    ASSERT_EQ(insert.step(), SQLITE_DONE);
+#endif
+}
+
+TEST_F(DBEngineTest, TryApiShouldReportErrorsWithoutThrowing) {
+    Expected<PreparedStatement> bad = PreparedStatement::tryPrepare(db, "INSERT INTO test ID VALUES(?, ?);");
+    ASSERT_FALSE(bad.ok());
+    ASSERT_EQ(bad.status().code, ENGINE_SYNTAX_ERROR);
+
+    Expected<PreparedStatement> insert = PreparedStatement::tryPrepare(db, "INSERT INTO test VALUES(?, ?);");
+    ASSERT_TRUE(insert.ok());
+    ASSERT_EQ(insert->tryBind(3, 1).code, ENGINE_RANGE);
+    ASSERT_TRUE(insert->tryBind(1, 1).ok());
+    ASSERT_TRUE(insert->tryBind(2).ok());     // name is NOT NULL
+    Status status = insert->tryStep();
+    ASSERT_EQ(status.code, ENGINE_CONSTRAINT);
+    ASSERT_EQ(status.rc, SQLITE_CONSTRAINT);
+
+    // the failed step reset the statement, it can be rebound and run
+    ASSERT_TRUE(insert->tryBind(2, std::string("bob")).ok());
+    ASSERT_TRUE(insert->tryStep().ok());
+    ASSERT_EQ(insert->tryBind(1, 2).code, ENGINE_STATE_ERROR);
+    ASSERT_THROW(insert->throwIfError(insert->tryBind(1, 2)), StatementStateError);
+
+    PreparedStatement select(db, "SELECT COUNT(*) FROM test;");
+    ASSERT_TRUE(select.tryStep().row());
+    ASSERT_EQ(Row(select.get()).get<int>(0), 1);
+
+    // SQLITE_READONLY has the value of ENGINE_ROW, it must not pass for a row
+    db->execute("PRAGMA query_only = ON;", "read only");
+    PreparedStatement readOnly(db, "INSERT INTO test VALUES(3, 'carol');");
+    Status denied = readOnly.tryStep();
+    EXPECT_EQ(denied.code, ENGINE_STEP_ERROR);
+    EXPECT_EQ(denied.rc, SQLITE_READONLY);
+    EXPECT_THROW(readOnly.step(), DatabaseException);
+    db->execute("PRAGMA query_only = OFF;", "writable");
+}
+
 /*
  * Cache Tests
  *
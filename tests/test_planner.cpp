@@ -0,0 +1,892 @@
+#include <gtest/gtest.h>
+#include <algorithm>
+#include "../app.hpp"
+#include "../analytics.hpp"
+#include "../typeahead.hpp"
+#include "../importer.hpp"
+#include "../exporter.hpp"
+#include "../compactor.hpp"
+#include "../timerwheel.hpp"
+#include "../reminders.hpp"
+#include "../calendar.hpp"
+#include <sstream>
+#include <cstdio>
+#include <fstream>
+#include <atomic>
+#ifdef __linux__
+#include "../server.hpp"
+#include <unistd.h>
+#endif
+#include <thread>
+#include "../logger.hpp"
+
+using namespace App;
+
+class GiftPlannerTest :
+    public ::testing::Test {
+        protected:
+            GiftPlanner planner;
+
+            void SetUp() override {
+                Logger::enabled = false;
+                planner.init(":memory:");
+                planner.initialize_tables();
+                planner.addEvent(Event{0, "Christmas", "25-12-2025"});
+                planner.addRecipient(Recipient{0, "Alice", "Family"});
+            }
+    };
+
+TEST_F(GiftPlannerTest, EventWithGiftsRollsBackOnlyBadGifts) {
+    Gift good;
+    good.recipientId = 1;
+    good.name = "Kite";
+    good.price = 15.0;
+    Gift bad = good;
+    bad.recipientId = 42;       // no such recipient
+    Gift other = good;
+    other.name = "Yo-yo";
+    std::vector<size_t> rejected;
+    int eventId = planner.addEventWithGifts(Event{0, "Birthday", "01-06-2026"}, {good, bad, other}, &rejected);
+    ASSERT_EQ(eventId, 2);
+    ASSERT_EQ(rejected, std::vector<size_t>{1});
+    ASSERT_EQ(planner.fetchRecipientsAndGifts(eventId).size(), 2u);
+    ASSERT_EQ(planner.getEventCount(), 2);
+}
+
+TEST_F(GiftPlannerTest, UpsertsAreIdempotent) {
+    ASSERT_EQ(planner.upsertRecipient(Recipient{0, "Alice", "Family"}), 1);
+    int bob = planner.upsertRecipient(Recipient{0, "Bob", ""});
+    std::vector<int> ids = planner.upsertRecipients({{0, "Bob", ""}, {0, "Bob", "Friend"}, {0, "Alice", "Family"}});
+    ASSERT_EQ(ids.size(), 3u);
+    ASSERT_EQ(ids[0], bob);
+    ASSERT_NE(ids[1], bob);
+    ASSERT_EQ(ids[2], 1);
+    ASSERT_EQ(planner.getRecipientCount(), 3);
+
+    ASSERT_EQ(planner.upsertEvent(Event{0, "Christmas", "24-12-2025"}), 1);
+    ASSERT_EQ(planner.getEvents()[0].eventDate, "24-12-2025");
+
+    Gift gift;
+    gift.recipientId = 1;
+    gift.eventId = 1;
+    gift.name = "Scarf";
+    gift.price = 20.0;
+    int id = planner.upsertGift(gift);
+    gift.price = 18.0;
+    gift.status = GiftStatus::PURCHASED;
+    ASSERT_EQ(planner.upsertGifts({gift, gift}), (std::vector<int>{id, id}));
+    std::vector<RecipientGifts> gifts = planner.fetchRecipientsAndGifts(1);
+    ASSERT_EQ(gifts.size(), 1u);
+    ASSERT_DOUBLE_EQ(gifts[0].giftPrice, 18.0);
+    ASSERT_EQ(gifts[0].giftStatus, GiftStatus::PURCHASED);
+}
+
+TEST_F(GiftPlannerTest, AddsReturnTheStoredEntity) {
+    Recipient bob = planner.addRecipient(Recipient{0, "Bob", "Friend"});
+    ASSERT_EQ(bob.id, 2);
+    ASSERT_EQ(bob.name, "Bob");
+    Event birthday = planner.addEvent(Event{0, "Birthday", "01-06-2026"});
+    ASSERT_EQ(birthday.eventId, 2);
+
+    Gift gift;
+    gift.recipientId = bob.id;
+    gift.eventId = birthday.eventId;
+    gift.name = "Kite";
+    gift.price = 9.5;
+    Gift added = planner.addGift(gift);
+    std::vector<RecipientGifts> gifts = planner.fetchRecipientsAndGifts(birthday.eventId);
+    ASSERT_EQ(gifts.size(), 1u);
+    ASSERT_EQ(gifts[0].giftId, added.id);
+    ASSERT_EQ(added.name, "Kite");
+}
+
+TEST_F(GiftPlannerTest, BulkDeletesCascadeAndUpdatesBySet) {
+    int bob = planner.addRecipient(Recipient{0, "Bob", "Friend"}).id;
+    int birthday = planner.addEvent(Event{0, "Birthday", "01-06-2026"}).eventId;
+    std::vector<int> ids;
+    for(int i = 0; i < 10; i++) {
+        Gift g;
+        g.recipientId = i % 2 ? bob : 1;
+        g.eventId = i < 6 ? 1 : birthday;
+        g.name = "Gift " + std::to_string(i);
+        ids.push_back(planner.addGift(g).id);
+    }
+    ASSERT_EQ(planner.setGiftStatus({ids[0], ids[1], ids[1], 999}, GiftStatus::PURCHASED), 2);
+    ASSERT_EQ(planner.setGiftStatus({ids[0]}, GiftStatus::PURCHASED), 0);      // unchanged
+    ASSERT_EQ(planner.totalGiftsPurchased(), 2);
+    ASSERT_EQ(planner.moveGifts({ids[2]}, birthday), 1);
+    ASSERT_THROW(planner.moveGifts({ids[3]}, 999), Engine::ConstraintError);  // no such event
+
+    ASSERT_EQ(planner.deleteGifts({ids[0]}), 1);
+    // Bob's gifts go with him
+    ASSERT_EQ(planner.deleteRecipients({bob}), 1);
+    ASSERT_EQ(planner.getGiftCount(1), 1);          // Gift 4, Gift 2 moved away
+    ASSERT_EQ(planner.clearEventGifts({1, birthday}), 4);
+    ASSERT_EQ(planner.getGiftCount(1) + planner.getGiftCount(birthday), 0);
+    ASSERT_EQ(planner.deleteEvents({birthday}), 1);
+    ASSERT_EQ(planner.getEventCount(), 1);
+    ASSERT_EQ(planner.deleteGifts({}), 0);
+}
+
+TEST(GiftPlannerMigrationTest, DuplicatesMergeBeforeKeysAreCreated) {
+    Logger::enabled = false;
+    std::string path = ::testing::TempDir() + "planner_dedupe.db";
+    std::remove(path.c_str());
+    {
+        GiftPlanner planner;
+        planner.init(path);
+        planner.initialize_tables();
+        // a database from before the natural keys
+        Engine::DBEngine* db = planner.engine();
+        db->execute("DROP INDEX RECIPIENTS_KEY; DROP INDEX GIFTS_KEY;", "drop keys");
+        db->execute("INSERT INTO EVENTS(Name, Date) VALUES('Christmas', '25-12-2025');"
+                    "INSERT INTO RECIPIENTS(Name, Relationship) VALUES('Alice', NULL), ('Alice', ''), ('Bob', 'Friend');"
+                    "INSERT INTO GIFTS(RecipientID, EventID, Name) VALUES(1, 1, 'Book'), (2, 1, 'Book'), (2, 1, 'Mug'), (3, 1, 'Book');",
+                    "old rows");
+    }
+    GiftPlanner planner;
+    planner.init(path);
+    planner.initialize_tables();
+    ASSERT_EQ(planner.getRecipientCount(), 2);
+    std::vector<RecipientGifts> gifts = planner.fetchRecipientsAndGifts(1);
+    ASSERT_EQ(gifts.size(), 3u);
+    for(const RecipientGifts& g : gifts)
+        ASSERT_EQ(g.recipientId, g.recipientName == "Alice" ? 1 : 3);
+    ASSERT_THROW(planner.addRecipient(Recipient{0, "Bob", "Friend"}), Engine::ConstraintError);
+    std::remove(path.c_str());
+    std::remove((path + "-wal").c_str());
+    std::remove((path + "-shm").c_str());
+}
+
+TEST(GiftPlannerMigrationTest, DatesBecomeIsoOnce) {
+    Logger::enabled = false;
+    std::string path = ::testing::TempDir() + "planner_dates.db";
+    std::remove(path.c_str());
+    {
+        GiftPlanner planner;
+        planner.init(path);
+        planner.initialize_tables();
+        // a database from before ISO dates
+        Engine::DBEngine* db = planner.engine();
+        db->execute("DROP INDEX EVENTS_DATE;", "drop index");
+        db->execute("INSERT INTO EVENTS(Name, Date) VALUES('Christmas', '25-12-2025'), ('Easter', '05-04-2026');"
+                    "INSERT INTO RECIPIENTS(Name, Relationship) VALUES('Alice', '');"
+                    "INSERT INTO GIFTS(RecipientID, EventID, Name, Price, Status, Date) VALUES(1, 1, 'Book', '10', 2, '20-12-2025');",
+                    "old rows");
+    }
+    GiftPlanner planner;
+    planner.init(path);
+    planner.initialize_tables();
+    std::vector<Event> events = planner.getEventsBetween(Date{2025, 12, 1}, Date{2025, 12, 31});
+    ASSERT_EQ(events.size(), 1u);
+    ASSERT_EQ(events[0].eventDate, "25-12-2025");
+    Engine::PreparedStatement stmt(planner.engine(), "SELECT Date FROM EVENTS WHERE ID = 2;");
+    stmt.step();
+    ASSERT_EQ(Engine::Row(stmt.get()).get<std::string>(0), "2026-04-05");
+    ASSERT_EQ(planner.spendingTimeline().series(SeriesBucket::DAY).xs.front(), static_cast<float>(daysFromCivil(2025, 12, 20)));
+    std::remove(path.c_str());
+    std::remove((path + "-wal").c_str());
+    std::remove((path + "-shm").c_str());
+}
+
+TEST(GiftPlannerMigrationTest, RowsWithoutUsersBelongToTheFirst) {
+    Logger::enabled = false;
+    std::string path = ::testing::TempDir() + "planner_users.db";
+    for(const char* suffix : {"", "-wal", "-shm"})
+        std::remove((path + suffix).c_str());
+    {
+        // a database from before users: unique event names, keys and search index without UserID
+        Engine::DBEngine db(path);
+        db.execute("CREATE TABLE EVENTS(ID INTEGER PRIMARY KEY AUTOINCREMENT, Name TEXT NOT NULL UNIQUE, Date TEXT NOT NULL, DeletedAt INTEGER);"
+                   "CREATE TABLE RECIPIENTS(ID INTEGER PRIMARY KEY AUTOINCREMENT, Name TEXT NOT NULL, Relationship TEXT, DeletedAt INTEGER);"
+                   "CREATE TABLE GIFTS(ID INTEGER PRIMARY KEY AUTOINCREMENT, RecipientID INTEGER NOT NULL, EventID INTEGER NOT NULL, "
+                   "Name TEXT NOT NULL, Link TEXT, Budget TEXT, Price TEXT, Status INTEGER DEFAULT 0, Date TEXT, DeletedAt INTEGER, "
+                   "FOREIGN KEY(RecipientID) REFERENCES RECIPIENTS(ID) ON DELETE CASCADE, FOREIGN KEY(EventID) REFERENCES EVENTS(ID) ON DELETE CASCADE);"
+                   "CREATE TABLE USER(ID INTEGER PRIMARY KEY AUTOINCREMENT, Name TEXT, Budget INTEGER, MoneySpent TEXT, LeftToBuy INTEGER, GiftsBought INTEGER);"
+                   "CREATE UNIQUE INDEX RECIPIENTS_KEY ON RECIPIENTS(Name, Relationship);"
+                   "CREATE INDEX EVENTS_DATE ON EVENTS(Date) WHERE DeletedAt IS NULL;"
+                   "CREATE VIRTUAL TABLE SEARCH_INDEX USING fts5(Title, Detail);"
+                   "INSERT INTO USER(Name) VALUES('Alice');"
+                   "INSERT INTO EVENTS(Name, Date) VALUES('Christmas', '2025-12-25');"
+                   "INSERT INTO RECIPIENTS(Name, Relationship) VALUES('Alice', 'Family');"
+                   "INSERT INTO GIFTS(RecipientID, EventID, Name) VALUES(1, 1, 'Book');"
+                   "INSERT INTO GIFTS(RecipientID, EventID, Name, DeletedAt) VALUES(1, 1, 'Boots', 1);",
+                   "old schema");
+    }
+    GiftPlanner planner;
+    planner.init(path);
+    planner.initialize_tables();
+    // gifts survived the events table being rebuilt
+    ASSERT_EQ(planner.getEvents().size(), 1u);
+    ASSERT_EQ(planner.getGiftCount(1), 1);
+    ASSERT_EQ(planner.search("bo").size(), 1u);
+    int bob = planner.setup(User{0, "Bob"}).id;
+    planner.useUser(bob);
+    ASSERT_TRUE(planner.getEvents().empty());
+    ASSERT_GT(planner.addEvent(Event{0, "Christmas", "25-12-2025"}).eventId, 1);
+    Engine::PreparedStatement stmt(planner.engine(), "SELECT COUNT(*) FROM sqlite_master WHERE name IN ('EVENTS_KEY', 'GIFTS_OWNER_INSERT');");
+    stmt.step();
+    ASSERT_EQ(Engine::Row(stmt.get()).get<int>(0), 2);
+    for(const char* suffix : {"", "-wal", "-shm"})
+        std::remove((path + suffix).c_str());
+}
+
+TEST(GiftPlannerCompactionTest, DeletesAreTombstonesUntilCompacted) {
+    Logger::enabled = false;
+    std::string path = ::testing::TempDir() + "planner_compact.db";
+    for(const char* suffix : {"", "-wal", "-shm"})
+        std::remove((path + suffix).c_str());
+    {
+        GiftPlanner planner;
+        planner.init(path);
+        planner.initialize_tables();
+        ASSERT_EQ(planner.engine()->config().autoVacuum, "INCREMENTAL");
+        int christmas = planner.addEvent(Event{0, "Christmas", "25-12-2025"}).eventId;
+        int alice = planner.addRecipient(Recipient{0, "Alice", "Family"}).id;
+        std::vector<int> ids;
+        planner.batch([&]() {
+            for(int i = 0; i < 2000; i++) {
+                Gift g;
+                g.recipientId = alice;
+                g.eventId = christmas;
+                g.name = "Gift " + std::to_string(i);
+                g.link = std::string(200, 'x');
+                ids.push_back(planner.addGift(g).id);
+            }
+        });
+        ASSERT_EQ(planner.deleteGifts(std::vector<int>(ids.begin(), ids.end() - 1)), 1999);
+        ASSERT_EQ(planner.getGiftCount(christmas), 1);
+        ASSERT_EQ(planner.search("Gift").size(), 1u);
+        // adding a deleted gift again brings it back under its old ID, a live duplicate still fails
+        Gift again;
+        again.recipientId = alice;
+        again.eventId = christmas;
+        again.name = "Gift 0";
+        ASSERT_EQ(planner.addGift(again).id, ids[0]);
+        ASSERT_EQ(planner.search("Gift").size(), 2u);
+        ASSERT_THROW(planner.addGift(again), Engine::ConstraintError);
+        ASSERT_EQ(planner.deleteRecipients({alice}), 1);
+        ASSERT_EQ(planner.getRecipientCount(), 0);
+        ASSERT_EQ(planner.getGiftCount(christmas), 0);
+
+        // out of budget before the first batch
+        Compactor compactor(100);
+        CompactionStats none = compactor.compact(planner.engine(), std::chrono::steady_clock::now());
+        ASSERT_FALSE(none.complete);
+        ASSERT_EQ(none.purged, 0);
+
+        // scheduled, it runs on the maintenance connection
+        Engine::MaintenanceScheduler maintenance(planner.engine());
+        compactor.schedule(maintenance, std::chrono::seconds(3600), std::chrono::milliseconds(60000));
+        ASSERT_TRUE(maintenance.run("compact"));
+        CompactionStats stats = compactor.totals();
+        ASSERT_TRUE(stats.complete);
+        ASSERT_EQ(stats.purged, 2001);      // the gifts and Alice
+        ASSERT_GT(stats.pagesFreed, 0);
+        ASSERT_EQ(compactor.compact(planner.engine()).purged, 0);
+
+        // the planner's own connection sees the rows gone
+        Engine::PreparedStatement count(planner.engine(), "SELECT COUNT(*) FROM GIFTS;");
+        count.step();
+        ASSERT_EQ(Engine::Row(count.get()).get<int>(0), 0);
+    }
+    GiftPlanner memory;
+    memory.init(":memory:");
+    memory.initialize_tables();
+    memory.deleteRecipients({memory.addRecipient(Recipient{0, "Bob", ""}).id});
+    Compactor compactor;
+    ASSERT_EQ(compactor.compact(memory.engine()).purged, 1);
+    for(const char* suffix : {"", "-wal", "-shm"})
+        std::remove((path + suffix).c_str());
+}
+
+TEST_F(GiftPlannerTest, LiveGiftsKeepTheirParents) {
+    int bob = planner.addRecipient(Recipient{0, "Bob", "Friend"}).id;
+    ASSERT_EQ(planner.deleteRecipients({bob}), 1);
+    Gift kite;
+    kite.recipientId = bob;
+    kite.eventId = 1;
+    kite.name = "Kite";
+    ASSERT_THROW(planner.addGift(kite), Engine::ConstraintError);
+    ASSERT_THROW(planner.upsertGift(kite), Engine::ConstraintError);
+
+    // a deleted gift doesn't come back under its deleted event
+    int easter = planner.addEvent(Event{0, "Easter", "05-04-2026"}).eventId;
+    Gift egg;
+    egg.recipientId = 1;
+    egg.eventId = easter;
+    egg.name = "Egg";
+    planner.addGift(egg);
+    ASSERT_EQ(planner.deleteEvents({easter}), 1);
+    ASSERT_THROW(planner.addGift(egg), Engine::ConstraintError);
+
+    // databases from before the triggers may hold live gifts of deleted parents, compaction keeps both
+    Gift scarf;
+    scarf.recipientId = 1;
+    scarf.eventId = 1;
+    scarf.name = "Scarf";
+    planner.addGift(scarf);
+    ASSERT_EQ(planner.engine()->execute("UPDATE RECIPIENTS SET DeletedAt = 1 WHERE ID = 1;", "tombstone Alice"), Engine::ENGINE_OK);
+    Compactor compactor;
+    ASSERT_EQ(compactor.compact(planner.engine()).purged, 3);      // Bob, Easter and the egg
+    ASSERT_EQ(planner.getGiftCount(1), 1);
+}
+
+/*
+ * Analytics tests
+ */
+TEST(AnalyticsTest, CivilDateRoundTrip) {
+    ASSERT_EQ(daysFromCivil(1970, 1, 1), 0);
+    ASSERT_EQ(daysFromCivil(2024, 2, 29), 19782);
+    int y, m, d;
+    civilFromDays(19782, y, m, d);
+    ASSERT_EQ(y, 2024);
+    ASSERT_EQ(m, 2);
+    ASSERT_EQ(d, 29);
+}
+
+TEST(DateTest, ParsesAndFormatsBothLayouts) {
+    static_assert(parseDate("29-02-2024")->days() == 19782, "parsed at compile time");
+    static_assert(formatDate(Date{2025, 1, 9}).view() == "2025-01-09", "formatted at compile time");
+    ASSERT_EQ(parseDate("2025-12-25"), (Date{2025, 12, 25}));
+    ASSERT_EQ(parseDate("25/12/2025"), (Date{2025, 12, 25}));
+    ASSERT_FALSE(parseDate("29-02-2025"));
+    ASSERT_FALSE(parseDate("2025-13-01"));
+    ASSERT_FALSE(parseDate("25-12-25"));
+    ASSERT_FALSE(parseDate("2025-12/25"));
+    ASSERT_STREQ(formatDate(Date{2025, 12, 25}, DateFormat::DISPLAY).c_str(), "25-12-2025");
+    ASSERT_EQ(Date::fromDays(Date{2024, 12, 31}.days() + 1), (Date{2025, 1, 1}));
+    ASSERT_LT((Date{2024, 12, 31}), (Date{2025, 1, 1}));
+}
+
+TEST(AnalyticsTest, LTTBKeepsEndpointsAndLimit) {
+    std::vector<float> xs, ys;
+    for(int i = 0; i < 1000; i++) {
+        xs.push_back(static_cast<float>(i));
+        ys.push_back(i == 500 ? 100.0f : 1.0f);
+    }
+    Series out;
+    downsampleLTTB(xs.data(), ys.data(), xs.size(), 50, out);
+    ASSERT_EQ(out.size(), 50u);
+    ASSERT_EQ(out.xs.front(), 0.0f);
+    ASSERT_EQ(out.xs.back(), 999.0f);
+    // the spike must survive downsampling
+    ASSERT_NE(std::find(out.ys.begin(), out.ys.end(), 100.0f), out.ys.end());
+
+    downsampleLTTB(xs.data(), ys.data(), 10, 50, out);
+    ASSERT_EQ(out.size(), 10u);
+}
+
+TEST(AnalyticsTest, TimelineRollsUpWeeksAndMonths) {
+    SpendingTimeline timeline;
+    // 2024-01-30 (Tue), 2024-02-01 (Thu), 2024-03-15
+    std::vector<int> days = {daysFromCivil(2024, 1, 30), daysFromCivil(2024, 2, 1), daysFromCivil(2024, 3, 15)};
+    std::vector<double> amounts = {10.0, 5.0, 20.0};
+    timeline.load(days, amounts);
+
+    const Series& daily = timeline.series(SeriesBucket::DAY);
+    ASSERT_EQ(daily.size(), static_cast<size_t>(days.back() - days.front() + 1));
+    const Series& weekly = timeline.series(SeriesBucket::WEEK);
+    ASSERT_EQ(weekly.xs.front(), static_cast<float>(daysFromCivil(2024, 1, 29)));
+    ASSERT_FLOAT_EQ(weekly.ys.front(), 15.0f);
+    const Series& monthly = timeline.series(SeriesBucket::MONTH);
+    ASSERT_EQ(monthly.size(), 3u);
+    ASSERT_FLOAT_EQ(monthly.ys[0], 10.0f);
+    ASSERT_FLOAT_EQ(monthly.ys[1], 5.0f);
+    ASSERT_FLOAT_EQ(monthly.ys[2], 20.0f);
+    ASSERT_DOUBLE_EQ(timeline.total(), 35.0);
+    ASSERT_LE(timeline.plot(SeriesBucket::DAY, 8).size(), 8u);
+}
+
+TEST_F(GiftPlannerTest, EventsAreOrderedAndRangedByDate) {
+    planner.addEvent(Event{0, "Easter", "2026-04-05"});
+    Event birthday = planner.addEvent(Event{0, "Birthday", "01-06-2025"});
+    ASSERT_EQ(birthday.eventDate, "01-06-2025");
+    ASSERT_THROW(planner.addEvent(Event{0, "Nope", "31-06-2025"}), Engine::ConstraintError);
+
+    std::vector<Event> events = planner.getEvents();
+    ASSERT_EQ(events.size(), 3u);
+    ASSERT_EQ(events[0].eventName, "Birthday");
+    ASSERT_EQ(events[1].eventName, "Christmas");
+    ASSERT_EQ(events[2].eventDate, "05-04-2026");
+
+    events = planner.getEventsBetween(Date{2025, 12, 25}, Date{2026, 4, 5});
+    ASSERT_EQ(events.size(), 2u);
+    ASSERT_EQ(events[0].eventName, "Christmas");
+    planner.deleteEvents({events[0].eventId});
+    ASSERT_EQ(planner.getEventsBetween(Date{2025, 1, 1}, Date{2025, 12, 31}).size(), 1u);
+
+    Engine::PreparedStatement plan(planner.engine(), "EXPLAIN QUERY PLAN SELECT ID FROM EVENTS "
+                                                     "WHERE Date BETWEEN '2025-01-01' AND '2025-12-31' AND DeletedAt IS NULL ORDER BY Date;");
+    ASSERT_EQ(plan.step(), Engine::ENGINE_ROW);
+    ASSERT_NE(Engine::Row(plan.get()).get<std::string>(3).find("EVENTS_DATE"), std::string::npos);
+}
+
+TEST_F(GiftPlannerTest, CalendarCachesMonthsUntilEventsChange) {
+    planner.addEvent(Event{0, "New Year", "01-01-2026"});
+    planner.addEvent(Event{0, "Boxing Day", "26-12-2025"});
+    EventCalendar calendar(planner, 2);
+
+    const std::vector<EventCalendar::Entry>& december = calendar.month(2025, 12);
+    ASSERT_EQ(december.size(), 2u);
+    ASSERT_EQ(december[0].event.eventName, "Christmas");
+    ASSERT_EQ(december[1].date, (Date{2025, 12, 26}));
+    ASSERT_EQ(calendar.month(2026, 1).size(), 1u);
+    ASSERT_EQ(calendar.month(2025, 12).size(), 2u);
+    ASSERT_EQ(calendar.loads(), 2u);
+
+    // across the year boundary from the cached months, then a third month evicts December
+    std::vector<EventCalendar::Entry> agenda = calendar.agenda(Date{2025, 12, 26}, 7);
+    ASSERT_EQ(agenda.size(), 2u);
+    ASSERT_EQ(agenda[1].event.eventName, "New Year");
+    ASSERT_EQ(calendar.loads(), 2u);
+    ASSERT_TRUE(calendar.month(2026, 2).empty());
+    ASSERT_EQ(calendar.cached(), 2u);
+    calendar.month(2026, 1);
+    ASSERT_EQ(calendar.loads(), 3u);
+    calendar.month(2025, 12);
+    ASSERT_EQ(calendar.loads(), 4u);
+
+    // a new event drops the cache, only the month asked for is read again
+    planner.addEvent(Event{0, "Epiphany", "06-01-2026"});
+    ASSERT_EQ(calendar.month(2026, 1).size(), 2u);
+    ASSERT_EQ(calendar.cached(), 1u);
+    ASSERT_EQ(calendar.loads(), 5u);
+}
+
+TEST_F(GiftPlannerTest, WritesInsideReadThrow) {
+    ASSERT_THROW(planner.read([&]() { planner.addRecipient(Recipient{0, "Bob", "Friend"}); }), Engine::DatabaseException);
+    ASSERT_THROW(planner.read([&]() { planner.deleteEvents({1}); }), Engine::DatabaseException);
+    ASSERT_FALSE(planner.engine()->isReadOnly());
+    ASSERT_EQ(planner.getRecipientCount(), 1);
+    ASSERT_EQ(planner.getEventCount(), 1);
+    planner.addRecipient(Recipient{0, "Bob", "Friend"});
+    ASSERT_EQ(planner.getRecipientCount(), 2);
+}
+
+TEST_F(GiftPlannerTest, SpendingTimelineCountsPurchases) {
+    Gift g;
+    g.recipientId = 1;
+    g.eventId = 1;
+    g.name = "Scarf";
+    g.price = 25.0;
+    planner.addGift(g);
+    ASSERT_TRUE(planner.spendingTimeline().empty());
+    planner.markGiftAsPurchased(1);
+    ASSERT_DOUBLE_EQ(planner.spendingTimeline().total(), 25.0);
+
+    // a mistyped year stays out of the dense series instead of stretching it over millennia
+    g.name = "Gloves";
+    int gloves = planner.upsertGift(g);
+    planner.markGiftAsPurchased(gloves);
+    ASSERT_EQ(planner.engine()->execute("UPDATE GIFTS SET Date = '0025-12-20' WHERE ID = " + std::to_string(gloves) + ";", "typo"), Engine::ENGINE_OK);
+    ASSERT_DOUBLE_EQ(planner.spendingTimeline().total(), 25.0);
+    ASSERT_EQ(planner.spendingTimeline().series(SeriesBucket::DAY).size(), 1u);
+}
+
+/*
+ * Search tests
+ */
+TEST_F(GiftPlannerTest, SearchMatchesPrefixesAcrossTables) {
+    Gift g;
+    g.recipientId = 1;
+    g.eventId = 1;
+    g.name = "Christmas jumper";
+    g.link = "shop.example";
+    g.price = 30.0;
+    planner.addGift(g);
+
+    std::vector<SearchResult> results = planner.search("chris");
+    ASSERT_EQ(results.size(), 2u);
+    results = planner.search("ali fam");
+    ASSERT_EQ(results.size(), 1u);
+    ASSERT_EQ(results[0].kind, SearchKind::RECIPIENT);
+    ASSERT_EQ(results[0].id, 1);
+    ASSERT_EQ(results[0].title, "Alice");
+    ASSERT_TRUE(planner.search("  ").empty());
+    ASSERT_EQ(planner.search("jump", 1).size(), 1u);
+}
+
+TEST_F(GiftPlannerTest, SearchRanksEveryMatch) {
+    // the best match is older than many weaker ones
+    int scarf = planner.addRecipient(Recipient{0, "Scarf", "Friend"}).id;
+    planner.batch([&]() {
+        for(int i = 0; i < 1500; i++) {
+            Gift g;
+            g.recipientId = 1;
+            g.eventId = 1;
+            g.name = "Gift " + std::to_string(i);
+            g.link = "scarf.example";
+            planner.addGift(g);
+        }
+    });
+    std::vector<SearchResult> results = planner.search("scarf", 1);
+    ASSERT_EQ(results.size(), 1u);
+    ASSERT_EQ(results[0].kind, SearchKind::RECIPIENT);
+    ASSERT_EQ(results[0].id, scarf);
+}
+
+TEST_F(GiftPlannerTest, UsersSeeOnlyTheirOwnRows) {
+    Gift g;
+    g.recipientId = 1;
+    g.eventId = 1;
+    g.name = "Christmas jumper";
+    g.price = 30.0;
+    g.status = GiftStatus::PURCHASED;
+    int jumper = planner.addGift(g).id;
+    ASSERT_EQ(planner.spendingTimeline().total(), 30.0);
+
+    ASSERT_EQ(planner.setup(User{0, "Me"}).id, planner.currentUser());
+    User bob = planner.setup(User{0, "Bob"});
+    ASSERT_EQ(planner.currentUser(), 1);
+    planner.useUser(bob.id);
+    ASSERT_EQ(planner.getUserData().name, "Bob");
+    ASSERT_THROW(planner.useUser(bob.id + 1), Engine::ConstraintError);
+    ASSERT_EQ(planner.currentUser(), bob.id);
+
+    // names are unique per user
+    int christmas = planner.addEvent(Event{0, "Christmas", "25-12-2025"}).eventId;
+    ASSERT_NE(christmas, 1);
+    ASSERT_EQ(planner.getEvents().size(), 1u);
+    ASSERT_EQ(planner.getRecipientCount(), 0);
+    ASSERT_TRUE(planner.fetchRecipientsAndGifts(1).empty());
+    ASSERT_EQ(planner.search("chris").size(), 1u);
+    ASSERT_EQ(planner.spendingTimeline().total(), 0.0);
+
+    // another user's IDs change nothing, and can't be referred to
+    ASSERT_EQ(planner.deleteGifts({jumper}), 0);
+    ASSERT_EQ(planner.deleteEvents({1}), 0);
+    g.eventId = christmas;
+    ASSERT_THROW(planner.addGift(g), Engine::ConstraintError);
+    ASSERT_THROW(planner.remindBeforeEvent(1, std::chrono::hours(24), ""), Engine::ConstraintError);
+
+    planner.useUser(1);
+    ASSERT_EQ(planner.getGiftCount(1), 1);
+    ASSERT_EQ(planner.search("chris").size(), 2u);
+    ASSERT_EQ(planner.spendingTimeline().total(), 30.0);
+    ASSERT_EQ(planner.getUsers().size(), 2u);
+}
+
+TEST(TypeAheadTest, NarrowsCompleteResultsWithoutQuerying) {
+    std::atomic<int> calls{0};
+    TypeAhead search([&](const std::string&, int) {
+        calls++;
+        return std::vector<SearchResult>{
+            SearchResult{SearchKind::RECIPIENT, 1, "Alice", "Family", 0.0},
+            SearchResult{SearchKind::RECIPIENT, 2, "Alan", "Work", 0.0}};
+    }, 10, std::chrono::milliseconds(0));
+
+    ASSERT_FALSE(search.update(""));
+    search.update("al");
+    for(int i = 0; i < 200 && search.pending(); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        search.update("al");
+    }
+    ASSERT_EQ(search.results().size(), 2u);
+    ASSERT_EQ(calls.load(), 1);
+
+    // extending the query filters in memory
+    ASSERT_TRUE(search.update("ali"));
+    ASSERT_FALSE(search.pending());
+    ASSERT_EQ(search.results().size(), 1u);
+    ASSERT_EQ(search.results()[0].title, "Alice");
+    ASSERT_FALSE(search.update("ali"));
+    ASSERT_EQ(calls.load(), 1);
+
+    // a different query goes back to the worker
+    search.update("bob");
+    for(int i = 0; i < 200 && search.pending(); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        search.update("bob");
+    }
+    ASSERT_EQ(calls.load(), 2);
+
+    // invalidate() drops the results at once and asks again for the same input
+    search.invalidate();
+    ASSERT_TRUE(search.results().empty());
+    ASSERT_TRUE(search.pending());
+    for(int i = 0; i < 200 && search.pending(); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        search.update("bob");
+    }
+    ASSERT_EQ(calls.load(), 3);
+    ASSERT_EQ(search.results().size(), 2u);
+}
+
+TEST(TypeAheadTest, AsksTheIndexForNonAsciiText) {
+    std::atomic<int> calls{0};
+    TypeAhead search([&](const std::string&, int) {
+        calls++;
+        return std::vector<SearchResult>{SearchResult{SearchKind::GIFT, 1, "Caf\xc3\xa9 voucher", "", 0.0}};
+    }, 10, std::chrono::milliseconds(0));
+    auto settle = [&](const std::string& input) {
+        search.update(input);
+        for(int i = 0; i < 200 && search.pending(); i++) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            search.update(input);
+        }
+    };
+    settle("caf");
+    ASSERT_EQ(calls.load(), 1);
+    // the index folds the accent and still matches, a local filter would drop the result
+    settle("cafe");
+    ASSERT_EQ(calls.load(), 2);
+    ASSERT_EQ(search.results().size(), 1u);
+}
+
+/*
+ * Import tests
+ */
+TEST_F(GiftPlannerTest, ImportResolvesNamesAndQuotedFields) {
+    std::string path = ::testing::TempDir() + "gifts_import.csv";
+    {
+        std::ofstream csv(path, std::ios::binary);
+        csv << "Name,Recipient,Event,Price,Status,Link,Event_Date\r\n"
+               "\"Book, signed\",Alice,Christmas,12.5,purchased,,\n"
+               "\"Mug \"\"XL\"\"\nwith lid\",Bob,Birthday,8,1,shop.example,14-03-2026\n"
+               "\n"
+               "Socks,Alice,Christmas,cheap,idea,,\n"
+               ",Alice,Christmas,1,idea,,\n"
+               "Kite,Alice,Easter,5,idea,,\n";
+    }
+    CsvImporter importer(planner, 2, 1);
+    ImportStats stats = importer.importFile(ImportKind::GIFTS, path);
+    std::remove(path.c_str());
+
+    ASSERT_EQ(stats.rows, 5u);
+    ASSERT_EQ(stats.inserted, 2u);
+    ASSERT_EQ(stats.skipped, 3u);
+    ASSERT_EQ(stats.errors.size(), 3u);
+    // a new event needs its date
+    ASSERT_NE(stats.errors[2].find("missing event date"), std::string::npos);
+    ASSERT_EQ(planner.getEvents().size(), 2u);
+    ASSERT_EQ(stats.recipientsCreated, 1u);
+    ASSERT_EQ(stats.eventsCreated, 1u);
+    ASSERT_EQ(planner.getRecipientCount(), 2);
+    ASSERT_EQ(planner.totalGiftsPurchased(), 1);
+
+    std::vector<RecipientGifts> gifts = planner.fetchRecipientsAndGifts(2);
+    ASSERT_EQ(gifts.size(), 1u);
+    ASSERT_EQ(gifts[0].giftName, "Mug \"XL\"\nwith lid");
+    ASSERT_EQ(gifts[0].recipientName, "Bob");
+    ASSERT_EQ(gifts[0].giftStatus, GiftStatus::ORDERED);
+    // imported rows are searchable
+    ASSERT_EQ(planner.search("mug").size(), 1u);
+    ASSERT_EQ(planner.search("bob").size(), 1u);
+}
+
+/*
+ * Export tests
+ */
+TEST_F(GiftPlannerTest, ExportEscapesAndRoundTrips) {
+    Gift g;
+    g.recipientId = 1;
+    g.eventId = 1;
+    g.name = "Book \"Dune\", signed";
+    g.price = 12.5;
+    planner.addGift(g);
+    planner.markGiftAsPurchased(1);
+
+    Exporter exporter(planner, 16);
+    std::ostringstream json;
+    ASSERT_EQ(exporter.exportTo(json, ExportKind::GIFTS, ExportFormat::NDJSON), 1u);
+    ASSERT_NE(json.str().find("\"name\":\"Book \\\"Dune\\\", signed\""), std::string::npos);
+    ASSERT_NE(json.str().find("\"price\":12.5,"), std::string::npos);
+    ASSERT_NE(json.str().find("\"link\":\"\""), std::string::npos);
+
+    std::string path = ::testing::TempDir() + "gifts_export.csv";
+    ASSERT_EQ(exporter.exportFile(path, ExportKind::GIFTS, ExportFormat::CSV), 1u);
+    GiftPlanner copy;
+    copy.init(":memory:");
+    copy.initialize_tables();
+    ImportStats stats = CsvImporter(copy).importFile(ImportKind::GIFTS, path);
+    std::remove(path.c_str());
+    ASSERT_EQ(stats.inserted, 1u);
+    std::vector<RecipientGifts> gifts = copy.fetchRecipientsAndGifts(1);
+    ASSERT_EQ(gifts.size(), 1u);
+    ASSERT_EQ(gifts[0].giftName, g.name);
+    ASSERT_EQ(gifts[0].recipientName, "Alice");
+    ASSERT_EQ(gifts[0].eventDate, "25-12-2025");
+    ASSERT_EQ(gifts[0].giftStatus, GiftStatus::PURCHASED);
+    ASSERT_DOUBLE_EQ(gifts[0].giftPrice, 12.5);
+}
+
+/*
+ * Reminder tests
+ */
+TEST(TimerWheelTest, FiresInDueOrderAcrossLevels) {
+    const std::int64_t start = 1700000000;
+    TimerWheel wheel(start);
+    std::vector<int> fired;
+    // level 0, 1, 2 and far future, scheduled out of order
+    const std::int64_t offsets[] = {4000, 5, 63, 64, 300000, 1LL << 40, 70};
+    for(int i = 0; i < 7; i++)
+        wheel.schedule(start + offsets[i], [&fired, i]() { fired.push_back(i); });
+    TimerWheel::TimerId cancelled = wheel.schedule(start + 10, [&fired]() { fired.push_back(-1); });
+    wheel.schedule(start - 5, [&fired]() { fired.push_back(7); });   // already overdue
+    ASSERT_EQ(wheel.size(), 9u);
+    ASSERT_EQ(wheel.nextWake(), start);
+
+    ASSERT_TRUE(wheel.cancel(cancelled));
+    ASSERT_FALSE(wheel.cancel(cancelled));
+    ASSERT_EQ(wheel.advance(start), 1u);
+    ASSERT_EQ(wheel.nextWake(), start + 5);
+    ASSERT_EQ(wheel.advance(start + 4), 0u);
+
+    ASSERT_EQ(wheel.advance(start + 4000), 5u);
+    ASSERT_EQ(fired, (std::vector<int>{7, 1, 2, 3, 6, 0}));
+    ASSERT_EQ(wheel.now(), start + 4000);
+    // a cascade tick may come first, the timer itself fires exactly on time
+    ASSERT_EQ(wheel.advance(start + 299999), 0u);
+    ASSERT_EQ(wheel.advance(start + 300000), 1u);
+
+    // callbacks may schedule, a timer already due fires in the next advance()
+    wheel.schedule(start + 300001, [&]() { wheel.schedule(start + 300001, [&fired]() { fired.push_back(8); }); });
+    ASSERT_EQ(wheel.advance(start + 300001), 1u);
+    ASSERT_EQ(wheel.advance(start + 300001), 1u);
+    ASSERT_EQ(fired.back(), 8);
+    ASSERT_EQ(wheel.size(), 1u);
+    ASSERT_EQ(wheel.advance(start + (1LL << 40)), 1u);
+    ASSERT_FALSE(wheel.nextWake());
+}
+
+TEST_F(GiftPlannerTest, RemindersFollowTheirEventsAndFireOnce) {
+    Event christmas = planner.getEvents()[0];
+    Event birthday = planner.addEvent(Event{0, "Birthday", "01-01-2026"});
+    Reminder early = planner.remindBeforeEvent(christmas.eventId, std::chrono::hours(48), "Wrap presents");
+    Reminder named = planner.remindBeforeEvent(birthday.eventId, std::chrono::hours(0), "");
+    ASSERT_EQ(named.message, "Birthday");
+    ASSERT_EQ(named.dueAt - early.dueAt, 9 * 86400);
+    ASSERT_THROW(planner.remindBeforeEvent(999, std::chrono::hours(1), "x"), Engine::ConstraintError);
+
+    ReminderService reminders(planner);
+    std::vector<std::string> seen;
+    reminders.subscribe([&seen](const Reminder& r) { seen.push_back(r.message); });
+    ASSERT_EQ(reminders.poll(early.dueAt - 1), 0u);
+    ASSERT_EQ(reminders.nextWake(), early.dueAt);
+
+    // moving the event moves its reminder
+    planner.upsertEvent(Event{0, "Christmas", "26-12-2025"});
+    ASSERT_EQ(reminders.poll(early.dueAt), 0u);
+    ASSERT_EQ(reminders.poll(early.dueAt + 86400), 1u);
+    ASSERT_EQ(seen, (std::vector<std::string>{"Wrap presents"}));
+    ASSERT_EQ(reminders.pending(), 0u);
+
+    // a deleted event's reminder never comes due, fired ones don't come back
+    planner.deleteEvents({birthday.eventId});
+    reminders.invalidate();
+    ASSERT_EQ(reminders.poll(named.dueAt + 86400), 0u);
+    ASSERT_TRUE(planner.getPendingReminders(named.dueAt + 86400).empty());
+    ASSERT_EQ(seen.size(), 1u);
+}
+
+#ifdef __linux__
+/*
+ * RPC server tests
+ */
+TEST_F(GiftPlannerTest, ServerBatchesPipelinedWrites) {
+    std::string path = "/tmp/giftplanner_test_" + std::to_string(getpid()) + ".sock";
+    Rpc::Server server(planner, path);
+    server.listen();
+    std::thread loop([&]() { server.run(); });
+
+    Rpc::Client client;
+    client.connect(path);
+    Rpc::Writer w;
+    const int count = 200;
+    for(int i = 0; i < count; i++) {
+        encode(w, Recipient{0, "Person " + std::to_string(i), "Friend"});
+        client.send(Rpc::Op::ADD_RECIPIENT, w);
+    }
+    // duplicate event name fails alone, the rest of the batch still commits
+    encode(w, Event{0, "Christmas", "25-12-2025"});
+    client.send(Rpc::Op::ADD_EVENT, w);
+    for(int i = 0; i < count; i++) {
+        Rpc::Frame added = client.receive();
+        EXPECT_EQ(added.code, static_cast<uint8_t>(Rpc::Status::OK));
+        Rpc::Reader ar(added.payload.data(), added.payload.size());
+        Recipient r;
+        decode(ar, r);
+        EXPECT_EQ(r.id, i + 2);     // replies carry the new row's ID
+    }
+    EXPECT_EQ(client.receive().code, static_cast<uint8_t>(Rpc::Status::FAILED));
+
+    Rpc::Frame counts = client.call(Rpc::Op::COUNTS);
+    Rpc::Reader r(counts.payload.data(), counts.payload.size());
+    EXPECT_EQ(r.i32(), 1);
+    EXPECT_EQ(r.i32(), count + 1);
+
+    w.str("person 150");
+    w.i32(5);
+    Rpc::Frame found = client.call(Rpc::Op::SEARCH, w);
+    Rpc::Reader fr(found.payload.data(), found.payload.size());
+    std::vector<SearchResult> results = Rpc::decodeList<SearchResult>(fr);
+    EXPECT_TRUE(fr.ok());
+    EXPECT_EQ(results.size(), 1u);
+
+    client.close();
+    server.stop();
+    loop.join();
+    ASSERT_LT(server.getStats().batches, static_cast<unsigned long long>(count));
+}
+
+TEST_F(GiftPlannerTest, ServerFailsRepliesOverTheFrameLimit) {
+    planner.batch([&]() {
+        for(int i = 0; i < 17000; i++)
+            planner.upsertRecipient(Recipient{0, std::to_string(i) + std::string(1000, 'x'), "Friend"});
+    });
+    std::string path = "/tmp/giftplanner_test_" + std::to_string(getpid()) + ".sock";
+    Rpc::Server server(planner, path);
+    server.listen();
+    std::thread loop([&]() { server.run(); });
+
+    // fails alone, the connection keeps working
+    Rpc::Client client;
+    client.connect(path);
+    client.send(Rpc::Op::GET_RECIPIENTS);
+    Rpc::Frame listed = client.receive();
+    EXPECT_EQ(listed.code, static_cast<uint8_t>(Rpc::Status::FAILED));
+    EXPECT_NE(std::string(listed.payload.begin(), listed.payload.end()).find("frame limit"), std::string::npos);
+    EXPECT_EQ(client.call(Rpc::Op::PING).code, static_cast<uint8_t>(Rpc::Status::OK));
+
+    client.close();
+    server.stop();
+    loop.join();
+}
+
+TEST_F(GiftPlannerTest, ServerPausesClientsThatDontRead) {
+    for(int i = 0; i < 200; i++)
+        planner.upsertRecipient(Recipient{0, "Person with a long name " + std::to_string(i), "Friend"});
+    size_t recipients = planner.getRecipients().size();
+    std::string path = "/tmp/giftplanner_test_" + std::to_string(getpid()) + ".sock";
+    Rpc::Server server(planner, path);
+    server.listen();
+    std::thread loop([&]() { server.run(); });
+
+    // the replies are far over the server's output cap, it stops reading until the client catches up
+    Rpc::Client client;
+    client.connect(path);
+    const int count = 2000;
+    std::thread sender([&]() {
+        for(int i = 0; i < count; i++)
+            client.send(Rpc::Op::GET_RECIPIENTS);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    for(int i = 0; i < count; i++) {
+        Rpc::Frame listed = client.receive();
+        ASSERT_EQ(listed.code, static_cast<uint8_t>(Rpc::Status::OK));
+        Rpc::Reader lr(listed.payload.data(), listed.payload.size());
+        ASSERT_EQ(Rpc::decodeList<Recipient>(lr).size(), recipients);
+    }
+    sender.join();
+
+    client.close();
+    server.stop();
+    loop.join();
+}
+#endif
+
+int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
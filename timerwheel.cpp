@@ -0,0 +1,142 @@
+#include "timerwheel.hpp"
+
+namespace App {
+
+    static int countTrailingZeros(std::uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_ctzll(bits);
+#else
+        int n = 0;
+        for(; !(bits & 1); bits >>= 1)
+            n++;
+        return n;
+#endif
+    }
+
+    // Distance from index from to the next set bit after it, going round, 1 to 64. bits must not be 0
+    static int nextSetBit(std::uint64_t bits, int from) {
+        int start = (from + 1) & 63;
+        std::uint64_t rotated = start ? (bits >> start) | (bits << (64 - start)) : bits;
+        return countTrailingZeros(rotated) + 1;
+    }
+
+    /*
+     * Class: TimerWheel
+     */
+    TimerWheel::TimerWheel(std::int64_t now) : current(now) {}
+
+    TimerWheel::TimerId TimerWheel::schedule(std::int64_t when, Callback callback) {
+        TimerId id = nextId++;
+        Slot created;
+        created.push_back(Timer{id, when, std::move(callback)});
+        place(created, created.begin());
+        return id;
+    }
+
+    bool TimerWheel::cancel(TimerId id) {
+        auto found = locations.find(id);
+        if(found == locations.end())
+            return false;
+        Location loc = found->second;
+        locations.erase(found);
+        if(loc.level < 0) {
+            overdue.erase(loc.it);
+            return true;
+        }
+        Slot& slot = wheel[loc.level][loc.slot];
+        slot.erase(loc.it);
+        if(slot.empty())
+            markEmpty(loc.level, loc.slot);
+        return true;
+    }
+
+    // Level L holds timers due within 64^(L+1) seconds, in the slot of their due time's
+    // L-th 6 bit digit. Its slot is reached (and emptied downwards) at a multiple of 64^L
+    void TimerWheel::place(Slot& from, Slot::iterator it) {
+        std::int64_t when = it->when;
+        Location loc{-1, 0, it};
+        Slot* to = &overdue;
+        if(when > current) {
+            std::int64_t delta = when - current;
+            int level = 0;
+            while(level < LEVELS - 1 && delta >= (std::int64_t(1) << (BITS * (level + 1))))
+                level++;
+            int slot = static_cast<int>((when >> (BITS * level)) & (SLOTS - 1));
+            to = &wheel[level][slot];
+            occupied[level] |= std::uint64_t(1) << slot;
+            loc.level = level;
+            loc.slot = slot;
+        }
+        to->splice(to->end(), from, it);
+        locations[it->id] = loc;
+    }
+
+    void TimerWheel::markEmpty(int level, int slot) {
+        occupied[level] &= ~(std::uint64_t(1) << slot);
+    }
+
+    // Earliest tick after current at which a slot fires (level 0) or cascades (higher levels)
+    std::optional<std::int64_t> TimerWheel::nextTick() const {
+        std::optional<std::int64_t> next;
+        for(int level = 0; level < LEVELS; level++) {
+            if(!occupied[level])
+                continue;
+            int shift = BITS * level;
+            std::int64_t turn = current >> shift;
+            int distance = nextSetBit(occupied[level], static_cast<int>(turn & (SLOTS - 1)));
+            std::int64_t tick = (turn + distance) << shift;
+            if(!next || tick < *next)
+                next = tick;
+        }
+        return next;
+    }
+
+    std::optional<std::int64_t> TimerWheel::nextWake() const {
+        if(!overdue.empty())
+            return current;
+        return nextTick();
+    }
+
+    size_t TimerWheel::advance(std::int64_t now) {
+        Slot fired;
+        while(true) {
+            fired.splice(fired.end(), overdue);
+            std::optional<std::int64_t> tick = nextTick();
+            if(!tick || *tick > now)
+                break;
+            current = *tick;
+            // highest level first, a timer can fall through several levels in one tick
+            for(int level = LEVELS - 1; level >= 1; level--) {
+                int shift = BITS * level;
+                if(current & ((std::int64_t(1) << shift) - 1))
+                    continue;
+                int slot = static_cast<int>((current >> shift) & (SLOTS - 1));
+                if(!(occupied[level] >> slot & 1))
+                    continue;
+                Slot moving;
+                moving.splice(moving.end(), wheel[level][slot]);
+                markEmpty(level, slot);
+                while(!moving.empty())
+                    place(moving, moving.begin());
+            }
+            int slot = static_cast<int>(current & (SLOTS - 1));
+            if(occupied[0] >> slot & 1) {
+                fired.splice(fired.end(), wheel[0][slot]);
+                markEmpty(0, slot);
+            }
+        }
+        if(now > current)
+            current = now;
+
+        // the wheel is consistent before any callback runs, they may schedule and cancel
+        for(const Timer& timer : fired)
+            locations.erase(timer.id);
+        size_t count = fired.size();
+        for(Timer& timer : fired)
+            timer.callback();
+        return count;
+    }
+
+    // end of Class: TimerWheel
+
+}
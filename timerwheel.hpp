@@ -0,0 +1,72 @@
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <optional>
+#include <unordered_map>
+
+namespace App {
+
+    /*
+     * Hierarchical timer wheel with one second ticks.
+     * Six levels of 64 slots, level L has slots 64^L seconds wide, together they reach about
+     * two thousand years ahead. A timer goes into the level whose span covers its distance from
+     * the wheel's current time, and moves down one or more levels when its slot is reached.
+     * Scheduling and cancelling are O(1). advance() jumps straight to the next tick that has
+     * work (an occupancy bitmap per level finds it), so idle stretches cost nothing however
+     * long they are. Times are seconds on any clock, e.g. unix time.
+     * Not thread safe, callbacks run inside advance() and may schedule or cancel timers.
+     */
+    class TimerWheel {
+        public:
+            using TimerId = std::uint64_t;
+            using Callback = std::function<void()>;
+
+            explicit TimerWheel(std::int64_t now);
+
+            // Fires at the first advance() that reaches when. A time already passed fires on the next advance()
+            TimerId schedule(std::int64_t when, Callback callback);
+            // False when the timer has already fired or was cancelled
+            bool cancel(TimerId id);
+            // Fires every timer due at or before now, in due order, and returns how many fired
+            size_t advance(std::int64_t now);
+            // The next time advance() has anything to do, nothing while the wheel is empty
+            std::optional<std::int64_t> nextWake() const;
+            std::int64_t now() const { return current; }
+            size_t size() const { return locations.size(); }
+
+        private:
+            static const int LEVELS = 6;
+            static const int SLOTS = 64;
+            static const int BITS = 6;
+
+            struct Timer {
+                TimerId id;
+                std::int64_t when;
+                Callback callback;
+            };
+            using Slot = std::list<Timer>;
+            struct Location {
+                int level;                  // -1: overdue
+                int slot;
+                Slot::iterator it;
+            };
+
+            // Moves the timer at it (in from) to the level and slot its due time needs
+            void place(Slot& from, Slot::iterator it);
+            std::optional<std::int64_t> nextTick() const;
+            void markEmpty(int level, int slot);
+
+            std::int64_t current;
+            TimerId nextId = 1;
+            std::array<std::array<Slot, SLOTS>, LEVELS> wheel;
+            std::array<std::uint64_t, LEVELS> occupied{};
+            Slot overdue;                   // scheduled at or before current
+            std::unordered_map<TimerId, Location> locations;
+    };
+
+}
+
+#endif
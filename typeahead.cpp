@@ -0,0 +1,186 @@
+#include "typeahead.hpp"
+#include <cctype>
+#include "logger.hpp"
+
+namespace App {
+
+    // Splits text into lowercase words the same way the search index tokenizes ASCII
+    // (unicode61 also folds non-ASCII case and diacritics, "café" matches "cafe", this doesn't)
+    static std::vector<std::string> words(const std::string& text) {
+        std::vector<std::string> out;
+        std::string word;
+        for(char c : text) {
+            unsigned char u = static_cast<unsigned char>(c);
+            if(std::isalnum(u) || u >= 0x80) {
+                word += static_cast<char>(std::tolower(u));
+            }
+            else if(!word.empty()) {
+                out.push_back(word);
+                word.clear();
+            }
+        }
+        if(!word.empty())
+            out.push_back(word);
+        return out;
+    }
+
+    static bool isAscii(const std::string& text) {
+        for(char c : text) {
+            if(static_cast<unsigned char>(c) >= 0x80)
+                return false;
+        }
+        return true;
+    }
+
+    static bool hasWordWithPrefix(const std::vector<std::string>& haystack, const std::string& prefix) {
+        for(const std::string& w : haystack) {
+            if(w.compare(0, prefix.size(), prefix) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    bool matchesQuery(const SearchResult& result, const std::string& query) {
+        std::vector<std::string> title = words(result.title);
+        std::vector<std::string> detail = words(result.detail);
+        for(const std::string& term : words(query)) {
+            if(!hasWordWithPrefix(title, term) && !hasWordWithPrefix(detail, term))
+                return false;
+        }
+        return true;
+    }
+
+    /*
+     * Class: TypeAhead
+     */
+    TypeAhead::TypeAhead(SearchFn search, int limit, std::chrono::milliseconds debounce)
+        : searchFn(std::move(search)), limit(limit), debounce(debounce) {
+        worker = std::thread(&TypeAhead::run, this);
+    }
+    TypeAhead::~TypeAhead() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stop = true;
+        }
+        cv.notify_one();
+        if(worker.joinable())
+            worker.join();
+    }
+
+    // Extending the query can only remove matches, so complete results are filtered in place
+    bool TypeAhead::narrow(const std::string& input) {
+        if(currentQuery.empty() || static_cast<int>(current.size()) >= limit)
+            return false;
+        if(input.compare(0, currentQuery.size(), currentQuery) != 0)
+            return false;
+        // non-ASCII text would be compared without the index's folding, the worker asks the index
+        if(!isAscii(input))
+            return false;
+        for(const SearchResult& r : current) {
+            if(!isAscii(r.title) || !isAscii(r.detail))
+                return false;
+        }
+        std::vector<SearchResult> kept;
+        kept.reserve(current.size());
+        for(SearchResult& r : current) {
+            if(matchesQuery(r, input))
+                kept.push_back(std::move(r));
+        }
+        current.swap(kept);
+        currentQuery = input;
+        return true;
+    }
+
+    void TypeAhead::invalidate() {
+        // a response still coming is for the old state
+        generation++;
+        inFlight = false;
+        invalidated = invalidated || !current.empty() || !currentQuery.empty();
+        current.clear();
+        currentQuery.clear();
+        dirty = !words(lastInput).empty();
+        lastChange = std::chrono::steady_clock::time_point();
+    }
+
+    bool TypeAhead::update(const std::string& input) {
+        bool changed = invalidated;
+        invalidated = false;
+        auto now = std::chrono::steady_clock::now();
+
+        if(input != lastInput) {
+            lastInput = input;
+            lastChange = now;
+            // whatever is in flight is for an older input now
+            generation++;
+            inFlight = false;
+            if(words(input).empty()) {
+                dirty = false;
+                changed = !current.empty() || !currentQuery.empty();
+                current.clear();
+                currentQuery.clear();
+            }
+            else if(narrow(input)) {
+                dirty = false;
+                changed = true;
+            }
+            else {
+                dirty = true;
+            }
+        }
+
+        if(dirty && now - lastChange >= debounce) {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                request = lastInput;
+                requestGeneration = generation;
+                hasRequest = true;
+            }
+            cv.notify_one();
+            dirty = false;
+            inFlight = true;
+        }
+
+        if(inFlight) {
+            std::lock_guard<std::mutex> lock(mtx);
+            if(hasResponse && responseGeneration == generation) {
+                current.swap(response);
+                currentQuery = lastInput;
+                hasResponse = false;
+                inFlight = false;
+                changed = true;
+            }
+        }
+        return changed;
+    }
+
+    void TypeAhead::run() {
+        std::unique_lock<std::mutex> lock(mtx);
+        while(true) {
+            cv.wait(lock, [this] { return stop || hasRequest; });
+            if(stop)
+                return;
+            std::string query = request;
+            unsigned long gen = requestGeneration;
+            hasRequest = false;
+
+            lock.unlock();
+            std::vector<SearchResult> found;
+            try {
+                found = searchFn(query, limit);
+            }
+            catch(const std::exception& e) {
+                Logger::error(std::string("[Search]: ") + e.what());
+            }
+            lock.lock();
+
+            // a newer request replaces this one
+            if(!hasRequest) {
+                response.swap(found);
+                responseGeneration = gen;
+                hasResponse = true;
+            }
+        }
+    }
+    // end of Class: TypeAhead
+
+}
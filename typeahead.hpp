@@ -0,0 +1,84 @@
+#ifndef TYPEAHEAD_H
+#define TYPEAHEAD_H
+#include "app.hpp"
+#include <vector>
+#include <string>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+namespace App {
+
+    /*
+     * Type-ahead search for text inputs.
+     * Call update() every frame with the current input, it only does work when the input changed:
+     *  - if the input extends the query of the current results and those results were complete
+     *    (fewer than limit), they are narrowed in memory right away. Only ASCII text is narrowed,
+     *    the index folds case and diacritics of every script and the local filter doesn't
+     *  - otherwise a query is sent to the worker thread once the input has been stable for the
+     *    debounce interval. Only the newest query matters, stale results are dropped.
+     *
+     * The search function runs on the worker thread and must not share a DBEngine with the UI,
+     * give it its own connection.
+     */
+    class TypeAhead {
+        public:
+            using SearchFn = std::function<std::vector<SearchResult>(const std::string& query, int limit)>;
+
+            explicit TypeAhead(SearchFn search, int limit=100,
+                               std::chrono::milliseconds debounce=std::chrono::milliseconds(150));
+            ~TypeAhead();
+
+            // Returns true when results() changed since the last call
+            bool update(const std::string& input);
+            const std::vector<SearchResult>& results() const { return current; }
+            // true while a query is waiting for the debounce or running on the worker
+            bool pending() const { return dirty || inFlight; }
+            const std::string& query() const { return currentQuery; }
+            // Drops the results and runs the current input again without waiting for the debounce,
+            // for when what the search function reads changed (e.g. another user)
+            void invalidate();
+
+            TypeAhead(const TypeAhead&) = delete;
+            TypeAhead& operator=(const TypeAhead&) = delete;
+
+        private:
+            void run();
+            bool narrow(const std::string& input);
+
+            SearchFn searchFn;
+            int limit;
+            std::chrono::milliseconds debounce;
+
+            // UI thread state
+            std::string lastInput;
+            std::string currentQuery;
+            std::vector<SearchResult> current;
+            std::chrono::steady_clock::time_point lastChange;
+            bool dirty = false;
+            bool inFlight = false;
+            bool invalidated = false;               // results dropped since the last update()
+            unsigned long generation = 0;
+
+            // shared with the worker, guarded by mtx
+            std::mutex mtx;
+            std::condition_variable cv;
+            bool stop = false;
+            bool hasRequest = false;
+            std::string request;
+            unsigned long requestGeneration = 0;
+            bool hasResponse = false;
+            std::vector<SearchResult> response;
+            unsigned long responseGeneration = 0;
+            std::thread worker;
+    };
+
+    // true if every word of query is a prefix of some word in result's title or detail.
+    // Matches like the search index for ASCII text only
+    bool matchesQuery(const SearchResult& result, const std::string& query);
+
+}
+
+#endif